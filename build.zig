@@ -107,6 +107,8 @@ pub fn build(b: *std.Build) void {
             "view/mesh_gui.cpp",
             "humanpose/humanpose_stream.cpp",
             "humanpose/bvhnode.cpp",
+            "humanpose/replaynode.cpp",
+            // "humanpose/udpnode.cpp",
             //
             "fs_util_win32.cpp",
         },
@@ -154,15 +156,28 @@ pub fn build(b: *std.Build) void {
             "vrm/importer.cpp",
             "vrm/runtime_scene.cpp",
             "vrm/animation.cpp",
+            "vrm/animation_layer.cpp",
+            "vrm/pose_cache.cpp",
+            "vrm/compressed_animation.cpp",
+            "vrm/keyframe_reducer.cpp",
+            "vrm/mapped_file.cpp",
+            "vrm/shared_memory.cpp",
             // "vrm/timeline.cpp",
             "vrm/spring_bone.cpp",
             "vrm/spring_collision.cpp",
             "vrm/runtime_springjoint.cpp",
             "vrm/network/srht_update.cpp",
+            "vrm/network/srht_jitter.cpp",
+            "vrm/network/quat_packer.cpp",
+            "vrm/network/srht_record.cpp",
+            "vrm/network/srht_dispatcher.cpp",
+            "vrm/network/srht_shm.cpp",
             // "vrm/network/srht_sender.cpp",
+            // "vrm/network/srht_receiver.cpp",
             "vrm/bvh/bvh.cpp",
             "vrm/bvh/bvhframe.cpp",
             "vrm/bvh/bvhscene.cpp",
+            "vrm/bvh/bvhstream.cpp",
             "vrm/humanoid/humanskeleton.cpp",
         },
         .flags = &FLAGS_WITH_CPP,
@@ -465,8 +465,15 @@ SceneRenderer::RenderRuntime(
 
   auto nodestates = runtime->m_base->NodeStates();
   if (nodestates.size()) {
+    runtime->SpringLodUpdate(m_camera->ViewMatrix,
+                             m_camera->ProjectionMatrix,
+                             viewport.Height,
+                             m_settings->SpringLodPixels);
     runtime->UpdateNodeStates(nodestates);
     m_settings->NextSpringDelta = {};
+    m_settings->SpringActive = runtime->m_springStats.Active;
+    m_settings->SpringSleeping = runtime->m_springStats.Sleeping;
+    m_settings->SpringLodReduced = runtime->m_springStats.LodReduced;
   }
 
   if (m_settings->ShowSpring) {
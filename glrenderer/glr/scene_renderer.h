@@ -26,6 +26,12 @@ struct ViewSettings
 {
   bool EnableSpring = true;
   libvrm::Time NextSpringDelta = libvrm::Time(0.0);
+  // chains smaller than this on screen are simulated at lower rate
+  float SpringLodPixels = 32;
+  // spring chain counts of the last frame
+  int SpringActive = 0;
+  int SpringSleeping = 0;
+  int SpringLodReduced = 0;
 
   // mesh
   bool ShowMesh = true;
@@ -10,31 +10,151 @@ WeightsCurve::GetValue(float time, bool repeat) const
     return Span(Times.size() - 1);
   }
 
-  while (time > Times.back()) {
-    time -= Times.back();
-    if (time < 0) {
-      time = 0;
-    }
+  time = WrapTime(time, Times.back());
+
+  auto i = FindKeyframe(Times, time, &m_cursor);
+  if (i == 0) {
+    return Span(0);
+  }
+  if (i == Times.size()) {
+    return Span(Times.size() - 1);
+  }
+  if (Interpolation == gltfjson::AnimationInterpolationModes::STEP) {
+    return Span(i - 1);
   }
+  if (IsCubic()) {
+    m_lerpBuffer.resize(WeightsCount);
+    GetValue(time, repeat, m_lerpBuffer);
+    return m_lerpBuffer;
+  }
+  auto lastTime = Times[i - 1];
+  return SpanLerp(i - 1, i, (time - lastTime) / (Times[i] - lastTime));
+}
 
-  float lastTime = 0;
-  for (int i = 0; i < Times.size(); ++i) {
-    auto current = Times[i];
-    if (current > time) {
-      if (i == 0) {
-        return Span(0);
-      }
-      if (Interpolation == gltfjson::AnimationInterpolationModes::STEP) {
-        return Span(i - 1);
-      } else {
-        // TODO: cubic
-        return SpanLerp(i - 1, i, (time - lastTime) / (current - lastTime));
-      }
+void
+WeightsCurve::GetValue(float time, bool repeat, std::span<float> dst) const
+{
+  auto count = std::min<size_t>(dst.size(), WeightsCount);
+  auto write = [dst, count](std::span<const float> src) {
+    std::copy(src.begin(), src.begin() + count, dst.begin());
+  };
+
+  if (!repeat && time > Times.back()) {
+    write(Span(Times.size() - 1));
+    return;
+  }
+  time = WrapTime(time, Times.back());
+
+  auto i = FindKeyframe(Times, time, &m_cursor);
+  if (i == 0) {
+    write(Span(0));
+    return;
+  }
+  if (i == Times.size()) {
+    write(Span(Times.size() - 1));
+    return;
+  }
+  if (Interpolation == gltfjson::AnimationInterpolationModes::STEP) {
+    write(Span(i - 1));
+    return;
+  }
+  auto lastTime = Times[i - 1];
+  auto dt = Times[i] - lastTime;
+  auto t = (time - lastTime) / dt;
+  auto l = Span(i - 1);
+  auto r = Span(i);
+  if (IsCubic()) {
+    auto out = Span(i - 1, 2);
+    auto in = Span(i, 0);
+    size_t j = 0;
+    // 4 weights at once
+    for (; j + 4 <= count; j += 4) {
+      DirectX::XMStoreFloat4(
+        (DirectX::XMFLOAT4*)&dst[j],
+        XMHermite(DirectX::XMLoadFloat4((const DirectX::XMFLOAT4*)&l[j]),
+                  DirectX::XMLoadFloat4((const DirectX::XMFLOAT4*)&out[j]),
+                  DirectX::XMLoadFloat4((const DirectX::XMFLOAT4*)&in[j]),
+                  DirectX::XMLoadFloat4((const DirectX::XMFLOAT4*)&r[j]),
+                  dt,
+                  t));
+    }
+    for (; j < count; ++j) {
+      dst[j] = Hermite(l[j], out[j], in[j], r[j], dt, t);
     }
-    lastTime = current;
+    return;
   }
+  for (size_t j = 0; j < count; ++j) {
+    dst[j] = Lerp(l[j], r[j], t);
+  }
+}
 
-  return Span(Times.size() - 1);
+void
+AnimationBinding::Update(Time time, bool repeat) const
+{
+  float seconds = time.count();
+  for (auto& channel : Translations) {
+    *channel.Target = channel.Source->GetValue(seconds, repeat);
+  }
+  for (auto& channel : Rotations) {
+    *channel.Target = channel.Source->GetValue(seconds, repeat);
+  }
+  for (auto& channel : Scales) {
+    *channel.Target = channel.Source->GetValue(seconds, repeat);
+  }
+  for (auto& channel : Weights) {
+    channel.Source->GetValue(seconds, repeat, channel.Target);
+  }
+}
+
+size_t
+AnimationBinding::ValueCount() const
+{
+  size_t count =
+    Translations.size() * 3 + Rotations.size() * 4 + Scales.size() * 3;
+  for (auto& channel : Weights) {
+    count += channel.Target.size();
+  }
+  return count;
+}
+
+void
+AnimationBinding::Store(std::span<float> dst) const
+{
+  auto p = dst.data();
+  for (auto& channel : Translations) {
+    p = std::copy_n(&channel.Target->x, 3, p);
+  }
+  for (auto& channel : Rotations) {
+    p = std::copy_n(&channel.Target->x, 4, p);
+  }
+  for (auto& channel : Scales) {
+    p = std::copy_n(&channel.Target->x, 3, p);
+  }
+  for (auto& channel : Weights) {
+    p = std::copy(channel.Target.begin(), channel.Target.end(), p);
+  }
+}
+
+void
+AnimationBinding::Load(std::span<const float> src) const
+{
+  auto p = src.data();
+  for (auto& channel : Translations) {
+    std::copy_n(p, 3, &channel.Target->x);
+    p += 3;
+  }
+  for (auto& channel : Rotations) {
+    std::copy_n(p, 4, &channel.Target->x);
+    p += 4;
+  }
+  for (auto& channel : Scales) {
+    std::copy_n(p, 3, &channel.Target->x);
+    p += 3;
+  }
+  for (auto& channel : Weights) {
+    std::copy_n(p, channel.Target.size(), channel.Target.begin());
+    p += channel.Target.size();
+  }
 }
 
 Animation::Animation(std::u8string_view name)
@@ -122,31 +242,76 @@ Animation::AddWeights(uint32_t node_index,
       .Name = { name.begin(), name.end() },
       .Times = { times.begin(), times.end() },
       .Values = { values.begin(), values.end() },
-      .WeightsCount = static_cast<uint32_t>(values.size() / times.size()),
+      .WeightsCount = static_cast<uint32_t>(
+        values.size() / times.size() /
+        (interpolation == gltfjson::AnimationInterpolationModes::CUBICSPLINE
+           ? 3
+           : 1)),
       .Interpolation = interpolation,
     });
 }
 
-void
-Animation::Update(Time time, RuntimeScene& runtime, bool repeat) const
+std::shared_ptr<AnimationBinding>
+Animation::Bind(RuntimeScene& runtime) const
 {
-  float seconds = time.count();
+  auto binding = std::make_shared<AnimationBinding>();
+  auto getNode = [&runtime, &binding](uint32_t i) -> RuntimeNode* {
+    if (i >= runtime.m_nodes.size()) {
+      return nullptr;
+    }
+    binding->Nodes.push_back(runtime.m_nodes[i]);
+    return binding->Nodes.back().get();
+  };
   for (auto& [k, v] : m_translationMap) {
-    auto node = runtime.m_nodes[k];
-    node->Transform.Translation = v.GetValue(seconds, repeat);
+    if (auto node = getNode(k)) {
+      binding->Translations.push_back({ &v, &node->Transform.Translation });
+    }
   }
   for (auto& [k, v] : m_rotationMap) {
-    auto node = runtime.m_nodes[k];
-    node->Transform.Rotation = v.GetValue(seconds, repeat);
+    if (auto node = getNode(k)) {
+      binding->Rotations.push_back({ &v, &node->Transform.Rotation });
+    }
   }
   for (auto& [k, v] : m_scaleMap) {
-    auto node = runtime.m_nodes[k];
-    node->Scale = v.GetValue(seconds, repeat);
+    if (auto node = getNode(k)) {
+      binding->Scales.push_back({ &v, &node->Scale });
+    }
+  }
+  for (auto& [k, v] : m_weightsMap) {
+    binding->Weights.push_back({ &v, runtime.MorphWeights(k, v.WeightsCount) });
+  }
+  return binding;
+}
+
+std::shared_ptr<AnimationBinding>
+Animation::Bind(RuntimeScene& runtime, AnimationPose& pose) const
+{
+  pose.Resize(runtime.m_nodes.size());
+  std::fill(pose.Animated.begin(), pose.Animated.end(), AnimationPose::None);
+
+  auto binding = std::make_shared<AnimationBinding>();
+  for (auto& [k, v] : m_translationMap) {
+    if (k < pose.Animated.size()) {
+      binding->Translations.push_back({ &v, &pose.Translations[k] });
+      pose.Animated[k] |= AnimationPose::Translation;
+    }
+  }
+  for (auto& [k, v] : m_rotationMap) {
+    if (k < pose.Animated.size()) {
+      binding->Rotations.push_back({ &v, &pose.Rotations[k] });
+      pose.Animated[k] |= AnimationPose::Rotation;
+    }
+  }
+  for (auto& [k, v] : m_scaleMap) {
+    if (k < pose.Animated.size()) {
+      binding->Scales.push_back({ &v, &pose.Scales[k] });
+      pose.Animated[k] |= AnimationPose::Scale;
+    }
   }
   for (auto& [k, v] : m_weightsMap) {
-    auto values = v.GetValue(seconds, repeat);
-    runtime.SetMorphWeights(k, values);
+    binding->Weights.push_back({ &v, runtime.MorphWeights(k, v.WeightsCount) });
   }
+  return binding;
 }
 
 } // namespace
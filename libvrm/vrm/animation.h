@@ -2,6 +2,8 @@
 #include "node.h"
 #include "runtime_scene.h"
 #include "timeline.h"
+#include <algorithm>
+#include <cmath>
 #include <span>
 #include <unordered_map>
 #include <vector>
@@ -36,6 +38,102 @@ Lerp(const DirectX::XMFLOAT4& lhs, const DirectX::XMFLOAT4& rhs, float t)
   return dst;
 }
 
+// CUBICSPLINE. glTF tangents are scaled by the key interval dt
+inline float
+Hermite(float v0, float out0, float in1, float v1, float dt, float t)
+{
+  auto t2 = t * t;
+  auto t3 = t2 * t;
+  return (2 * t3 - 3 * t2 + 1) * v0 + (t3 - 2 * t2 + t) * dt * out0 +
+         (-2 * t3 + 3 * t2) * v1 + (t3 - t2) * dt * in1;
+}
+
+inline DirectX::XMVECTOR
+XMHermite(DirectX::FXMVECTOR v0,
+          DirectX::FXMVECTOR out0,
+          DirectX::FXMVECTOR in1,
+          DirectX::GXMVECTOR v1,
+          float dt,
+          float t)
+{
+  return DirectX::XMVectorHermite(v0,
+                                  DirectX::XMVectorScale(out0, dt),
+                                  v1,
+                                  DirectX::XMVectorScale(in1, dt),
+                                  t);
+}
+
+inline DirectX::XMFLOAT3
+Hermite(const DirectX::XMFLOAT3& v0,
+        const DirectX::XMFLOAT3& out0,
+        const DirectX::XMFLOAT3& in1,
+        const DirectX::XMFLOAT3& v1,
+        float dt,
+        float t)
+{
+  DirectX::XMFLOAT3 dst;
+  DirectX::XMStoreFloat3(&dst,
+                         XMHermite(DirectX::XMLoadFloat3(&v0),
+                                   DirectX::XMLoadFloat3(&out0),
+                                   DirectX::XMLoadFloat3(&in1),
+                                   DirectX::XMLoadFloat3(&v1),
+                                   dt,
+                                   t));
+  return dst;
+}
+
+inline DirectX::XMFLOAT4
+Hermite(const DirectX::XMFLOAT4& v0,
+        const DirectX::XMFLOAT4& out0,
+        const DirectX::XMFLOAT4& in1,
+        const DirectX::XMFLOAT4& v1,
+        float dt,
+        float t)
+{
+  DirectX::XMFLOAT4 dst;
+  DirectX::XMStoreFloat4(
+    &dst,
+    DirectX::XMQuaternionNormalize(XMHermite(DirectX::XMLoadFloat4(&v0),
+                                             DirectX::XMLoadFloat4(&out0),
+                                             DirectX::XMLoadFloat4(&in1),
+                                             DirectX::XMLoadFloat4(&v1),
+                                             dt,
+                                             t)));
+  return dst;
+}
+
+// repeat の時に time を [0, duration] に畳む
+inline float
+WrapTime(float time, float duration)
+{
+  if (time > duration && duration > 0) {
+    time = std::fmod(time, duration);
+  }
+  return time;
+}
+
+// return first index that times[index] > time. times.size() if not found.
+// cursor is the last result. forward playback is O(1), seek is O(log n).
+inline size_t
+FindKeyframe(std::span<const float> times, float time, size_t* cursor)
+{
+  auto isKey = [times, time](size_t i) {
+    return (i == 0 || times[i - 1] <= time) &&
+           (i == times.size() || times[i] > time);
+  };
+  auto i = std::min(*cursor, times.size());
+  if (isKey(i)) {
+    return i;
+  }
+  if (i < times.size() && isKey(i + 1)) {
+    *cursor = i + 1;
+    return i + 1;
+  }
+  i = std::upper_bound(times.begin(), times.end(), time) - times.begin();
+  *cursor = i;
+  return i;
+}
+
 template<typename T>
 struct Curve
 {
@@ -43,47 +141,52 @@ struct Curve
   std::vector<float> Times;
   std::vector<T> Values;
   gltfjson::AnimationInterpolationModes Interpolation;
+  mutable size_t m_cursor = 0;
 
   float MaxSeconds() const { return Times.empty() ? 0 : Times.back(); }
 
+  bool IsCubic() const
+  {
+    return Interpolation ==
+           gltfjson::AnimationInterpolationModes::CUBICSPLINE;
+  }
+
+  // CUBICSPLINE has [in-tangent, value, out-tangent] per key
+  const T& Value(size_t i) const
+  {
+    return IsCubic() ? Values[i * 3 + 1] : Values[i];
+  }
+
   T GetValue(float time, bool repeat) const
   {
     if (!repeat && time > Times.back()) {
-      return Values.back();
+      return Value(Times.size() - 1);
     }
+    time = WrapTime(time, Times.back());
 
-    while (time > Times.back()) {
-      if (Times.back() <= 0) {
-        break;
-      }
-      time -= Times.back();
-      if (time < 0) {
-        time = 0;
-      }
+    auto i = FindKeyframe(Times, time, &m_cursor);
+    if (i == 0) {
+      return Value(0);
     }
-
-    float lastTime = 0;
-    T last = {};
-    for (int i = 0; i < Times.size(); ++i) {
-      auto current = Times[i];
-      auto value = Values[i];
-      if (current > time) {
-        if (i == 0) {
-          return value;
-        }
-        if (Interpolation == gltfjson::AnimationInterpolationModes::STEP) {
-          return last;
-        } else {
-          // use linear
-          // TOOD: cubic
-          return Lerp(last, value, (time - lastTime) / (current - lastTime));
-        }
-        return value;
-      }
-      last = value;
-      lastTime = current;
+    if (i == Times.size()) {
+      return Value(Times.size() - 1);
+    }
+    if (Interpolation == gltfjson::AnimationInterpolationModes::STEP) {
+      return Value(i - 1);
+    }
+    auto lastTime = Times[i - 1];
+    auto dt = Times[i] - lastTime;
+    auto t = (time - lastTime) / dt;
+    if (IsCubic()) {
+      return Hermite(Values[(i - 1) * 3 + 1],
+                     Values[(i - 1) * 3 + 2],
+                     Values[i * 3],
+                     Values[i * 3 + 1],
+                     dt,
+                     t);
     }
-    return Values.back();
+    // use linear
+    return Lerp(Value(i - 1), Value(i), t);
   }
 };
 
@@ -97,10 +200,20 @@ struct WeightsCurve
   float MaxSeconds() const { return Times.empty() ? 0 : Times.back(); }
 
   mutable std::vector<float> m_lerpBuffer;
+  mutable size_t m_cursor = 0;
 
-  std::span<const float> Span(size_t index) const
+  bool IsCubic() const
   {
-    auto begin = index * WeightsCount;
+    return Interpolation ==
+           gltfjson::AnimationInterpolationModes::CUBICSPLINE;
+  }
+
+  // CUBICSPLINE has [in-tangents, values, out-tangents] per key
+  // element: 0 => in-tangent, 1 => value, 2 => out-tangent
+  std::span<const float> Span(size_t index, size_t element = 1) const
+  {
+    auto begin =
+      (IsCubic() ? index * 3 + element : index) * WeightsCount;
     return { Values.data() + begin, Values.data() + begin + WeightsCount };
   }
 
@@ -118,6 +231,65 @@ struct WeightsCurve
   }
 
   std::span<const float> GetValue(float time, bool repeat) const;
+  // write to dst without buffer
+  void GetValue(float time, bool repeat, std::span<float> dst) const;
+};
+
+// scene に解決済みの channel
+template<typename T>
+struct AnimationChannel
+{
+  const Curve<T>* Source;
+  T* Target;
+};
+
+struct AnimationWeightsChannel
+{
+  const WeightsCurve* Source;
+  std::span<float> Target;
+};
+
+// contiguous local pose indexed by node
+struct AnimationPose
+{
+  enum Channels : uint8_t
+  {
+    None = 0,
+    Translation = 1,
+    Rotation = 2,
+    Scale = 4,
+  };
+  std::vector<DirectX::XMFLOAT3> Translations;
+  std::vector<DirectX::XMFLOAT4> Rotations;
+  std::vector<DirectX::XMFLOAT3> Scales;
+  // animated channels per node
+  std::vector<uint8_t> Animated;
+
+  void Resize(size_t size)
+  {
+    Translations.resize(size, { 0, 0, 0 });
+    Rotations.resize(size, { 0, 0, 0, 1 });
+    Scales.resize(size, { 1, 1, 1 });
+    Animated.resize(size, None);
+  }
+};
+
+// Animation::Bind で作る。Update は heap を使わない
+struct AnimationBinding
+{
+  // keep target nodes alive
+  std::vector<std::shared_ptr<RuntimeNode>> Nodes;
+  std::vector<AnimationChannel<DirectX::XMFLOAT3>> Translations;
+  std::vector<AnimationChannel<DirectX::XMFLOAT4>> Rotations;
+  std::vector<AnimationChannel<DirectX::XMFLOAT3>> Scales;
+  std::vector<AnimationWeightsChannel> Weights;
+
+  void Update(Time time, bool repeat = false) const;
+
+  // snapshot of the sampled targets for PoseCache
+  size_t ValueCount() const;
+  void Store(std::span<float> dst) const;
+  void Load(std::span<const float> src) const;
 };
 
 struct Animation
@@ -156,7 +328,12 @@ struct Animation
                   std::u8string_view name,
                   gltfjson::AnimationInterpolationModes interpolation);
 
-  void Update(Time time, RuntimeScene& runtime, bool repeat = false) const;
+  // The Animation must outlive the binding
+  std::shared_ptr<AnimationBinding> Bind(RuntimeScene& runtime) const;
+  // node channels to the pose. pose must not be resized after this.
+  // morph weights are written to the scene.
+  std::shared_ptr<AnimationBinding> Bind(RuntimeScene& runtime,
+                                         AnimationPose& pose) const;
 };
 
 }
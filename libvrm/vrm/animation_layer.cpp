@@ -0,0 +1,387 @@
+#include "animation_layer.h"
+#include "runtime_node.h"
+#include "runtime_scene.h"
+#include <algorithm>
+
+namespace libvrm {
+
+void
+AnimationLayerStack::Initialize(const RuntimeScene& runtime)
+{
+  auto size = runtime.m_nodes.size();
+  m_rest.Resize(size);
+  m_result.Resize(size);
+  m_translationWeights.resize(size);
+  m_rotationWeights.resize(size);
+  m_scaleWeights.resize(size);
+  for (size_t i = 0; i < size; ++i) {
+    auto& base = runtime.m_nodes[i]->Base;
+    m_rest.Translations[i] = base->InitialTransform.Translation;
+    m_rest.Rotations[i] = base->InitialTransform.Rotation;
+    m_rest.Scales[i] = base->InitialScale;
+  }
+}
+
+std::shared_ptr<AnimationLayer>
+AnimationLayerStack::AddLayer(RuntimeScene& runtime,
+                              const std::shared_ptr<Animation>& clip,
+                              AnimationBlendModes mode)
+{
+  if (m_rest.Animated.size() != runtime.m_nodes.size()) {
+    Initialize(runtime);
+  }
+  auto layer = std::make_shared<AnimationLayer>();
+  layer->Name = { (const char*)clip->m_name.data(), clip->m_name.size() };
+  layer->Clip = clip;
+  layer->Mode = mode;
+  layer->m_binding = clip->Bind(runtime, layer->m_pose);
+  Layers.push_back(layer);
+  return layer;
+}
+
+void
+AnimationLayerStack::Rebind(RuntimeScene& runtime)
+{
+  Initialize(runtime);
+  for (auto& layer : Layers) {
+    layer->m_binding = layer->Clip->Bind(runtime, layer->m_pose);
+  }
+}
+
+void
+AnimationLayerStack::RemoveLayer(const std::shared_ptr<AnimationLayer>& layer)
+{
+  Layers.erase(std::remove(Layers.begin(), Layers.end(), layer), Layers.end());
+}
+
+Time
+AnimationLayerStack::Duration() const
+{
+  Time duration = {};
+  for (auto& layer : Layers) {
+    duration = std::max(duration, layer->Clip->Duration());
+  }
+  return duration;
+}
+
+void
+AnimationLayerStack::SetBoneMask(AnimationLayer& layer,
+                                 const RuntimeScene& runtime,
+                                 std::span<const HumanBones> bones)
+{
+  layer.NodeMask.clear();
+  if (bones.empty()) {
+    return;
+  }
+  layer.NodeMask.resize(runtime.m_nodes.size(), 0.0f);
+  for (size_t i = 0; i < runtime.m_nodes.size(); ++i) {
+    for (auto node = runtime.m_nodes[i]; node; node = node->Parent.lock()) {
+      if (auto bone = node->Base->Humanoid) {
+        if (std::find(bones.begin(), bones.end(), *bone) != bones.end()) {
+          layer.NodeMask[i] = 1.0f;
+          break;
+        }
+      }
+    }
+  }
+}
+
+// 4 quaternions in SoA
+struct Quaternion4
+{
+  DirectX::XMVECTOR X;
+  DirectX::XMVECTOR Y;
+  DirectX::XMVECTOR Z;
+  DirectX::XMVECTOR W;
+
+  static Quaternion4 Load(const DirectX::XMFLOAT4* src)
+  {
+    auto m = DirectX::XMMatrixTranspose({ DirectX::XMLoadFloat4(src),
+                                          DirectX::XMLoadFloat4(src + 1),
+                                          DirectX::XMLoadFloat4(src + 2),
+                                          DirectX::XMLoadFloat4(src + 3) });
+    return { m.r[0], m.r[1], m.r[2], m.r[3] };
+  }
+
+  void Store(DirectX::XMFLOAT4* dst) const
+  {
+    auto m = DirectX::XMMatrixTranspose({ X, Y, Z, W });
+    DirectX::XMStoreFloat4(dst, m.r[0]);
+    DirectX::XMStoreFloat4(dst + 1, m.r[1]);
+    DirectX::XMStoreFloat4(dst + 2, m.r[2]);
+    DirectX::XMStoreFloat4(dst + 3, m.r[3]);
+  }
+};
+
+static DirectX::XMVECTOR
+Dot4(const Quaternion4& a, const Quaternion4& b)
+{
+  using namespace DirectX;
+  return XMVectorMultiplyAdd(
+    a.X,
+    b.X,
+    XMVectorMultiplyAdd(
+      a.Y, b.Y, XMVectorMultiplyAdd(a.Z, b.Z, XMVectorMultiply(a.W, b.W))));
+}
+
+// slerp approximated by nlerp on the shorter arc.
+// t is corrected by a fitted polynomial of the angle
+static Quaternion4
+Slerp4(const Quaternion4& a, const Quaternion4& b, DirectX::XMVECTOR t)
+{
+  using namespace DirectX;
+  auto dot = Dot4(a, b);
+  auto d = XMVectorAbs(dot);
+  auto A = XMVectorMultiplyAdd(
+    d,
+    XMVectorMultiplyAdd(
+      d,
+      XMVectorMultiplyAdd(
+        d, XMVectorReplicate(-1.43519f), XMVectorReplicate(3.55645f)),
+      XMVectorReplicate(-3.2452f)),
+    XMVectorReplicate(1.0904f));
+  auto B = XMVectorMultiplyAdd(
+    d,
+    XMVectorMultiplyAdd(
+      d, XMVectorReplicate(0.215638f), XMVectorReplicate(-1.06021f)),
+    XMVectorReplicate(0.848013f));
+  auto h = XMVectorSubtract(t, g_XMOneHalf);
+  auto k = XMVectorMultiplyAdd(A, XMVectorMultiply(h, h), B);
+  // t + t * (t - 0.5) * (t - 1) * k
+  t = XMVectorMultiplyAdd(
+    XMVectorMultiply(XMVectorMultiply(t, h), XMVectorSubtract(t, g_XMOne)),
+    k,
+    t);
+
+  auto s = XMVectorSubtract(g_XMOne, t);
+  // -b for the other hemisphere
+  auto negative = XMVectorLess(dot, XMVectorZero());
+  t = XMVectorSelect(t, XMVectorNegate(t), negative);
+  Quaternion4 r{
+    XMVectorMultiplyAdd(b.X, t, XMVectorMultiply(a.X, s)),
+    XMVectorMultiplyAdd(b.Y, t, XMVectorMultiply(a.Y, s)),
+    XMVectorMultiplyAdd(b.Z, t, XMVectorMultiply(a.Z, s)),
+    XMVectorMultiplyAdd(b.W, t, XMVectorMultiply(a.W, s)),
+  };
+  auto inv = XMVectorReciprocalSqrt(Dot4(r, r));
+  return { XMVectorMultiply(r.X, inv),
+           XMVectorMultiply(r.Y, inv),
+           XMVectorMultiply(r.Z, inv),
+           XMVectorMultiply(r.W, inv) };
+}
+
+// same order as XMQuaternionMultiply. rotate by a, then b
+static Quaternion4
+Multiply4(const Quaternion4& a, const Quaternion4& b)
+{
+  using namespace DirectX;
+  return {
+    XMVectorSubtract(
+      XMVectorMultiplyAdd(
+        b.W, a.X, XMVectorMultiplyAdd(b.X, a.W, XMVectorMultiply(b.Y, a.Z))),
+      XMVectorMultiply(b.Z, a.Y)),
+    XMVectorSubtract(
+      XMVectorMultiplyAdd(
+        b.W, a.Y, XMVectorMultiplyAdd(b.Y, a.W, XMVectorMultiply(b.Z, a.X))),
+      XMVectorMultiply(b.X, a.Z)),
+    XMVectorSubtract(
+      XMVectorMultiplyAdd(
+        b.W, a.Z, XMVectorMultiplyAdd(b.Z, a.W, XMVectorMultiply(b.X, a.Y))),
+      XMVectorMultiply(b.Y, a.X)),
+    XMVectorSubtract(
+      XMVectorMultiply(b.W, a.W),
+      XMVectorMultiplyAdd(
+        b.X, a.X, XMVectorMultiplyAdd(b.Y, a.Y, XMVectorMultiply(b.Z, a.Z)))),
+  };
+}
+
+static Quaternion4
+Conjugate4(const Quaternion4& q)
+{
+  using namespace DirectX;
+  return { XMVectorNegate(q.X), XMVectorNegate(q.Y), XMVectorNegate(q.Z), q.W };
+}
+
+// the tail is padded with identity
+template<typename F>
+static void
+ForEachQuaternion4(std::span<DirectX::XMFLOAT4> dst,
+                   std::span<const DirectX::XMFLOAT4> src,
+                   std::span<const DirectX::XMFLOAT4> rest,
+                   std::span<const float> weights,
+                   const F& f)
+{
+  auto size = dst.size();
+  size_t i = 0;
+  for (; i + 4 <= size; i += 4) {
+    f(Quaternion4::Load(&dst[i]),
+      Quaternion4::Load(&src[i]),
+      Quaternion4::Load(&rest[i]),
+      DirectX::XMLoadFloat4((const DirectX::XMFLOAT4*)&weights[i]))
+      .Store(&dst[i]);
+  }
+  if (i == size) {
+    return;
+  }
+  DirectX::XMFLOAT4 d[4];
+  DirectX::XMFLOAT4 s[4];
+  DirectX::XMFLOAT4 r[4];
+  float w[4] = {};
+  for (size_t j = 0; j < 4; ++j) {
+    d[j] = s[j] = r[j] = { 0, 0, 0, 1 };
+    if (i + j < size) {
+      d[j] = dst[i + j];
+      s[j] = src[i + j];
+      r[j] = rest[i + j];
+      w[j] = weights[i + j];
+    }
+  }
+  f(Quaternion4::Load(d),
+    Quaternion4::Load(s),
+    Quaternion4::Load(r),
+    DirectX::XMLoadFloat4((const DirectX::XMFLOAT4*)w))
+    .Store(d);
+  for (size_t j = 0; i + j < size; ++j) {
+    dst[i + j] = d[j];
+  }
+}
+
+static void
+BlendRotations(std::span<DirectX::XMFLOAT4> dst,
+               std::span<const DirectX::XMFLOAT4> src,
+               std::span<const DirectX::XMFLOAT4> rest,
+               std::span<const float> weights,
+               AnimationBlendModes mode)
+{
+  if (mode == AnimationBlendModes::Additive) {
+    // local = delta * rest
+    ForEachQuaternion4(dst,
+                       src,
+                       rest,
+                       weights,
+                       [](const Quaternion4& d,
+                          const Quaternion4& s,
+                          const Quaternion4& r,
+                          DirectX::XMVECTOR w) {
+        auto identity = Quaternion4{ DirectX::XMVectorZero(),
+                                     DirectX::XMVectorZero(),
+                                     DirectX::XMVectorZero(),
+                                     DirectX::g_XMOne };
+        auto delta = Multiply4(s, Conjugate4(r));
+        return Multiply4(Slerp4(identity, delta, w), d);
+      });
+  } else {
+    ForEachQuaternion4(dst,
+                       src,
+                       rest,
+                       weights,
+                       [](const Quaternion4& d,
+                          const Quaternion4& s,
+                          const Quaternion4&,
+                          DirectX::XMVECTOR w) { return Slerp4(d, s, w); });
+  }
+}
+
+static void
+BlendFloat3(std::span<DirectX::XMFLOAT3> dst,
+            std::span<const DirectX::XMFLOAT3> src,
+            std::span<const DirectX::XMFLOAT3> rest,
+            std::span<const float> weights,
+            AnimationBlendModes mode)
+{
+  auto size = dst.size();
+  if (mode == AnimationBlendModes::Additive) {
+    // dst + (src - rest) * w
+    for (size_t i = 0; i < size; ++i) {
+      auto w = weights[i];
+      dst[i].x += (src[i].x - rest[i].x) * w;
+      dst[i].y += (src[i].y - rest[i].y) * w;
+      dst[i].z += (src[i].z - rest[i].z) * w;
+    }
+  } else {
+    for (size_t i = 0; i < size; ++i) {
+      auto w = weights[i];
+      dst[i].x += (src[i].x - dst[i].x) * w;
+      dst[i].y += (src[i].y - dst[i].y) * w;
+      dst[i].z += (src[i].z - dst[i].z) * w;
+    }
+  }
+}
+
+void
+AnimationLayerStack::Update(Time time, RuntimeScene& runtime, bool repeat)
+{
+  if (m_rest.Animated.size() != runtime.m_nodes.size()) {
+    return;
+  }
+
+  // start from the rest pose
+  std::copy(m_rest.Translations.begin(),
+            m_rest.Translations.end(),
+            m_result.Translations.begin());
+  std::copy(m_rest.Rotations.begin(),
+            m_rest.Rotations.end(),
+            m_result.Rotations.begin());
+  std::copy(
+    m_rest.Scales.begin(), m_rest.Scales.end(), m_result.Scales.begin());
+  std::fill(m_result.Animated.begin(),
+            m_result.Animated.end(),
+            AnimationPose::None);
+
+  auto size = m_result.Animated.size();
+  for (auto& layer : Layers) {
+    if (!layer->Enabled || layer->Weight <= 0 || !layer->m_binding) {
+      continue;
+    }
+    layer->m_binding->Update(time, repeat);
+
+    // weight per node and channel. no branch in the blend
+    auto& pose = layer->m_pose;
+    bool masked = layer->NodeMask.size() == size;
+    for (size_t i = 0; i < size; ++i) {
+      auto weight = masked ? layer->Weight * layer->NodeMask[i] : layer->Weight;
+      auto channels = weight > 0 ? pose.Animated[i] : AnimationPose::None;
+      m_translationWeights[i] =
+        channels & AnimationPose::Translation ? weight : 0;
+      m_rotationWeights[i] = channels & AnimationPose::Rotation ? weight : 0;
+      m_scaleWeights[i] = channels & AnimationPose::Scale ? weight : 0;
+      m_result.Animated[i] |= channels;
+    }
+
+    BlendFloat3(m_result.Translations,
+                pose.Translations,
+                m_rest.Translations,
+                m_translationWeights,
+                layer->Mode);
+    BlendRotations(m_result.Rotations,
+                   pose.Rotations,
+                   m_rest.Rotations,
+                   m_rotationWeights,
+                   layer->Mode);
+    BlendFloat3(m_result.Scales,
+                pose.Scales,
+                m_rest.Scales,
+                m_scaleWeights,
+                layer->Mode);
+  }
+
+  // write once
+  for (size_t i = 0; i < size; ++i) {
+    auto channels = m_result.Animated[i];
+    if (!channels) {
+      continue;
+    }
+    auto& node = runtime.m_nodes[i];
+    if (channels & AnimationPose::Translation) {
+      node->Transform.Translation = m_result.Translations[i];
+    }
+    if (channels & AnimationPose::Rotation) {
+      node->Transform.Rotation = m_result.Rotations[i];
+    }
+    if (channels & AnimationPose::Scale) {
+      node->Scale = m_result.Scales[i];
+    }
+  }
+}
+
+} // namespace
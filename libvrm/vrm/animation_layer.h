@@ -0,0 +1,67 @@
+#pragma once
+#include "animation.h"
+#include "humanoid/humanbones.h"
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace libvrm {
+
+enum class AnimationBlendModes
+{
+  // lerp/slerp from the layers below
+  Override,
+  // add the difference from the rest pose
+  Additive,
+};
+
+struct AnimationLayer
+{
+  std::string Name;
+  std::shared_ptr<Animation> Clip;
+  float Weight = 1.0f;
+  AnimationBlendModes Mode = AnimationBlendModes::Override;
+  bool Enabled = true;
+  // per node [0, 1]. empty is all nodes
+  std::vector<float> NodeMask;
+
+  AnimationPose m_pose;
+  std::shared_ptr<AnimationBinding> m_binding;
+};
+
+// blend N clips into one local pose, then write nodes once.
+// each layer is blended over the whole pose arrays with a per node weight,
+// rotations 4 nodes at a time
+struct AnimationLayerStack
+{
+  std::vector<std::shared_ptr<AnimationLayer>> Layers;
+
+  // rest pose of the scene
+  AnimationPose m_rest;
+  AnimationPose m_result;
+  // per node weight of the current layer. 0 if the channel is not animated
+  std::vector<float> m_translationWeights;
+  std::vector<float> m_rotationWeights;
+  std::vector<float> m_scaleWeights;
+
+  void Initialize(const RuntimeScene& runtime);
+  // bind the layers again after RuntimeScene::Reset
+  void Rebind(RuntimeScene& runtime);
+  std::shared_ptr<AnimationLayer> AddLayer(
+    RuntimeScene& runtime,
+    const std::shared_ptr<Animation>& clip,
+    AnimationBlendModes mode = AnimationBlendModes::Override);
+  void RemoveLayer(const std::shared_ptr<AnimationLayer>& layer);
+  Time Duration() const;
+
+  // mask nodes that belong to the bones (include descendants).
+  // empty bones clears the mask.
+  static void SetBoneMask(AnimationLayer& layer,
+                          const RuntimeScene& runtime,
+                          std::span<const HumanBones> bones);
+
+  void Update(Time time, RuntimeScene& runtime, bool repeat = false);
+};
+
+} // namespace
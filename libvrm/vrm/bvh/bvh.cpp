@@ -1,32 +1,33 @@
 #include "bvh.h"
 #include <assert.h>
+#include <atomic>
 #include <cctype>
 #include <charconv>
 #include <cmath>
-#include <functional>
 #include <iostream>
 #include <optional>
 #include <sstream>
 #include <stack>
 #include <stdlib.h>
-#include <vrm/fileutil.h>
+#include <string.h>
+#include <thread>
+#include <vrm/mapped_file.h>
 
 template<typename T>
 std::optional<T>
-to_num(const std::string& src);
-
-template<>
-std::optional<int>
-to_num<int>(const std::string& src)
+to_num(std::string_view src)
 {
-  return std::stoi(src);
-}
-
-template<>
-std::optional<float>
-to_num<float>(const std::string& src)
-{
-  return std::stof(src);
+  auto begin = src.data();
+  auto end = begin + src.size();
+  if (begin != end && *begin == '+') {
+    ++begin;
+  }
+  T value;
+  auto [ptr, ec] = std::from_chars(begin, end, value);
+  if (ec != std::errc{}) {
+    return {};
+  }
+  return value;
 }
 
 using It = std::string_view::iterator;
@@ -35,7 +36,6 @@ struct Result
   It end;
   It next;
 };
-using Delimiter = std::function<std::optional<Result>(It, It)>;
 
 class Tokenizer
 {
@@ -49,7 +49,10 @@ public:
     m_pos = m_data.begin();
   }
 
-  std::optional<std::string_view> token(const Delimiter& delimiter)
+  std::string_view rest() const { return { m_pos, m_data.end() }; }
+
+  template<typename D>
+  std::optional<std::string_view> token(const D& delimiter)
   {
     auto begin = m_pos;
 
@@ -66,7 +69,8 @@ public:
     return std::string_view(begin, end);
   }
 
-  bool expect(std::string_view expected, const Delimiter& delimiter)
+  template<typename D>
+  bool expect(std::string_view expected, const D& delimiter)
   {
     if (auto line = token(delimiter)) {
       if (*line == expected) {
@@ -76,18 +80,14 @@ public:
     return false;
   }
 
-  template<typename T>
-  std::optional<T> number(const Delimiter& delimiter)
+  template<typename T, typename D>
+  std::optional<T> number(const D& delimiter)
   {
     auto n = token(delimiter);
     if (!n) {
       return {};
     }
-    if (auto value = to_num<T>(std::string(n->begin(), n->end()))) {
-      return *value;
-    } else {
-      return {};
-    }
+    return to_num<T>(*n);
   }
 };
 
@@ -107,17 +107,6 @@ is_space(It it, It end)
   return Result{ tail, it };
 }
 
-static std::optional<Result>
-get_eol(It it, It end)
-{
-  if (*it != '\n') {
-    return {};
-  }
-  auto tail = it;
-  ++it;
-  return Result{ tail, it };
-}
-
 static std::optional<Result>
 get_name(It it, It end)
 {
@@ -161,6 +150,15 @@ struct BvhImpl
   std::vector<int> stack_;
 
   bool Parse()
+  {
+    if (!ParseHeader()) {
+      return {};
+    }
+    return ParseFrames(token_.rest());
+  }
+
+  // HIERARCHY and MOTION until Frame Time
+  bool ParseHeader()
   {
     if (!token_.expect("HIERARCHY", is_space)) {
       // return std::unexpected{ "format: no HIERARCHY" };
@@ -203,41 +201,93 @@ struct BvhImpl
     for (auto& joint : joints_) {
       channel_count_ += joint.channels.size();
     }
-    frames_.reserve(frame_count_ * channel_count_);
-    for (int i = 0; i < frame_count_; ++i) {
-      auto line = token_.token(get_eol);
-      if (!line) {
-        // return std::unexpected{ "format: no line" };
-        return {};
+    return true;
+  }
+
+  size_t Offset(std::string_view src) const
+  {
+    return token_.rest().data() - src.data();
+  }
+
+private:
+  // frame lines are independent. split them and parse on threads
+  bool ParseFrames(std::string_view src)
+  {
+    std::vector<std::string_view> lines;
+    lines.reserve(frame_count_);
+    auto p = src.data();
+    auto end = p + src.size();
+    while (p < end && lines.size() < frame_count_) {
+      auto eol = (const char*)memchr(p, '\n', end - p);
+      if (!eol) {
+        eol = end;
+      }
+      std::string_view line(p, eol - p);
+      if (line.find_first_not_of(" \t\r") != std::string_view::npos) {
+        lines.push_back(line);
       }
+      p = eol + 1;
+    }
+    if (lines.size() != frame_count_) {
+      // return std::unexpected{ "format: no line" };
+      return {};
+    }
 
-      Tokenizer line_token(*line);
-      for (int j = 0; j < channel_count_; ++j) {
-        if (auto value = line_token.number<float>(is_space)) {
-          frames_.push_back(*value);
-        } else {
-          std::stringstream ss;
-          ss << "format:" << i << ",(" << j << "/" << channel_count_
-             << "): no line value";
-          // return std::unexpected{ ss.str() };
-          return {};
+    frames_.resize(frame_count_ * channel_count_);
+    auto threadCount = std::min<size_t>(
+      std::max(1u, std::thread::hardware_concurrency()),
+      lines.size() / MinLinesPerThread + 1);
+    std::atomic<bool> failed = false;
+    auto parseRange = [this, &lines, &failed](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i) {
+        if (!ParseFrameLine(
+              lines[i],
+              { frames_.data() + i * channel_count_, channel_count_ })) {
+          failed = true;
+          return;
         }
       }
+    };
+    std::vector<std::thread> threads;
+    auto chunk = (lines.size() + threadCount - 1) / threadCount;
+    for (size_t i = 1; i < threadCount; ++i) {
+      threads.emplace_back(parseRange,
+                           std::min(i * chunk, lines.size()),
+                           std::min((i + 1) * chunk, lines.size()));
     }
-
-    size_t frame_channel_count = frame_count_ * channel_count_;
-    if (frames_.size() != frame_channel_count) {
-      std::stringstream ss;
-      ss << "format: invalid count:" << frames_.size() << "!=" << frame_count_
-         << "x" << channel_count_ << "=" << frame_count_ * channel_count_;
-      // return std::unexpected{ ss.str() };
+    parseRange(0, std::min(chunk, lines.size()));
+    for (auto& t : threads) {
+      t.join();
+    }
+    if (failed) {
+      // return std::unexpected{ "format: invalid frame value" };
       return {};
     }
+    return true;
+  }
+
+  static constexpr size_t MinLinesPerThread = 1024;
 
+  static bool ParseFrameLine(std::string_view line, std::span<float> dst)
+  {
+    auto p = line.data();
+    auto end = p + line.size();
+    for (auto& value : dst) {
+      while (p != end && (*p == ' ' || *p == '\t')) {
+        ++p;
+      }
+      if (p != end && *p == '+') {
+        ++p;
+      }
+      auto [ptr, ec] = std::from_chars(p, end, value);
+      if (ec != std::errc{}) {
+        return false;
+      }
+      p = ptr;
+    }
     return true;
   }
 
-private:
   bool ParseJoint()
   {
     while (true) {
@@ -418,17 +468,14 @@ Bvh::~Bvh() {}
 std::shared_ptr<Bvh>
 Bvh::FromFile(const std::filesystem::path& path)
 {
-  auto bytes = ReadAllBytes(path);
-  if (bytes.empty()) {
+  MappedFile file;
+  if (!file.Open(path)) {
     // return std::unexpected{ std::string("fail to read: " + path.string()) };
     return {};
   }
 
   auto ptr = std::make_shared<Bvh>();
-  if (auto result = ptr->Parse({
-        (const char*)bytes.data(),
-        (const char*)(bytes.data() + bytes.size()),
-      })) {
+  if (auto result = ptr->Parse(file.String())) {
     return ptr;
   } else {
     // return std::unexpected{ result.error() };
@@ -436,6 +483,48 @@ Bvh::FromFile(const std::filesystem::path& path)
   }
 }
 
+void
+Bvh::Bake(float scaling)
+{
+  auto frameCount = FrameCount();
+  auto jointCount = static_cast<uint32_t>(joints.size());
+  baked.joint_count = jointCount;
+  baked.translations.resize(frameCount * jointCount);
+  baked.rotations.resize(frameCount * jointCount);
+
+  auto bakeRange = [this, scaling, jointCount](uint32_t begin, uint32_t end) {
+    for (auto i = begin; i < end; ++i) {
+      auto frame = GetFrame(i);
+      auto t = baked.translations.data() + i * jointCount;
+      auto r = baked.rotations.data() + i * jointCount;
+      for (auto& joint : joints) {
+        auto transform = frame.Resolve(joint.channels);
+        *t++ = {
+          transform.Translation.x * scaling,
+          transform.Translation.y * scaling,
+          transform.Translation.z * scaling,
+        };
+        *r++ = transform.Rotation;
+      }
+    }
+  };
+
+  auto threadCount =
+    std::min(std::max(1u, std::thread::hardware_concurrency()),
+             frameCount / 256 + 1);
+  auto chunk = (frameCount + threadCount - 1) / threadCount;
+  std::vector<std::thread> threads;
+  for (uint32_t i = 1; i < threadCount; ++i) {
+    threads.emplace_back(bakeRange,
+                         std::min(i * chunk, frameCount),
+                         std::min((i + 1) * chunk, frameCount));
+  }
+  bakeRange(0, std::min(chunk, frameCount));
+  for (auto& t : threads) {
+    t.join();
+  }
+}
+
 bool
 Bvh::Parse(std::string_view src)
 {
@@ -449,4 +538,21 @@ Bvh::Parse(std::string_view src)
   return result;
 }
 
+bool
+Bvh::ParseHeader(std::string_view src,
+                 uint32_t* frameCount,
+                 size_t* framesOffset)
+{
+  BvhImpl parser(joints, endsites, frames, src);
+  if (!parser.ParseHeader()) {
+    return false;
+  }
+  frame_time = parser.frame_time_;
+  frame_channel_count = parser.channel_count_;
+  max_height = parser.max_height_;
+  *frameCount = parser.frame_count_;
+  *framesOffset = parser.Offset(src);
+  return true;
+}
+
 }
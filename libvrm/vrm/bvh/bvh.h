@@ -25,6 +25,24 @@ operator<<(std::ostream& os, const Joint& joint)
   return os;
 }
 
+// local transforms resolved from the channels. [frame][joint]
+struct BakedFrames
+{
+  uint32_t joint_count = 0;
+  std::vector<DirectX::XMFLOAT3> translations;
+  std::vector<DirectX::XMFLOAT4> rotations;
+
+  bool empty() const { return joint_count == 0; }
+  std::span<const DirectX::XMFLOAT3> Translations(int index) const
+  {
+    return { translations.data() + index * joint_count, joint_count };
+  }
+  std::span<const DirectX::XMFLOAT4> Rotations(int index) const
+  {
+    return { rotations.data() + index * joint_count, joint_count };
+  }
+};
+
 struct Bvh
 {
   std::vector<Joint> joints;
@@ -33,9 +51,22 @@ struct Bvh
   std::vector<float> frames;
   uint32_t frame_channel_count = 0;
   float max_height = 0;
+  BakedFrames baked;
   Bvh();
   ~Bvh();
   bool Parse(std::string_view src);
+  // joints and frame time only. frames are left empty
+  bool ParseHeader(std::string_view src,
+                   uint32_t* frameCount,
+                   size_t* framesOffset);
+  // resolve all frames to translation and quaternion on threads
+  void Bake(float scaling);
+  // memory of baked. the raw frames are kept
+  size_t BakedBytes() const
+  {
+    return (size_t)FrameCount() * joints.size() *
+           (sizeof(DirectX::XMFLOAT3) + sizeof(DirectX::XMFLOAT4));
+  }
   static std::shared_ptr<Bvh> FromFile(const std::filesystem::path& path);
   uint32_t FrameCount() const { return frames.size() / frame_channel_count; }
   const Joint* GetParent(int parent) const
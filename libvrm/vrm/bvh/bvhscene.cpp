@@ -1,39 +1,88 @@
 #include "bvhscene.h"
 #include "../node.h"
+#include <algorithm>
 
 namespace libvrm::bvh {
-// [x, y, z][c6][c5][c4][c3][c2][c1][parent][root]
 void
 UpdateSceneFromBvhFrame(const std::shared_ptr<RuntimeScene>& scene,
-                        std::shared_ptr<RuntimeNode>& node,
                         const std::shared_ptr<bvh::Bvh>& bvh,
                         const bvh::Frame& frame,
                         float scaling)
 {
-  auto joint = &bvh->joints[*scene->IndexOf(node)];
-  auto transform = frame.Resolve(joint->channels);
-  node->Transform.Translation = transform.Translation;
-  node->Transform.Translation.x *= scaling;
-  node->Transform.Translation.y *= scaling;
-  node->Transform.Translation.z *= scaling;
-  node->Transform.Rotation = transform.Rotation;
-  for (auto& child : node->Children) {
-    UpdateSceneFromBvhFrame(scene, child, bvh, frame, scaling);
+  auto count = std::min(bvh->joints.size(), scene->m_nodes.size());
+  for (size_t i = 0; i < count; ++i) {
+    auto transform = frame.Resolve(bvh->joints[i].channels);
+    auto& node = scene->m_nodes[i];
+    node->Transform.Translation = transform.Translation;
+    node->Transform.Translation.x *= scaling;
+    node->Transform.Translation.y *= scaling;
+    node->Transform.Translation.z *= scaling;
+    node->Transform.Rotation = transform.Rotation;
+  }
+}
+
+static void
+UpdateSceneFromBakedFrame(const std::shared_ptr<RuntimeScene>& scene,
+                          const bvh::BakedFrames& baked,
+                          int index)
+{
+  auto translations = baked.Translations(index);
+  auto rotations = baked.Rotations(index);
+  auto count = std::min<size_t>(baked.joint_count, scene->m_nodes.size());
+  for (size_t i = 0; i < count; ++i) {
+    auto& node = scene->m_nodes[i];
+    node->Transform.Translation = translations[i];
+    node->Transform.Rotation = rotations[i];
   }
 }
 
 void
 UpdateSceneFromBvhFrame(const std::shared_ptr<RuntimeScene>& scene,
                         const std::shared_ptr<bvh::Bvh>& bvh,
-                        Time time)
+                        Time time,
+                        PoseCache* cache)
 {
   if (scene->m_roots.empty()) {
     return;
   }
   auto index = bvh->TimeToIndex(time);
-  auto frame = bvh->GetFrame(index);
-  UpdateSceneFromBvhFrame(
-    scene, scene->m_roots[0], bvh, frame, bvh->GuessScaling());
+  if (!bvh->baked.empty()) {
+    UpdateSceneFromBakedFrame(scene, bvh->baked, index);
+  } else {
+    auto values =
+      cache ? cache->Find(bvh.get(), index) : std::span<const float>{};
+    if (values.size() == scene->LocalPoseSize()) {
+      scene->SetLocalPose(values);
+    } else {
+      auto frame = bvh->GetFrame(index);
+      UpdateSceneFromBvhFrame(scene, bvh, frame, bvh->GuessScaling());
+      if (cache) {
+        auto resolved =
+          cache->Insert(bvh.get(), index, scene->LocalPoseSize());
+        if (!resolved.empty()) {
+          scene->GetLocalPose(resolved);
+        }
+      }
+    }
+  }
+  scene->m_roots[0]->CalcWorldMatrix(true);
+  scene->RaiseSceneUpdated();
+}
+
+void
+UpdateSceneFromBvhFrame(const std::shared_ptr<RuntimeScene>& scene,
+                        BvhStream& stream,
+                        Time time)
+{
+  if (scene->m_roots.empty() || !stream.Header()) {
+    return;
+  }
+  auto frame = stream.GetFrame(stream.TimeToIndex(time));
+  if (frame.values.empty()) {
+    return;
+  }
+  auto header = stream.Header();
+  UpdateSceneFromBvhFrame(scene, header, frame, header->GuessScaling());
   scene->m_roots[0]->CalcWorldMatrix(true);
   scene->RaiseSceneUpdated();
 }
@@ -4,27 +4,38 @@
 #include "../timeline.h"
 #include "../gltfroot.h"
 #include "../node.h"
+#include "../pose_cache.h"
 #include "bvh.h"
 #include "bvhframe.h"
+#include "bvhstream.h"
 #include "humanbone_map.h"
 #include <memory>
 
 namespace libvrm {
 namespace bvh {
 
+// nodes are created in the joint order by InitializeSceneFromBvh.
+// joint i => scene->m_nodes[i]
 void
 UpdateSceneFromBvhFrame(
   const std::shared_ptr<RuntimeScene>& scene,
-  std::shared_ptr<RuntimeNode>& node,
   const std::shared_ptr<bvh::Bvh>& bvh,
   const bvh::Frame& frame,
   float scaling);
 
+// use bvh->baked if exists. else cache is keyed by the frame index
 void
 UpdateSceneFromBvhFrame(
   const std::shared_ptr<RuntimeScene>& scene,
   const std::shared_ptr<bvh::Bvh>& bvh,
-  Time time);
+  Time time,
+  PoseCache* cache = nullptr);
+
+// decode the frame on demand
+void
+UpdateSceneFromBvhFrame(const std::shared_ptr<RuntimeScene>& scene,
+                        BvhStream& stream,
+                        Time time);
 
 void
 InitializeSceneFromBvh(const std::shared_ptr<GltfRoot>& scene,
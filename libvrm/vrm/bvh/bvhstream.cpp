@@ -0,0 +1,149 @@
+#include "bvhstream.h"
+#include <charconv>
+#include <string.h>
+
+namespace libvrm::bvh {
+
+bool
+BvhStream::Open(const std::filesystem::path& path)
+{
+  if (!m_file.Open(path)) {
+    return false;
+  }
+  m_header = std::make_shared<Bvh>();
+  if (!m_header->ParseHeader(
+        m_file.String(), &m_frameCount, &m_framesOffset)) {
+    m_header = {};
+    return false;
+  }
+  m_checkpoints.clear();
+  m_scanOffset = m_framesOffset;
+  m_windowSize = 0;
+  return true;
+}
+
+int
+BvhStream::TimeToIndex(Time time) const
+{
+  if (m_frameCount == 0) {
+    return 0;
+  }
+  return static_cast<int>(time / m_header->frame_time) % m_frameCount;
+}
+
+static const char*
+SkipEmptyLines(const char* p, const char* end)
+{
+  while (p < end && (*p == '\r' || *p == '\n' || *p == ' ' || *p == '\t')) {
+    ++p;
+  }
+  return p;
+}
+
+static const char*
+NextLine(const char* p, const char* end)
+{
+  auto eol = (const char*)memchr(p, '\n', end - p);
+  return eol ? eol + 1 : end;
+}
+
+std::optional<size_t>
+BvhStream::LineOffset(uint32_t index)
+{
+  auto data = m_file.String();
+  auto begin = data.data();
+  auto end = begin + data.size();
+
+  // extend checkpoints
+  auto checkpoint = index / CheckpointInterval;
+  while (m_checkpoints.size() <= checkpoint) {
+    auto p = SkipEmptyLines(begin + m_scanOffset, end);
+    if (p == end) {
+      return {};
+    }
+    m_checkpoints.push_back(p - begin);
+    for (uint32_t i = 0; i < CheckpointInterval && p < end; ++i) {
+      p = SkipEmptyLines(NextLine(p, end), end);
+    }
+    m_scanOffset = p - begin;
+  }
+
+  auto p = begin + m_checkpoints[checkpoint];
+  for (uint32_t i = checkpoint * CheckpointInterval; i < index; ++i) {
+    p = SkipEmptyLines(NextLine(p, end), end);
+    if (p == end) {
+      return {};
+    }
+  }
+  return p - begin;
+}
+
+bool
+BvhStream::Decode(uint32_t begin)
+{
+  auto data = m_file.String();
+  auto end = data.data() + data.size();
+
+  std::optional<size_t> offset;
+  if (m_windowSize && begin == m_windowBegin + m_windowSize) {
+    // sequential
+    offset = m_windowEndOffset;
+  } else {
+    offset = LineOffset(begin);
+  }
+  if (!offset) {
+    return false;
+  }
+
+  auto channels = m_header->frame_channel_count;
+  auto size = std::min(ReadAhead, m_frameCount - begin);
+  m_window.resize(size * channels);
+  auto p = data.data() + *offset;
+  for (uint32_t i = 0; i < size; ++i) {
+    p = SkipEmptyLines(p, end);
+    auto eol = NextLine(p, end);
+    auto dst = m_window.data() + i * channels;
+    for (uint32_t j = 0; j < channels; ++j) {
+      while (p < eol && (*p == ' ' || *p == '\t')) {
+        ++p;
+      }
+      if (p < eol && *p == '+') {
+        ++p;
+      }
+      auto [ptr, ec] = std::from_chars(p, eol, dst[j]);
+      if (ec != std::errc{}) {
+        m_windowSize = 0;
+        return false;
+      }
+      p = ptr;
+    }
+    p = eol;
+  }
+  m_windowBegin = begin;
+  m_windowSize = size;
+  m_windowEndOffset = p - data.data();
+  return true;
+}
+
+Frame
+BvhStream::GetFrame(uint32_t index)
+{
+  Frame frame{
+    .index = static_cast<int>(index),
+    .time = m_header ? m_header->frame_time * index : Time{},
+  };
+  if (!m_header || index >= m_frameCount) {
+    return frame;
+  }
+  if (index < m_windowBegin || index >= m_windowBegin + m_windowSize) {
+    if (!Decode(index)) {
+      return frame;
+    }
+  }
+  auto channels = m_header->frame_channel_count;
+  auto begin = m_window.data() + (index - m_windowBegin) * channels;
+  frame.values = { begin, channels };
+  return frame;
+}
+
+} // namespace
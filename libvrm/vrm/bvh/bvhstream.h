@@ -0,0 +1,48 @@
+#pragma once
+#include "../mapped_file.h"
+#include "bvh.h"
+#include <memory>
+
+namespace libvrm::bvh {
+
+// play a large bvh without parsing all frames.
+// the header is parsed eagerly. frame lines are indexed and decoded on demand
+// from a memory mapped file. memory is independent of the clip length.
+class BvhStream
+{
+  MappedFile m_file;
+  // joints and frame time. frames are empty
+  std::shared_ptr<Bvh> m_header;
+  uint32_t m_frameCount = 0;
+  size_t m_framesOffset = 0;
+
+  // offset of every CheckpointInterval-th line. built lazily
+  static constexpr uint32_t CheckpointInterval = 256;
+  std::vector<size_t> m_checkpoints;
+  size_t m_scanOffset = 0;
+
+  // decoded read-ahead window
+  uint32_t m_windowBegin = 0;
+  uint32_t m_windowSize = 0;
+  std::vector<float> m_window;
+  // next line after the window for sequential playback
+  size_t m_windowEndOffset = 0;
+
+public:
+  uint32_t ReadAhead = 64;
+
+  bool Open(const std::filesystem::path& path);
+  const std::shared_ptr<Bvh>& Header() const { return m_header; }
+  uint32_t FrameCount() const { return m_frameCount; }
+  int TimeToIndex(Time time) const;
+  // empty values if failed
+  Frame GetFrame(uint32_t index);
+  size_t IndexedBytes() const { return m_scanOffset - m_framesOffset; }
+  size_t TotalBytes() const { return m_file.Bytes().size(); }
+
+private:
+  std::optional<size_t> LineOffset(uint32_t index);
+  bool Decode(uint32_t begin);
+};
+
+} // namespace
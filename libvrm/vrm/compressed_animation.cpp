@@ -0,0 +1,375 @@
+#include "compressed_animation.h"
+#include "animation.h"
+#include "network/quat_packer.h"
+#include "runtime_node.h"
+#include "runtime_scene.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace libvrm {
+
+static uint16_t
+Quantize(float value, float min, float extent)
+{
+  if (extent <= 0) {
+    return 0;
+  }
+  auto t = std::clamp((value - min) / extent, 0.0f, 1.0f);
+  return static_cast<uint16_t>(std::round(t * 0xffff));
+}
+
+static float
+Dequantize(uint16_t value, float min, float extent)
+{
+  return min + extent * (value / static_cast<float>(0xffff));
+}
+
+// 変化量がこれ以下なら定数として捨てる
+static const float CONSTANT_TOLERANCE = 1e-5f;
+static const float CONSTANT_ROTATION_DOT = 0.9999999f;
+
+struct CompressedAnimationBuilder
+{
+  CompressedAnimation& Dst;
+  float Duration;
+
+  float FrameTime(uint32_t i) const
+  {
+    if (Dst.FrameCount <= 1) {
+      return 0;
+    }
+    return std::min(Duration, i / Dst.SampleRate);
+  }
+
+  // evaluate on the half frame to include resampling error
+  template<typename F>
+  void ForEachErrorTime(const F& f) const
+  {
+    for (uint32_t i = 0; i < Dst.FrameCount * 2; ++i) {
+      f(std::min(Duration, i / (Dst.SampleRate * 2)));
+    }
+  }
+
+  void AddVector(uint32_t nodeIndex,
+                 CompressedTrackTypes type,
+                 const Curve<DirectX::XMFLOAT3>& curve)
+  {
+    std::vector<DirectX::XMFLOAT3> values(Dst.FrameCount);
+    DirectX::XMFLOAT3 min = curve.GetValue(0, false);
+    DirectX::XMFLOAT3 max = min;
+    for (uint32_t i = 0; i < Dst.FrameCount; ++i) {
+      auto& v = values[i];
+      v = curve.GetValue(FrameTime(i), false);
+      for (int j = 0; j < 3; ++j) {
+        (&min.x)[j] = std::min((&min.x)[j], (&v.x)[j]);
+        (&max.x)[j] = std::max((&max.x)[j], (&v.x)[j]);
+      }
+    }
+
+    CompressedTrack track{
+      .NodeIndex = nodeIndex,
+      .Type = type,
+      .Stride = 3,
+    };
+    if (max.x - min.x <= CONSTANT_TOLERANCE &&
+        max.y - min.y <= CONSTANT_TOLERANCE &&
+        max.z - min.z <= CONSTANT_TOLERANCE) {
+      track.Constant = true;
+      track.Value = { values[0].x, values[0].y, values[0].z, 0 };
+      ++Dst.Stats.ConstantTracks;
+    } else {
+      track.Offset = static_cast<uint32_t>(Dst.Samples.size());
+      track.Min = { min.x, min.y, min.z };
+      track.Extent = { max.x - min.x, max.y - min.y, max.z - min.z };
+      for (auto& v : values) {
+        for (int j = 0; j < 3; ++j) {
+          Dst.Samples.push_back(
+            Quantize((&v.x)[j], track.Min[j], track.Extent[j]));
+        }
+      }
+    }
+    Dst.Tracks.push_back(track);
+
+    auto& maxError = type == CompressedTrackTypes::Translation
+                       ? Dst.Stats.MaxTranslationError
+                       : Dst.Stats.MaxScaleError;
+    ForEachErrorTime([&](float time) {
+      auto src = curve.GetValue(time, false);
+      auto dst = Dst.GetVector(Dst.Tracks.back(), time);
+      auto error = DirectX::XMVectorGetX(DirectX::XMVector3Length(
+        DirectX::XMVectorSubtract(DirectX::XMLoadFloat3(&src),
+                                  DirectX::XMLoadFloat3(&dst))));
+      maxError = std::max(maxError, error);
+    });
+  }
+
+  void AddRotation(uint32_t nodeIndex, const Curve<DirectX::XMFLOAT4>& curve)
+  {
+    std::vector<DirectX::XMFLOAT4> values(Dst.FrameCount);
+    bool constant = true;
+    for (uint32_t i = 0; i < Dst.FrameCount; ++i) {
+      values[i] = curve.GetValue(FrameTime(i), false);
+      auto dot = std::abs(DirectX::XMVectorGetX(
+        DirectX::XMVector4Dot(DirectX::XMLoadFloat4(&values[0]),
+                              DirectX::XMLoadFloat4(&values[i]))));
+      if (dot < CONSTANT_ROTATION_DOT) {
+        constant = false;
+      }
+    }
+
+    CompressedTrack track{
+      .NodeIndex = nodeIndex,
+      .Type = CompressedTrackTypes::Rotation,
+      .Stride = 3,
+    };
+    if (constant) {
+      track.Constant = true;
+      track.Value = values[0];
+      ++Dst.Stats.ConstantTracks;
+    } else {
+      track.Offset = static_cast<uint32_t>(Dst.Samples.size());
+      Dst.Samples.resize(Dst.Samples.size() + values.size() * 3);
+      auto p = Dst.Samples.data() + track.Offset;
+      for (auto& v : values) {
+        quat_packer::Pack48(v.x, v.y, v.z, v.w, p);
+        p += 3;
+      }
+    }
+    Dst.Tracks.push_back(track);
+
+    ForEachErrorTime([&](float time) {
+      auto src = curve.GetValue(time, false);
+      auto dst = Dst.GetRotation(Dst.Tracks.back(), time);
+      auto dot = std::abs(DirectX::XMVectorGetX(DirectX::XMVector4Dot(
+        DirectX::XMLoadFloat4(&src), DirectX::XMLoadFloat4(&dst))));
+      auto error = 2 * std::acos(std::min(1.0f, dot));
+      Dst.Stats.MaxRotationError = std::max(Dst.Stats.MaxRotationError, error);
+    });
+  }
+
+  void AddWeights(uint32_t nodeIndex, const WeightsCurve& curve)
+  {
+    auto count = curve.WeightsCount;
+    std::vector<float> values(Dst.FrameCount * count);
+    std::vector<float> min(count, std::numeric_limits<float>::infinity());
+    std::vector<float> max(count, -std::numeric_limits<float>::infinity());
+    for (uint32_t i = 0; i < Dst.FrameCount; ++i) {
+      std::span<float> frame{ values.data() + i * count, count };
+      curve.GetValue(FrameTime(i), false, frame);
+      for (uint32_t j = 0; j < count; ++j) {
+        min[j] = std::min(min[j], frame[j]);
+        max[j] = std::max(max[j], frame[j]);
+      }
+    }
+
+    CompressedTrack track{
+      .NodeIndex = nodeIndex,
+      .Type = CompressedTrackTypes::Weights,
+      .Stride = count,
+    };
+    bool constant = true;
+    for (uint32_t j = 0; j < count; ++j) {
+      if (max[j] - min[j] > CONSTANT_TOLERANCE) {
+        constant = false;
+      }
+    }
+    if (constant) {
+      track.Constant = true;
+      track.ConstantWeights.assign(values.begin(), values.begin() + count);
+      ++Dst.Stats.ConstantTracks;
+    } else {
+      track.Offset = static_cast<uint32_t>(Dst.Samples.size());
+      track.Min = min;
+      for (uint32_t j = 0; j < count; ++j) {
+        track.Extent.push_back(max[j] - min[j]);
+      }
+      for (uint32_t i = 0; i < values.size(); ++i) {
+        Dst.Samples.push_back(
+          Quantize(values[i], track.Min[i % count], track.Extent[i % count]));
+      }
+    }
+    Dst.Tracks.push_back(track);
+
+    std::vector<float> src(count);
+    std::vector<float> dst(count);
+    ForEachErrorTime([&](float time) {
+      curve.GetValue(time, false, src);
+      Dst.GetWeights(Dst.Tracks.back(), time, dst);
+      for (uint32_t j = 0; j < count; ++j) {
+        Dst.Stats.MaxWeightError =
+          std::max(Dst.Stats.MaxWeightError, std::abs(src[j] - dst[j]));
+      }
+    });
+  }
+};
+
+template<typename T>
+static size_t
+RawBytes(const Curve<T>& curve)
+{
+  return curve.Times.size() * sizeof(float) + curve.Values.size() * sizeof(T);
+}
+
+std::shared_ptr<CompressedAnimation>
+CompressedAnimation::Compress(const Animation& src, float sampleRate)
+{
+  auto ptr = std::make_shared<CompressedAnimation>();
+  ptr->Name = src.m_name;
+  auto duration = static_cast<float>(src.Duration().count());
+  if (duration > 0 && sampleRate > 0) {
+    ptr->FrameCount =
+      static_cast<uint32_t>(std::ceil(duration * sampleRate)) + 1;
+    // last frame is exactly on the duration
+    ptr->SampleRate = (ptr->FrameCount - 1) / duration;
+  } else {
+    ptr->FrameCount = 1;
+    ptr->SampleRate = sampleRate;
+  }
+
+  CompressedAnimationBuilder builder{ *ptr, duration };
+  for (auto& [k, v] : src.m_translationMap) {
+    builder.AddVector(k, CompressedTrackTypes::Translation, v);
+    ptr->Stats.RawBytes += RawBytes(v);
+  }
+  for (auto& [k, v] : src.m_rotationMap) {
+    builder.AddRotation(k, v);
+    ptr->Stats.RawBytes += RawBytes(v);
+  }
+  for (auto& [k, v] : src.m_scaleMap) {
+    builder.AddVector(k, CompressedTrackTypes::Scale, v);
+    ptr->Stats.RawBytes += RawBytes(v);
+  }
+  for (auto& [k, v] : src.m_weightsMap) {
+    builder.AddWeights(k, v);
+    ptr->Stats.RawBytes +=
+      v.Times.size() * sizeof(float) + v.Values.size() * sizeof(float);
+  }
+
+  ptr->Stats.CompressedBytes = ptr->Samples.size() * sizeof(uint16_t);
+  for (auto& track : ptr->Tracks) {
+    ptr->Stats.CompressedBytes +=
+      sizeof(track.NodeIndex) + sizeof(track.Type) + sizeof(track.Stride) +
+      sizeof(track.Offset) +
+      (track.Constant ? sizeof(track.Value) : 0) +
+      (track.ConstantWeights.size() + track.Min.size() + track.Extent.size()) *
+        sizeof(float);
+  }
+  return ptr;
+}
+
+void
+CompressedAnimation::FramePosition(float time, uint32_t* frame, float* t) const
+{
+  auto f = std::max(0.0f, time * SampleRate);
+  *frame = static_cast<uint32_t>(f);
+  if (*frame + 1 >= FrameCount) {
+    *frame = FrameCount - 1;
+    *t = 0;
+  } else {
+    *t = f - *frame;
+  }
+}
+
+DirectX::XMFLOAT3
+CompressedAnimation::GetVector(const CompressedTrack& track, float time) const
+{
+  if (track.Constant) {
+    return { track.Value.x, track.Value.y, track.Value.z };
+  }
+  uint32_t frame;
+  float t;
+  FramePosition(time, &frame, &t);
+  auto get = [this, &track](uint32_t frame) {
+    auto p = Samples.data() + track.Offset + frame * track.Stride;
+    return DirectX::XMFLOAT3{
+      Dequantize(p[0], track.Min[0], track.Extent[0]),
+      Dequantize(p[1], track.Min[1], track.Extent[1]),
+      Dequantize(p[2], track.Min[2], track.Extent[2]),
+    };
+  };
+  if (t == 0) {
+    return get(frame);
+  }
+  return Lerp(get(frame), get(frame + 1), t);
+}
+
+DirectX::XMFLOAT4
+CompressedAnimation::GetRotation(const CompressedTrack& track,
+                                 float time) const
+{
+  if (track.Constant) {
+    return track.Value;
+  }
+  uint32_t frame;
+  float t;
+  FramePosition(time, &frame, &t);
+  auto get = [this, &track](uint32_t frame) {
+    DirectX::XMFLOAT4 q;
+    quat_packer::Unpack48(Samples.data() + track.Offset + frame * track.Stride,
+                          &q.x);
+    return q;
+  };
+  if (t == 0) {
+    return get(frame);
+  }
+  return Lerp(get(frame), get(frame + 1), t);
+}
+
+void
+CompressedAnimation::GetWeights(const CompressedTrack& track,
+                                float time,
+                                std::span<float> dst) const
+{
+  auto count = std::min<size_t>(dst.size(), track.Stride);
+  if (track.Constant) {
+    std::copy(track.ConstantWeights.begin(),
+              track.ConstantWeights.begin() + count,
+              dst.begin());
+    return;
+  }
+  uint32_t frame;
+  float t;
+  FramePosition(time, &frame, &t);
+  auto l = Samples.data() + track.Offset + frame * track.Stride;
+  auto r = t == 0 ? l : l + track.Stride;
+  for (size_t j = 0; j < count; ++j) {
+    dst[j] = Lerp(Dequantize(l[j], track.Min[j], track.Extent[j]),
+                  Dequantize(r[j], track.Min[j], track.Extent[j]),
+                  t);
+  }
+}
+
+void
+CompressedAnimation::Update(Time time, RuntimeScene& runtime, bool repeat) const
+{
+  auto duration = static_cast<float>(Duration().count());
+  float seconds = time.count();
+  if (repeat) {
+    seconds = WrapTime(seconds, duration);
+  }
+  for (auto& track : Tracks) {
+    if (track.NodeIndex >= runtime.m_nodes.size()) {
+      continue;
+    }
+    auto& node = runtime.m_nodes[track.NodeIndex];
+    switch (track.Type) {
+      case CompressedTrackTypes::Translation:
+        node->Transform.Translation = GetVector(track, seconds);
+        break;
+      case CompressedTrackTypes::Rotation:
+        node->Transform.Rotation = GetRotation(track, seconds);
+        break;
+      case CompressedTrackTypes::Scale:
+        node->Scale = GetVector(track, seconds);
+        break;
+      case CompressedTrackTypes::Weights:
+        GetWeights(track,
+                   seconds,
+                   runtime.MorphWeights(track.NodeIndex, track.Stride));
+        break;
+    }
+  }
+}
+
+} // namespace
@@ -0,0 +1,87 @@
+#pragma once
+#include "timeline.h"
+#include <DirectXMath.h>
+#include <memory>
+#include <span>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace libvrm {
+struct Animation;
+struct RuntimeScene;
+
+enum class CompressedTrackTypes : uint8_t
+{
+  Translation,
+  Rotation,
+  Scale,
+  Weights,
+};
+
+struct CompressedTrack
+{
+  uint32_t NodeIndex;
+  CompressedTrackTypes Type;
+  // uint16 per frame. translation, scale: 3, rotation: 3(48bit), weights: n
+  uint32_t Stride = 0;
+  // offset into CompressedAnimation::Samples. unused if constant
+  uint32_t Offset = 0;
+  bool Constant = false;
+  // constant value. weights use ConstantWeights
+  DirectX::XMFLOAT4 Value = { 0, 0, 0, 1 };
+  std::vector<float> ConstantWeights;
+  // quantization range for translation, scale and weights
+  std::vector<float> Min;
+  std::vector<float> Extent;
+};
+
+struct CompressedAnimationStats
+{
+  size_t RawBytes = 0;
+  size_t CompressedBytes = 0;
+  uint32_t ConstantTracks = 0;
+  float MaxTranslationError = 0;
+  // radians
+  float MaxRotationError = 0;
+  float MaxScaleError = 0;
+  float MaxWeightError = 0;
+  float Ratio() const
+  {
+    return CompressedBytes ? static_cast<float>(RawBytes) / CompressedBytes
+                           : 0;
+  }
+};
+
+// uniform resampled and 16bit quantized Animation
+struct CompressedAnimation
+{
+  std::u8string Name;
+  float SampleRate = 30;
+  uint32_t FrameCount = 0;
+  std::vector<CompressedTrack> Tracks;
+  std::vector<uint16_t> Samples;
+  CompressedAnimationStats Stats;
+
+  static std::shared_ptr<CompressedAnimation> Compress(const Animation& src,
+                                                       float sampleRate = 30);
+
+  Time Duration() const
+  {
+    return Time(FrameCount > 1 ? (FrameCount - 1) / SampleRate : 0);
+  }
+  DirectX::XMFLOAT3 GetVector(const CompressedTrack& track, float time) const;
+  DirectX::XMFLOAT4 GetRotation(const CompressedTrack& track,
+                                float time) const;
+  void GetWeights(const CompressedTrack& track,
+                  float time,
+                  std::span<float> dst) const;
+
+  // decompress to the scene nodes
+  void Update(Time time, RuntimeScene& runtime, bool repeat = false) const;
+
+  // frame index and position to the next frame
+  void FramePosition(float time, uint32_t* frame, float* t) const;
+};
+
+} // namespace
@@ -2,6 +2,7 @@
 #include <DirectXMath.h>
 #include <assert.h>
 #include <memory>
+#include <stdint.h>
 #include <string_view>
 
 namespace libvrm {
@@ -123,4 +124,19 @@ struct NodeConstraint
   };
 };
 
+// load 時に解決して依存順に並べたもの
+struct CompiledNodeConstraint
+{
+  uint32_t Source;
+  uint32_t Destination;
+  NodeConstraintTypes Type;
+  float Weight = 1.0f;
+  // aim or roll axis
+  DirectX::XMFLOAT3 Axis;
+  DirectX::XMFLOAT4 SourceInitialRotation;
+  DirectX::XMFLOAT4 SourceInitialRotationInverse;
+  DirectX::XMFLOAT4 DestinationInitialRotation;
+  DirectX::XMFLOAT4 DestinationInitialRotationInverse;
+};
+
 } // namespace
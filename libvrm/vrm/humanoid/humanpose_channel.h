@@ -0,0 +1,76 @@
+#pragma once
+#include "../timeline.h"
+#include "../triple_buffer.h"
+#include "humanpose.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+
+namespace libvrm {
+
+// owned copy of a HumanPose with fixed capacity. no allocation
+struct HumanPoseFrame
+{
+  static constexpr size_t Capacity = (size_t)HumanBones::tip;
+
+  Time Timestamp = {};
+  DirectX::XMFLOAT3 RootPosition = { 0, 0, 0 };
+  size_t BoneCount = 0;
+  std::array<HumanBones, Capacity> Bones;
+  std::array<DirectX::XMFLOAT4, Capacity> Rotations;
+
+  void SetPose(const HumanPose& pose, Time timestamp)
+  {
+    Timestamp = timestamp;
+    RootPosition = pose.RootPosition;
+    BoneCount = std::min(pose.Bones.size(), Capacity);
+    std::copy_n(pose.Bones.begin(), BoneCount, Bones.begin());
+    std::copy_n(pose.Rotations.begin(), BoneCount, Rotations.begin());
+  }
+
+  HumanPose GetPose() const
+  {
+    return {
+      RootPosition,
+      { Bones.data(), BoneCount },
+      { Rotations.data(), BoneCount },
+    };
+  }
+};
+
+// hand a pose from a worker thread to the render loop.
+// one channel per producer thread. the consumer takes the latest frame.
+struct HumanPoseChannel
+{
+  TripleBuffer<HumanPoseFrame> m_buffer;
+  std::atomic<uint64_t> m_published{ 0 };
+  uint64_t m_consumed = 0;
+
+  // producer thread
+  void Publish(const HumanPose& pose, Time timestamp)
+  {
+    m_buffer.Back().SetPose(pose, timestamp);
+    // counted before the frame is visible. never below m_consumed
+    m_published.fetch_add(1, std::memory_order_relaxed);
+    m_buffer.Publish();
+  }
+
+  // consumer thread. false if nothing new
+  bool Consume()
+  {
+    if (!m_buffer.Consume()) {
+      return false;
+    }
+    ++m_consumed;
+    return true;
+  }
+  const HumanPoseFrame& Latest() const { return m_buffer.Front(); }
+
+  // overwritten before consumed, or waiting
+  uint64_t Dropped() const
+  {
+    return m_published.load(std::memory_order_relaxed) - m_consumed;
+  }
+};
+
+} // namespace
@@ -0,0 +1,94 @@
+#pragma once
+#include "humanbones.h"
+#include <DirectXMath.h>
+#include <array>
+#include <stdint.h>
+#include <vector>
+
+namespace libvrm {
+
+// constants to convert between the local rotation of a node and the
+// normalized rotation of the human bone. order is XMQuaternionMultiply's.
+//
+// local = ToLocalPre * normalized * ToLocalPost
+// normalized = ToNormalizedPre * local * ToNormalizedPost
+struct HumanRetargetSlot
+{
+  HumanBones Bone;
+  uint32_t NodeIndex;
+  DirectX::XMFLOAT4 ToLocalPre;
+  DirectX::XMFLOAT4 ToLocalPost;
+  DirectX::XMFLOAT4 ToNormalizedPre;
+  DirectX::XMFLOAT4 ToNormalizedPost;
+  DirectX::XMFLOAT3 WorldInitialPosition;
+};
+
+// built once per model. no lookup and no allocation while retargeting
+struct HumanRetargetTable
+{
+  // node order
+  std::vector<HumanRetargetSlot> Slots;
+  // HumanBones => Slots index. -1 if not assigned
+  std::array<int32_t, (size_t)HumanBones::tip> BoneToSlot;
+
+  HumanRetargetTable() { BoneToSlot.fill(-1); }
+
+  void Clear()
+  {
+    Slots.clear();
+    BoneToSlot.fill(-1);
+  }
+
+  void Push(HumanBones bone,
+            uint32_t nodeIndex,
+            const DirectX::XMFLOAT4& localInitial,
+            const DirectX::XMFLOAT4& worldInitial,
+            const DirectX::XMFLOAT3& worldInitialPosition)
+  {
+    auto w = DirectX::XMLoadFloat4(&worldInitial);
+    auto wInv = DirectX::XMQuaternionInverse(w);
+    auto l = DirectX::XMLoadFloat4(&localInitial);
+    auto lInv = DirectX::XMQuaternionInverse(l);
+
+    HumanRetargetSlot slot{ bone, nodeIndex };
+    DirectX::XMStoreFloat4(&slot.ToLocalPre, w);
+    DirectX::XMStoreFloat4(&slot.ToLocalPost,
+                           DirectX::XMQuaternionMultiply(wInv, l));
+    DirectX::XMStoreFloat4(&slot.ToNormalizedPre, wInv);
+    DirectX::XMStoreFloat4(&slot.ToNormalizedPost,
+                           DirectX::XMQuaternionMultiply(lInv, w));
+    slot.WorldInitialPosition = worldInitialPosition;
+
+    BoneToSlot[(size_t)bone] = static_cast<int32_t>(Slots.size());
+    Slots.push_back(slot);
+  }
+
+  const HumanRetargetSlot* Find(HumanBones bone) const
+  {
+    if ((size_t)bone >= BoneToSlot.size()) {
+      return nullptr;
+    }
+    auto slot = BoneToSlot[(size_t)bone];
+    return slot >= 0 ? &Slots[slot] : nullptr;
+  }
+
+  static DirectX::XMVECTOR ToLocal(const HumanRetargetSlot& slot,
+                                   DirectX::FXMVECTOR normalized)
+  {
+    return DirectX::XMQuaternionMultiply(
+      DirectX::XMQuaternionMultiply(DirectX::XMLoadFloat4(&slot.ToLocalPre),
+                                    normalized),
+      DirectX::XMLoadFloat4(&slot.ToLocalPost));
+  }
+
+  static DirectX::XMVECTOR ToNormalized(const HumanRetargetSlot& slot,
+                                        DirectX::FXMVECTOR local)
+  {
+    return DirectX::XMQuaternionMultiply(
+      DirectX::XMQuaternionMultiply(
+        DirectX::XMLoadFloat4(&slot.ToNormalizedPre), local),
+      DirectX::XMLoadFloat4(&slot.ToNormalizedPost));
+  }
+};
+
+} // namespace
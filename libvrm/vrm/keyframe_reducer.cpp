@@ -0,0 +1,201 @@
+#include "keyframe_reducer.h"
+#include "animation.h"
+
+namespace libvrm {
+
+// greedy. extend the segment from the last kept key while every key inside
+// is reproduced by interpolation.
+template<typename F>
+static std::vector<uint32_t>
+Reduce(std::span<const float> times, const F& isReproduced)
+{
+  std::vector<uint32_t> keep;
+  if (times.empty()) {
+    return keep;
+  }
+  keep.push_back(0);
+  uint32_t anchor = 0;
+  for (uint32_t end = 2; end < times.size(); ++end) {
+    auto span = times[end] - times[anchor];
+    for (uint32_t k = anchor + 1; k < end; ++k) {
+      auto t = span > 0 ? (times[k] - times[anchor]) / span : 0;
+      if (!isReproduced(anchor, end, k, t)) {
+        anchor = end - 1;
+        keep.push_back(anchor);
+        break;
+      }
+    }
+  }
+  if (times.size() > 1) {
+    keep.push_back(static_cast<uint32_t>(times.size() - 1));
+  }
+  return keep;
+}
+
+std::vector<uint32_t>
+ReduceKeyframes(std::span<const float> times,
+                std::span<const DirectX::XMFLOAT3> values,
+                float tolerance)
+{
+  return Reduce(times, [values, tolerance](auto a, auto b, auto k, float t) {
+    auto lerp = DirectX::XMVectorLerp(DirectX::XMLoadFloat3(&values[a]),
+                                      DirectX::XMLoadFloat3(&values[b]),
+                                      t);
+    auto error = DirectX::XMVectorGetX(DirectX::XMVector3Length(
+      DirectX::XMVectorSubtract(lerp, DirectX::XMLoadFloat3(&values[k]))));
+    return error <= tolerance;
+  });
+}
+
+// |q0 - q1| is stable for small angles unlike acos(dot)
+static float
+QuaternionAngle(DirectX::FXMVECTOR q0, DirectX::FXMVECTOR q1)
+{
+  auto d0 = DirectX::XMVectorGetX(
+    DirectX::XMVector4Length(DirectX::XMVectorSubtract(q0, q1)));
+  auto d1 = DirectX::XMVectorGetX(
+    DirectX::XMVector4Length(DirectX::XMVectorAdd(q0, q1)));
+  return 4 * std::asin(std::min(1.0f, std::min(d0, d1) * 0.5f));
+}
+
+std::vector<uint32_t>
+ReduceKeyframes(std::span<const float> times,
+                std::span<const DirectX::XMFLOAT4> rotations,
+                float angle)
+{
+  return Reduce(times, [rotations, angle](auto a, auto b, auto k, float t) {
+    auto slerp =
+      DirectX::XMQuaternionSlerp(DirectX::XMLoadFloat4(&rotations[a]),
+                                 DirectX::XMLoadFloat4(&rotations[b]),
+                                 t);
+    return QuaternionAngle(slerp, DirectX::XMLoadFloat4(&rotations[k])) <=
+           angle;
+  });
+}
+
+std::vector<uint32_t>
+ReduceKeyframes(std::span<const float> times,
+                std::span<const float> weights,
+                uint32_t weightsCount,
+                float tolerance)
+{
+  return Reduce(
+    times, [weights, weightsCount, tolerance](auto a, auto b, auto k, float t) {
+      for (uint32_t i = 0; i < weightsCount; ++i) {
+        auto lerp = Lerp(weights[a * weightsCount + i],
+                         weights[b * weightsCount + i],
+                         t);
+        if (std::abs(lerp - weights[k * weightsCount + i]) > tolerance) {
+          return false;
+        }
+      }
+      return true;
+    });
+}
+
+// STEP は前のキーと同じ値なら消せる
+template<typename T, typename F>
+static std::vector<uint32_t>
+ReduceStep(std::span<const T> values, const F& isSame)
+{
+  std::vector<uint32_t> keep;
+  for (uint32_t i = 0; i < values.size(); ++i) {
+    if (keep.empty() || i + 1 == values.size() ||
+        !isSame(values[keep.back()], values[i])) {
+      keep.push_back(i);
+    }
+  }
+  return keep;
+}
+
+template<typename T>
+static void
+Apply(Curve<T>& curve, std::span<const uint32_t> keep)
+{
+  std::vector<float> times;
+  std::vector<T> values;
+  times.reserve(keep.size());
+  values.reserve(keep.size());
+  for (auto i : keep) {
+    times.push_back(curve.Times[i]);
+    values.push_back(curve.Values[i]);
+  }
+  curve.Times = std::move(times);
+  curve.Values = std::move(values);
+  curve.m_cursor = 0;
+}
+
+template<typename T, typename F>
+static void
+ReduceCurve(Curve<T>& curve,
+            KeyframeReduction* result,
+            const F& reduce,
+            float tolerance)
+{
+  result->Before += curve.Times.size();
+  if (curve.Interpolation ==
+      gltfjson::AnimationInterpolationModes::CUBICSPLINE) {
+    result->After += curve.Times.size();
+    return;
+  }
+
+  std::vector<uint32_t> keep;
+  if (curve.Interpolation == gltfjson::AnimationInterpolationModes::STEP) {
+    keep = ReduceStep<T>(curve.Values, [&reduce, tolerance](auto& l, auto& r) {
+      float times[] = { 0, 1, 2 };
+      T values[] = { l, r, l };
+      // same value if the middle key is reproduced by a flat segment
+      return reduce(times, std::span<const T>(values), tolerance).size() == 2;
+    });
+  } else {
+    keep = reduce(curve.Times, curve.Values, tolerance);
+  }
+  Apply(curve, keep);
+  result->After += curve.Times.size();
+}
+
+KeyframeReduction
+ReduceKeyframes(Animation& animation, const KeyframeTolerance& tolerance)
+{
+  KeyframeReduction result;
+  auto reduce3 = [](std::span<const float> times,
+                    std::span<const DirectX::XMFLOAT3> values,
+                    float tolerance) {
+    return ReduceKeyframes(times, values, tolerance);
+  };
+  auto reduce4 = [](std::span<const float> times,
+                    std::span<const DirectX::XMFLOAT4> values,
+                    float tolerance) {
+    return ReduceKeyframes(times, values, tolerance);
+  };
+  for (auto& [k, v] : animation.m_translationMap) {
+    ReduceCurve(v, &result, reduce3, tolerance.Position);
+  }
+  for (auto& [k, v] : animation.m_rotationMap) {
+    ReduceCurve(v, &result, reduce4, tolerance.Angle);
+  }
+  for (auto& [k, v] : animation.m_scaleMap) {
+    ReduceCurve(v, &result, reduce3, tolerance.Scale);
+  }
+  for (auto& [k, v] : animation.m_weightsMap) {
+    result.Before += v.Times.size();
+    if (v.Interpolation == gltfjson::AnimationInterpolationModes::LINEAR) {
+      auto keep =
+        ReduceKeyframes(v.Times, v.Values, v.WeightsCount, tolerance.Weight);
+      std::vector<float> times;
+      std::vector<float> values;
+      for (auto i : keep) {
+        times.push_back(v.Times[i]);
+        auto span = v.Span(i);
+        values.insert(values.end(), span.begin(), span.end());
+      }
+      v.Times = std::move(times);
+      v.Values = std::move(values);
+      v.m_cursor = 0;
+    }
+    result.After += v.Times.size();
+  }
+  return result;
+}
+
+} // namespace
@@ -0,0 +1,49 @@
+#pragma once
+#include <DirectXMath.h>
+#include <span>
+#include <stdint.h>
+#include <vector>
+
+namespace libvrm {
+struct Animation;
+
+struct KeyframeTolerance
+{
+  // meter
+  float Position = 0.001f;
+  // radians
+  float Angle = DirectX::XMConvertToRadians(0.1f);
+  float Scale = 0.001f;
+  float Weight = 0.001f;
+};
+
+struct KeyframeReduction
+{
+  size_t Before = 0;
+  size_t After = 0;
+};
+
+// return the indices of the keys to keep.
+// linear interpolation between kept keys stays within the tolerance at every
+// removed key. usable for export as well.
+std::vector<uint32_t>
+ReduceKeyframes(std::span<const float> times,
+                std::span<const DirectX::XMFLOAT3> values,
+                float tolerance);
+
+std::vector<uint32_t>
+ReduceKeyframes(std::span<const float> times,
+                std::span<const DirectX::XMFLOAT4> rotations,
+                float angle);
+
+std::vector<uint32_t>
+ReduceKeyframes(std::span<const float> times,
+                std::span<const float> weights,
+                uint32_t weightsCount,
+                float tolerance);
+
+// reduce LINEAR and STEP curves in place. CUBICSPLINE is kept as is.
+KeyframeReduction
+ReduceKeyframes(Animation& animation, const KeyframeTolerance& tolerance);
+
+} // namespace
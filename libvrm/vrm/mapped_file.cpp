@@ -0,0 +1,102 @@
+#include "mapped_file.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace libvrm {
+
+#ifdef _WIN32
+bool
+MappedFile::Open(const std::filesystem::path& path)
+{
+  Close();
+  auto file = CreateFileW(path.c_str(),
+                          GENERIC_READ,
+                          FILE_SHARE_READ,
+                          nullptr,
+                          OPEN_EXISTING,
+                          FILE_FLAG_SEQUENTIAL_SCAN,
+                          nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  m_handle = file;
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+    Close();
+    return false;
+  }
+  m_mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!m_mapping) {
+    Close();
+    return false;
+  }
+  m_data = (const uint8_t*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+  if (!m_data) {
+    Close();
+    return false;
+  }
+  m_size = static_cast<size_t>(size.QuadPart);
+  return true;
+}
+
+void
+MappedFile::Close()
+{
+  if (m_data) {
+    UnmapViewOfFile(m_data);
+    m_data = nullptr;
+  }
+  if (m_mapping) {
+    CloseHandle(m_mapping);
+    m_mapping = nullptr;
+  }
+  if (m_handle) {
+    CloseHandle(m_handle);
+    m_handle = nullptr;
+  }
+  m_size = 0;
+}
+#else
+bool
+MappedFile::Open(const std::filesystem::path& path)
+{
+  Close();
+  auto fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return false;
+  }
+  auto p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // the mapping keeps the file
+  close(fd);
+  if (p == MAP_FAILED) {
+    return false;
+  }
+  madvise(p, st.st_size, MADV_SEQUENTIAL);
+  m_data = (const uint8_t*)p;
+  m_size = st.st_size;
+  return true;
+}
+
+void
+MappedFile::Close()
+{
+  if (m_data) {
+    munmap((void*)m_data, m_size);
+    m_data = nullptr;
+  }
+  m_size = 0;
+}
+#endif
+
+} // namespace
@@ -0,0 +1,29 @@
+#pragma once
+#include <filesystem>
+#include <span>
+#include <stdint.h>
+#include <string_view>
+
+namespace libvrm {
+
+// read only memory mapped file
+class MappedFile
+{
+  void* m_handle = nullptr;
+  void* m_mapping = nullptr;
+  const uint8_t* m_data = nullptr;
+  size_t m_size = 0;
+
+public:
+  MappedFile() {}
+  ~MappedFile() { Close(); }
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  bool Open(const std::filesystem::path& path);
+  void Close();
+  std::span<const uint8_t> Bytes() const { return { m_data, m_size }; }
+  std::string_view String() const { return { (const char*)m_data, m_size }; }
+};
+
+} // namespace
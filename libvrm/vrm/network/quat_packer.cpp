@@ -0,0 +1,128 @@
+#include "quat_packer.h"
+#if defined(_M_X64) || defined(__SSE2__)
+#define QUAT_PACKER_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace libvrm::quat_packer {
+
+#ifdef QUAT_PACKER_SSE2
+// mask ? a : b
+static inline __m128
+Select(__m128 mask, __m128 a, __m128 b)
+{
+  return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// (a * SR2 + 1) * 0.5 * C, truncated to 10 bits. same order as pack()
+static inline __m128i
+Pack10(__m128 a)
+{
+  auto v = _mm_add_ps(_mm_mul_ps(a, _mm_set1_ps(SR2)), _mm_set1_ps(1.0f));
+  v = _mm_mul_ps(_mm_mul_ps(v, _mm_set1_ps(0.5f)), _mm_set1_ps(C));
+  return _mm_and_si128(_mm_cvttps_epi32(v), _mm_set1_epi32(0x3ff));
+}
+
+// ((a * R) * 2 - 1) * RSR2. same order as unpack()
+static inline __m128
+Unpack10(__m128i a)
+{
+  auto v = _mm_mul_ps(_mm_cvtepi32_ps(a), _mm_set1_ps(R));
+  v = _mm_sub_ps(_mm_mul_ps(v, _mm_set1_ps(2.0f)), _mm_set1_ps(1.0f));
+  return _mm_mul_ps(v, _mm_set1_ps(RSR2));
+}
+#endif
+
+void
+PackBatch(const float* src, uint32_t* dst, size_t n)
+{
+  size_t i = 0;
+#ifdef QUAT_PACKER_SSE2
+  for (; i + 4 <= n; i += 4, src += 16, dst += 4) {
+    // 4 x xyzw => xxxx, yyyy, zzzz, wwww
+    auto x = _mm_loadu_ps(src);
+    auto y = _mm_loadu_ps(src + 4);
+    auto z = _mm_loadu_ps(src + 8);
+    auto w = _mm_loadu_ps(src + 12);
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+
+    // dropmax. ties are resolved as the scalar version
+    auto xx = _mm_mul_ps(x, x);
+    auto yy = _mm_mul_ps(y, y);
+    auto zz = _mm_mul_ps(z, z);
+    auto ww = _mm_mul_ps(w, w);
+    auto d0 = _mm_and_ps(
+      _mm_and_ps(_mm_cmpgt_ps(xx, yy), _mm_cmpgt_ps(xx, zz)),
+      _mm_cmpgt_ps(xx, ww));
+    auto d1 = _mm_andnot_ps(
+      d0, _mm_and_ps(_mm_cmpgt_ps(yy, zz), _mm_cmpgt_ps(yy, ww)));
+    auto d01 = _mm_or_ps(d0, d1);
+    auto d2 = _mm_andnot_ps(d01, _mm_cmpgt_ps(zz, ww));
+    auto d3 = _mm_andnot_ps(_mm_or_ps(d01, d2),
+                            _mm_castsi128_ps(_mm_set1_epi32(-1)));
+
+    // the dropped component is positive. flip the sign bit of the others
+    auto dropped = Select(d0, x, Select(d1, y, Select(d2, z, w)));
+    auto flip = _mm_and_ps(_mm_cmplt_ps(dropped, _mm_setzero_ps()),
+                           _mm_set1_ps(-0.0f));
+    auto a0 = _mm_xor_ps(Select(d0, y, x), flip);
+    auto a1 = _mm_xor_ps(Select(d01, z, y), flip);
+    auto a2 = _mm_xor_ps(Select(d3, z, w), flip);
+
+    auto drop = _mm_or_si128(
+      _mm_and_si128(_mm_castps_si128(d1), _mm_set1_epi32(1u << 30)),
+      _mm_or_si128(
+        _mm_and_si128(_mm_castps_si128(d2), _mm_set1_epi32(2u << 30)),
+        _mm_and_si128(_mm_castps_si128(d3), _mm_set1_epi32(3u << 30))));
+    auto packed = _mm_or_si128(
+      _mm_or_si128(Pack10(a0), _mm_slli_epi32(Pack10(a1), 10)),
+      _mm_or_si128(_mm_slli_epi32(Pack10(a2), 20), drop));
+    _mm_storeu_si128((__m128i*)dst, packed);
+  }
+#endif
+  for (; i < n; ++i, src += 4, ++dst) {
+    *dst = Pack(src[0], src[1], src[2], src[3]);
+  }
+}
+
+void
+UnpackBatch(const uint32_t* src, float* dst, size_t n)
+{
+  size_t i = 0;
+#ifdef QUAT_PACKER_SSE2
+  auto mask = _mm_set1_epi32(0x3ff);
+  for (; i + 4 <= n; i += 4, src += 4, dst += 16) {
+    auto packed = _mm_loadu_si128((const __m128i*)src);
+    auto a0 = Unpack10(_mm_and_si128(packed, mask));
+    auto a1 = Unpack10(_mm_and_si128(_mm_srli_epi32(packed, 10), mask));
+    auto a2 = Unpack10(_mm_and_si128(_mm_srli_epi32(packed, 20), mask));
+    auto iss = _mm_sqrt_ps(_mm_sub_ps(
+      _mm_set1_ps(1.0f),
+      _mm_add_ps(_mm_add_ps(_mm_mul_ps(a0, a0), _mm_mul_ps(a1, a1)),
+                 _mm_mul_ps(a2, a2))));
+
+    auto drop = _mm_srli_epi32(packed, 30);
+    auto d0 = _mm_castsi128_ps(_mm_cmpeq_epi32(drop, _mm_setzero_si128()));
+    auto d1 = _mm_castsi128_ps(_mm_cmpeq_epi32(drop, _mm_set1_epi32(1)));
+    auto d2 = _mm_castsi128_ps(_mm_cmpeq_epi32(drop, _mm_set1_epi32(2)));
+    auto d3 = _mm_castsi128_ps(_mm_cmpeq_epi32(drop, _mm_set1_epi32(3)));
+
+    auto x = Select(d0, iss, a0);
+    auto y = Select(d0, a0, Select(d1, iss, a1));
+    auto z = Select(d3, a2, Select(d2, iss, a1));
+    auto w = Select(d3, iss, a2);
+
+    // xxxx, yyyy, zzzz, wwww => 4 x xyzw
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+    _mm_storeu_ps(dst, x);
+    _mm_storeu_ps(dst + 4, y);
+    _mm_storeu_ps(dst + 8, z);
+    _mm_storeu_ps(dst + 12, w);
+  }
+#endif
+  for (; i < n; ++i, ++src, dst += 4) {
+    Unpack(*src, dst);
+  }
+}
+
+}
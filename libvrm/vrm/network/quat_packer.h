@@ -1,5 +1,7 @@
 #pragma once
+#include <algorithm>
 #include <cmath>
+#include <stddef.h>
 #include <stdint.h>
 
 //
@@ -137,4 +139,46 @@ Unpack(uint32_t src, float values[4])
   }
 }
 
+// n quaternions of x, y, z, w. the result is the same as Pack / Unpack.
+// 4 quaternions at a time on sse2 without branches
+void
+PackBatch(const float* src, uint32_t* dst, size_t n);
+void
+UnpackBatch(const uint32_t* src, float* dst, size_t n);
+
+// 48bit variant. 3 x 15bit + 2bit drop index in the msb of [0] and [1].
+static constexpr float C15 = float(0x7fff);
+static constexpr float R15 = 1.0f / float(0x7fff);
+
+inline void
+Pack48(float x, float y, float z, float w, uint16_t dst[3])
+{
+  float q[4] = { x, y, z, w };
+  int drop = dropmax(square(x), square(y), square(z), square(w));
+  float s = sign(q[drop]);
+  for (int i = 0, j = 0; i < 4; ++i) {
+    if (i != drop) {
+      dst[j++] =
+        static_cast<uint16_t>((q[i] * s * SR2 + 1.0f) * 0.5f * C15 + 0.5f);
+    }
+  }
+  dst[0] |= static_cast<uint16_t>((drop & 1) << 15);
+  dst[1] |= static_cast<uint16_t>((drop >> 1) << 15);
+}
+
+inline void
+Unpack48(const uint16_t src[3], float values[4])
+{
+  int drop = (src[0] >> 15) | ((src[1] >> 15) << 1);
+  float a[3];
+  for (int i = 0; i < 3; ++i) {
+    a[i] = (((src[i] & 0x7fff) * R15) * 2.0f - 1.0f) * RSR2;
+  }
+  float iss = std::sqrt(
+    std::max(0.0f, 1.0f - (square(a[0]) + square(a[1]) + square(a[2]))));
+  for (int i = 0, j = 0; i < 4; ++i) {
+    values[i] = i == drop ? iss : a[j++];
+  }
+}
+
 }
@@ -359,7 +359,22 @@ enum class FrameFlags : uint32_t
   NONE = 0,
   // enableed rotation is Quat32: disabled rotation is float4(x, y, z, w)
   USE_QUAT32 = 0x1,
+  // rotation is uint16_t x 3 (quat_packer::Pack48)
+  USE_QUAT48 = 0x2,
+  // DeltaHeader and the changed joint bitmask follow the FrameHeader.
+  // only the changed joints are sent. the others keep the last value
+  DELTA = 0x4,
 };
+inline FrameFlags
+operator|(FrameFlags lhs, FrameFlags rhs)
+{
+  return static_cast<FrameFlags>((uint32_t)lhs | (uint32_t)rhs);
+}
+inline FrameFlags
+operator&(FrameFlags lhs, FrameFlags rhs)
+{
+  return static_cast<FrameFlags>((uint32_t)lhs & (uint32_t)rhs);
+}
 
 constexpr const char* SRHT_FRAME_MAGIC1 = "SRHTFRM1";
 struct FrameHeader
@@ -376,4 +391,13 @@ struct FrameHeader
 // continue PackQuat x SkeletonHeader::JointCount
 static_assert(sizeof(FrameHeader) == 32, "FrameSize");
 
+struct DeltaHeader
+{
+  uint16_t jointCount = 0;
+  uint16_t reserved = 0;
+};
+// continue uint32_t x (jointCount + 31) / 32 bitmask. bit i is joint i.
+// then the rotations of the joints that the bit is set
+static_assert(sizeof(DeltaHeader) == 4, "DeltaHeader");
+
 } // namespace srht
@@ -0,0 +1,175 @@
+#include "srht_dispatcher.h"
+#include "../gltfroot.h"
+#include "../runtime_node.h"
+#include "../runtime_scene.h"
+#include "srht_record.h"
+#include <string_view>
+
+namespace libvrm {
+namespace srht {
+
+ReceiverStream::ReceiverStream(uint16_t skeletonId, size_t jointCapacity)
+  : SkeletonId(skeletonId)
+{
+  Skeleton.Initialize([jointCapacity](ReceivedSkeleton& slot) {
+    slot.Joints.reserve(jointCapacity);
+    slot.InitialRotations.reserve(jointCapacity);
+  });
+  Frames.Initialize([jointCapacity](ReceivedFrame& slot) {
+    slot.Rotations.reserve(jointCapacity);
+  });
+  State.Rotations.reserve(jointCapacity);
+  SkeletonState.Joints.reserve(jointCapacity);
+  SkeletonState.InitialRotations.reserve(jointCapacity);
+}
+
+void
+PacketDispatcher::Dispatch(std::span<const uint8_t> data,
+                           std::chrono::steady_clock::time_point received)
+{
+  ++m_packets;
+  if (m_recorder) {
+    // as received. broken packets too
+    m_recorder->Write(received, data);
+  }
+  auto id = PeekSkeletonId(data);
+  if (!id) {
+    ++m_errors;
+    return;
+  }
+  auto stream = GetOrCreateStream(*id);
+  if (!stream) {
+    return;
+  }
+  std::string_view magic((const char*)data.data(), 8);
+  if (magic == SRHT_SKELETON_MAGIC1) {
+    auto& back = stream->Skeleton.Back();
+    if (DecodeSkeleton(data, &back)) {
+      back.Generation = ++stream->Generation;
+      // copy keeps the capacity
+      stream->SkeletonState = back;
+      stream->Skeleton.Publish();
+      ++m_skeletons;
+      return;
+    }
+  } else {
+    if (DecodeFrame(data, &stream->State)) {
+      OnFrame(*stream, data.size(), received);
+      return;
+    }
+  }
+  ++m_errors;
+}
+
+void
+PacketDispatcher::OnFrame(ReceiverStream& stream,
+                          size_t bytes,
+                          std::chrono::steady_clock::time_point received)
+{
+  auto& state = stream.State;
+  stream.Stats.Push(
+    received, bytes, state.Changed, state.Rotations.size(), state.Keyframe);
+  ++m_frames;
+  if (stream.PublishPose.load(std::memory_order_relaxed)) {
+    OnPose(stream);
+  }
+  auto back = stream.Frames.Back();
+  if (!back) {
+    // consumer is stalled
+    ++m_overflow;
+    return;
+  }
+  // copy keeps the capacity
+  static_cast<FrameData&>(*back) = state;
+  back->Received = received;
+  back->Generation = stream.Generation;
+  back->Stats = stream.Stats;
+  stream.Frames.Push();
+}
+
+void
+PacketDispatcher::OnPose(ReceiverStream& stream)
+{
+  if (!stream.Generation) {
+    // the skeleton is not received yet
+    return;
+  }
+  if (stream.PoseGeneration != stream.Generation) {
+    // a new skeleton. allocates
+    if (!stream.PoseScene) {
+      stream.PoseScene = RuntimeScene::Load(std::make_shared<GltfRoot>());
+    }
+    BuildScene(stream.PoseScene->m_base, stream.SkeletonState);
+    stream.PoseScene->Reset();
+    stream.PoseGeneration = stream.Generation;
+  }
+
+  auto& scene = *stream.PoseScene;
+  auto& state = stream.State;
+  if (scene.m_roots.empty() || state.Rotations.size() != scene.m_nodes.size()) {
+    return;
+  }
+  for (size_t i = 0; i < state.Rotations.size(); ++i) {
+    scene.m_nodes[i]->Transform.Rotation = state.Rotations[i];
+  }
+  scene.m_roots[0]->Transform.Translation = state.RootPosition;
+  scene.m_roots[0]->CalcWorldMatrix(true);
+  stream.Pose.Publish(scene.UpdateHumanPose(), state.Time);
+}
+
+ReceiverStream*
+PacketDispatcher::Stream(size_t i) const
+{
+  if (i >= StreamCount()) {
+    return nullptr;
+  }
+  return m_streams[i].get();
+}
+
+// a few dozens. linear search is enough
+ReceiverStream*
+PacketDispatcher::FindStream(uint16_t skeletonId) const
+{
+  auto count = StreamCount();
+  for (size_t i = 0; i < count; ++i) {
+    if (m_streams[i]->SkeletonId == skeletonId) {
+      return m_streams[i].get();
+    }
+  }
+  return nullptr;
+}
+
+ReceiverStream*
+PacketDispatcher::GetOrCreateStream(uint16_t skeletonId)
+{
+  if (auto stream = FindStream(skeletonId)) {
+    return stream;
+  }
+  auto count = m_streamCount.load(std::memory_order_relaxed);
+  if (count == m_streams.size()) {
+    ++m_rejected;
+    return nullptr;
+  }
+  // a new performer
+  m_streams[count] =
+    std::make_unique<ReceiverStream>(skeletonId, Receiver::JointCapacity);
+  m_streamCount.store(count + 1, std::memory_order_release);
+  return m_streams[count].get();
+}
+
+ReceiverStats
+PacketDispatcher::Stats() const
+{
+  return {
+    m_packets.load(std::memory_order_relaxed),
+    m_skeletons.load(std::memory_order_relaxed),
+    m_frames.load(std::memory_order_relaxed),
+    m_errors.load(std::memory_order_relaxed),
+    m_overflow.load(std::memory_order_relaxed),
+    m_rejected.load(std::memory_order_relaxed),
+    m_lost.load(std::memory_order_relaxed),
+  };
+}
+
+} // namespace
+} // namespace
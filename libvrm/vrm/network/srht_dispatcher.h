@@ -0,0 +1,60 @@
+#pragma once
+#include "srht_receiver.h"
+#include <array>
+#include <atomic>
+#include <memory>
+#include <span>
+
+namespace libvrm {
+namespace srht {
+
+// the transport independent half of a Receiver.
+// decodes the packets of the receive thread into the streams
+class PacketDispatcher
+{
+  // registry of skeletonId. written by the receive thread, m_streamCount is
+  // published after the slot is constructed. never shrinks
+  std::array<std::unique_ptr<ReceiverStream>, Receiver::MaxStreams> m_streams;
+  std::atomic<size_t> m_streamCount{ 0 };
+
+  std::atomic<uint64_t> m_packets{ 0 };
+  std::atomic<uint64_t> m_skeletons{ 0 };
+  std::atomic<uint64_t> m_frames{ 0 };
+  std::atomic<uint64_t> m_errors{ 0 };
+  std::atomic<uint64_t> m_overflow{ 0 };
+  std::atomic<uint64_t> m_rejected{ 0 };
+  std::atomic<uint64_t> m_lost{ 0 };
+
+  // receive thread
+  std::shared_ptr<PacketRecorder> m_recorder;
+
+public:
+  // receive thread
+  void SetRecorder(const std::shared_ptr<PacketRecorder>& recorder)
+  {
+    m_recorder = recorder;
+  }
+  void Dispatch(std::span<const uint8_t> data,
+                std::chrono::steady_clock::time_point received);
+  void CountError() { ++m_errors; }
+  void CountLost(uint64_t count) { m_lost += count; }
+
+  // any thread
+  size_t StreamCount() const
+  {
+    return m_streamCount.load(std::memory_order_acquire);
+  }
+  ReceiverStream* Stream(size_t i) const;
+  ReceiverStream* FindStream(uint16_t skeletonId) const;
+  ReceiverStats Stats() const;
+
+private:
+  ReceiverStream* GetOrCreateStream(uint16_t skeletonId);
+  void OnFrame(ReceiverStream& stream,
+               size_t bytes,
+               std::chrono::steady_clock::time_point received);
+  void OnPose(ReceiverStream& stream);
+};
+
+} // namespace
+} // namespace
@@ -0,0 +1,211 @@
+#include "srht_jitter.h"
+#include <algorithm>
+#include <cmath>
+
+namespace libvrm {
+namespace srht {
+
+static double
+ToSeconds(std::chrono::nanoseconds time)
+{
+  return std::chrono::duration<double>(time).count();
+}
+
+static double
+ToSeconds(std::chrono::steady_clock::time_point time)
+{
+  return std::chrono::duration<double>(time.time_since_epoch()).count();
+}
+
+// u > 1 extrapolates
+static void
+Interpolate(const FrameData& a, const FrameData& b, float u, FrameData* out)
+{
+  out->SkeletonId = b.SkeletonId;
+  out->Time = a.Time + std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         (b.Time - a.Time) * u);
+  out->Keyframe = true;
+  if (a.Rotations.size() != b.Rotations.size()) {
+    *out = b;
+    return;
+  }
+
+  DirectX::XMStoreFloat3(
+    &out->RootPosition,
+    DirectX::XMVectorLerp(DirectX::XMLoadFloat3(&a.RootPosition),
+                          DirectX::XMLoadFloat3(&b.RootPosition),
+                          u));
+  out->Rotations.resize(b.Rotations.size());
+  for (size_t i = 0; i < b.Rotations.size(); ++i) {
+    auto q = DirectX::XMQuaternionSlerp(DirectX::XMLoadFloat4(&a.Rotations[i]),
+                                        DirectX::XMLoadFloat4(&b.Rotations[i]),
+                                        u);
+    DirectX::XMStoreFloat4(&out->Rotations[i],
+                           DirectX::XMQuaternionNormalize(q));
+  }
+  out->Changed = static_cast<uint16_t>(out->Rotations.size());
+}
+
+JitterBuffer::JitterBuffer(size_t jointCapacity)
+{
+  for (auto& slot : m_slots) {
+    slot.Rotations.reserve(jointCapacity);
+  }
+  m_previous.Rotations.reserve(jointCapacity);
+}
+
+void
+JitterBuffer::Clear()
+{
+  m_begin = 0;
+  m_count = 0;
+  m_hasPrevious = false;
+  m_hasBase = false;
+  m_jitter = 0;
+  m_interval = 0;
+  m_delay = 0;
+  m_newest = 0;
+  m_hasPlayed = false;
+  m_stats = {};
+}
+
+void
+JitterBuffer::PopFront()
+{
+  // swap keeps both capacities
+  std::swap(m_previous, At(0));
+  m_hasPrevious = true;
+  m_begin = (m_begin + 1) % Capacity;
+  --m_count;
+}
+
+void
+JitterBuffer::Push(const FrameData& frame,
+                   std::chrono::steady_clock::time_point received)
+{
+  auto time = ToSeconds(frame.Time);
+  if (m_hasBase && time < m_newest - 1.0) {
+    // sender restarted
+    Clear();
+  }
+
+  ++m_stats.Received;
+  auto transit = ToSeconds(received) - time;
+  if (!m_hasBase) {
+    m_baseOffset = transit;
+    m_hasBase = true;
+  } else {
+    m_jitter += (std::abs(transit - m_lastTransit) - m_jitter) / 16;
+    if (transit < m_baseOffset) {
+      m_baseOffset = transit;
+    } else {
+      // follow the clock drift slowly
+      m_baseOffset += (transit - m_baseOffset) * 0.001;
+    }
+  }
+  m_lastTransit = transit;
+
+  if (m_hasPlayed && time <= m_played) {
+    ++m_stats.Late;
+    return;
+  }
+
+  if (m_stats.Received > 1) {
+    if (time > m_newest) {
+      auto gap = time - m_newest;
+      if (m_interval > 0 && gap > m_interval * 1.5) {
+        m_stats.Lost +=
+          static_cast<uint64_t>(std::round(gap / m_interval)) - 1;
+      } else {
+        m_interval =
+          m_interval > 0 ? m_interval + (gap - m_interval) * 0.1 : gap;
+      }
+    } else if (m_stats.Lost > 0) {
+      // reordered. counted as lost by the gap
+      --m_stats.Lost;
+    }
+  }
+  m_newest = std::max(m_newest, time);
+
+  for (size_t i = 0; i < m_count; ++i) {
+    if (At(i).Time == frame.Time) {
+      // duplicated
+      return;
+    }
+  }
+  if (m_count == Capacity) {
+    PopFront();
+  }
+  // copy keeps the capacity
+  At(m_count++) = frame;
+  // out of order
+  for (size_t i = m_count - 1; i > 0 && At(i - 1).Time > At(i).Time; --i) {
+    std::swap(At(i - 1), At(i));
+  }
+}
+
+bool
+JitterBuffer::Sample(std::chrono::steady_clock::time_point now, FrameData* out)
+{
+  if (m_count == 0) {
+    if (!m_hasPrevious) {
+      return false;
+    }
+    ++m_stats.Underrun;
+    *out = m_previous;
+    return true;
+  }
+
+  auto target =
+    std::clamp(JitterFactor * m_jitter + m_interval, MinDelay, MaxDelay);
+  m_delay += (target - m_delay) * 0.05;
+  m_stats.TargetDelay = target * 1000;
+  m_stats.Delay = m_delay * 1000;
+  m_stats.Jitter = m_jitter * 1000;
+  m_stats.Interval = m_interval * 1000;
+
+  // sender time to show
+  auto t = ToSeconds(now) - m_baseOffset - m_delay;
+  if (m_hasPlayed) {
+    t = std::max(t, m_played);
+  }
+  m_played = t;
+  m_hasPlayed = true;
+
+  // keep the last frame before t
+  while (m_count >= 2 && ToSeconds(At(1).Time) <= t) {
+    PopFront();
+  }
+
+  auto& a = At(0);
+  auto ta = ToSeconds(a.Time);
+  if (t <= ta) {
+    // waiting the delay
+    *out = a;
+    return true;
+  }
+
+  if (m_count >= 2) {
+    auto& b = At(1);
+    auto u = (t - ta) / (ToSeconds(b.Time) - ta);
+    Interpolate(a, b, static_cast<float>(u), out);
+    return true;
+  }
+
+  // beyond the newest frame
+  if (m_hasPrevious && t - ta <= MaxExtrapolation) {
+    auto tp = ToSeconds(m_previous.Time);
+    if (ta > tp) {
+      auto u = (t - tp) / (ta - tp);
+      Interpolate(m_previous, a, static_cast<float>(u), out);
+      ++m_stats.Extrapolated;
+      return true;
+    }
+  }
+  ++m_stats.Underrun;
+  *out = a;
+  return true;
+}
+
+} // namespace
+} // namespace
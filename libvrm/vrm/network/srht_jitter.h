@@ -0,0 +1,88 @@
+#pragma once
+#include "srht_update.h"
+#include <array>
+#include <chrono>
+#include <stdint.h>
+
+namespace libvrm {
+namespace srht {
+
+struct JitterStats
+{
+  // milliseconds
+  // playout delay behind the fastest packet
+  double Delay = 0;
+  double TargetDelay = 0;
+  // RFC 3550 interarrival jitter
+  double Jitter = 0;
+  // sender frame interval
+  double Interval = 0;
+
+  uint64_t Received = 0;
+  // arrived after its time is played out
+  uint64_t Late = 0;
+  // gaps in the sender time
+  uint64_t Lost = 0;
+  // sampled beyond the newest frame
+  uint64_t Extrapolated = 0;
+  // nothing new to sample. the last frame is held
+  uint64_t Underrun = 0;
+};
+
+// reorder frames by FrameData::Time and play them out with a delay that
+// follows the jitter. a sample is the slerp of the two bracketing frames.
+// no allocation after the slots are reserved.
+class JitterBuffer
+{
+public:
+  static constexpr size_t Capacity = 64;
+
+  // target delay = JitterFactor * jitter + interval
+  float JitterFactor = 3.0f;
+  // seconds
+  double MinDelay = 0.0;
+  double MaxDelay = 0.25;
+  double MaxExtrapolation = 0.1;
+
+private:
+  // ordered by Time. ring
+  std::array<FrameData, Capacity> m_slots;
+  size_t m_begin = 0;
+  size_t m_count = 0;
+  // the last frame dropped from the front. used to extrapolate
+  FrameData m_previous;
+  bool m_hasPrevious = false;
+
+  // seconds
+  // local arrival - sender time. the minimum is the fastest transit
+  double m_baseOffset = 0;
+  double m_lastTransit = 0;
+  bool m_hasBase = false;
+  double m_jitter = 0;
+  double m_interval = 0;
+  double m_delay = 0;
+  double m_newest = 0;
+  double m_played = 0;
+  bool m_hasPlayed = false;
+
+  JitterStats m_stats;
+
+public:
+  JitterBuffer(size_t jointCapacity = 256);
+  void Clear();
+
+  void Push(const FrameData& frame,
+            std::chrono::steady_clock::time_point received);
+  // false if no frame is pushed yet
+  bool Sample(std::chrono::steady_clock::time_point now, FrameData* out);
+
+  size_t Size() const { return m_count; }
+  const JitterStats& Stats() const { return m_stats; }
+
+private:
+  FrameData& At(size_t i) { return m_slots[(m_begin + i) % Capacity]; }
+  void PopFront();
+};
+
+} // namespace
+} // namespace
@@ -0,0 +1,159 @@
+#include "srht_receiver.h"
+#include "srht_dispatcher.h"
+#include <array>
+#include <thread>
+
+#ifdef _WIN32
+#define _WIN32_WINNT 0x0601
+#endif
+#include <asio.hpp>
+
+namespace libvrm {
+namespace srht {
+
+struct UdpReceiverImpl
+{
+  asio::io_context m_io;
+  asio::ip::udp::socket m_socket;
+  asio::ip::udp::endpoint m_remote;
+  // max udp payload
+  std::array<uint8_t, 65536> m_buffer;
+  std::thread m_thread;
+  uint16_t m_port = 0;
+
+  PacketDispatcher m_dispatcher;
+
+  UdpReceiverImpl()
+    : m_socket(m_io)
+  {
+  }
+
+  ~UdpReceiverImpl() { Stop(); }
+
+  bool Start(uint16_t port, bool loopback)
+  {
+    Stop();
+    std::error_code ec;
+    m_socket.open(asio::ip::udp::v4(), ec);
+    if (!ec) {
+      auto address = loopback ? asio::ip::address_v4::loopback()
+                              : asio::ip::address_v4::any();
+      m_socket.bind(asio::ip::udp::endpoint(address, port), ec);
+    }
+    if (ec) {
+      std::error_code ignore;
+      m_socket.close(ignore);
+      return false;
+    }
+    m_port = port;
+    AsyncReceive();
+    m_thread = std::thread([self = this]() { self->m_io.run(); });
+    return true;
+  }
+
+  void Stop()
+  {
+    if (!m_thread.joinable()) {
+      return;
+    }
+    m_io.stop();
+    m_thread.join();
+    std::error_code ignore;
+    m_socket.close(ignore);
+    m_io.restart();
+  }
+
+  // asio recycles the handler memory. no allocation after the first packet
+  void AsyncReceive()
+  {
+    m_socket.async_receive_from(
+      asio::buffer(m_buffer),
+      m_remote,
+      [self = this](const std::error_code& ec, size_t size) {
+        if (ec == asio::error::operation_aborted) {
+          return;
+        }
+        if (ec) {
+          self->m_dispatcher.CountError();
+        } else {
+          self->m_dispatcher.Dispatch({ self->m_buffer.data(), size },
+                                      std::chrono::steady_clock::now());
+        }
+        self->AsyncReceive();
+      });
+  }
+};
+
+UdpReceiver::UdpReceiver()
+  : m_impl(new UdpReceiverImpl)
+{
+}
+
+UdpReceiver::~UdpReceiver()
+{
+  delete m_impl;
+}
+
+bool
+UdpReceiver::Start(uint16_t port, bool loopback)
+{
+  return m_impl->Start(port, loopback);
+}
+
+void
+UdpReceiver::Stop()
+{
+  m_impl->Stop();
+}
+
+bool
+UdpReceiver::IsRunning() const
+{
+  return m_impl->m_thread.joinable();
+}
+
+uint16_t
+UdpReceiver::Port() const
+{
+  return m_impl->m_port;
+}
+
+size_t
+UdpReceiver::StreamCount() const
+{
+  return m_impl->m_dispatcher.StreamCount();
+}
+
+ReceiverStream*
+UdpReceiver::Stream(size_t i) const
+{
+  return m_impl->m_dispatcher.Stream(i);
+}
+
+ReceiverStream*
+UdpReceiver::FindStream(uint16_t skeletonId) const
+{
+  return m_impl->m_dispatcher.FindStream(skeletonId);
+}
+
+void
+UdpReceiver::SetRecorder(const std::shared_ptr<PacketRecorder>& recorder)
+{
+  if (IsRunning()) {
+    // the recorder is used on the io thread
+    asio::post(m_impl->m_io, [impl = m_impl, recorder]() {
+      impl->m_dispatcher.SetRecorder(recorder);
+    });
+  } else {
+    m_impl->m_dispatcher.SetRecorder(recorder);
+  }
+}
+
+ReceiverStats
+UdpReceiver::Stats() const
+{
+  return m_impl->m_dispatcher.Stats();
+}
+
+} // namespace
+} // namespace
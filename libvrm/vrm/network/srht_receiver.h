@@ -0,0 +1,138 @@
+#pragma once
+#include "../humanoid/humanpose_channel.h"
+#include "../spsc_queue.h"
+#include "../triple_buffer.h"
+#include "srht_update.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdint.h>
+
+namespace libvrm {
+struct RuntimeScene;
+
+namespace srht {
+
+class PacketRecorder;
+
+struct ReceivedSkeleton : SkeletonData
+{
+  // incremented for each skeleton packet
+  uint32_t Generation = 0;
+};
+
+struct ReceivedFrame : FrameData
+{
+  // steady_clock when the datagram is read on the io thread
+  std::chrono::steady_clock::time_point Received;
+  // ReceivedSkeleton::Generation at the time
+  uint32_t Generation = 0;
+  // of the stream at the time
+  StreamStats Stats;
+};
+
+struct ReceiverStats
+{
+  uint64_t Packets = 0;
+  uint64_t Skeletons = 0;
+  uint64_t Frames = 0;
+  uint64_t Errors = 0;
+  // frames dropped because the queue is full
+  uint64_t Overflow = 0;
+  // packets of a skeletonId beyond MaxStreams
+  uint64_t Rejected = 0;
+  // shared memory. overwritten by the writer before read
+  uint64_t Lost = 0;
+};
+
+// one skeletonId on the socket. created by the io thread on the first packet
+// of the id and kept until the receiver is destroyed.
+struct ReceiverStream
+{
+  // about 0.5 second at 120Hz
+  static constexpr size_t FrameCapacity = 64;
+
+  const uint16_t SkeletonId;
+
+  // io thread => consumer. the skeleton is handed through a triple buffer,
+  // frames through a queue in order
+  TripleBuffer<ReceivedSkeleton> Skeleton;
+  SpscQueue<ReceivedFrame, FrameCapacity> Frames;
+  // the HumanPose of the latest frame, converted on the io thread while the
+  // consumer sets PublishPose
+  HumanPoseChannel Pose;
+  std::atomic<bool> PublishPose{ false };
+
+  // io thread only
+  uint32_t Generation = 0;
+  // delta frames are applied to this
+  FrameData State;
+  StreamStats Stats;
+  // the last skeleton, for PoseScene
+  SkeletonData SkeletonState;
+  std::shared_ptr<RuntimeScene> PoseScene;
+  uint32_t PoseGeneration = 0;
+
+  // consumer thread only. a stream has one consumer
+  bool Claimed = false;
+
+  ReceiverStream(uint16_t skeletonId, size_t jointCapacity);
+};
+
+// SRHT packets of many skeletons through one transport and one receive
+// thread. the consumer side is the same for each transport
+class Receiver
+{
+public:
+  // joints reserved per slot. grows only if a larger skeleton comes
+  static constexpr size_t JointCapacity = 256;
+  // packets of more skeletonIds are dropped
+  static constexpr size_t MaxStreams = 64;
+
+  virtual ~Receiver() {}
+
+  virtual void Stop() = 0;
+  virtual bool IsRunning() const = 0;
+
+  // consumer thread. in order of arrival
+  virtual size_t StreamCount() const = 0;
+  virtual ReceiverStream* Stream(size_t i) const = 0;
+  // nullptr if no packet of the skeletonId is received yet
+  virtual ReceiverStream* FindStream(uint16_t skeletonId) const = 0;
+
+  // record every packet on the receive thread. nullptr to stop
+  virtual void SetRecorder(const std::shared_ptr<PacketRecorder>& recorder) = 0;
+
+  virtual ReceiverStats Stats() const = 0;
+};
+
+// receive on one socket and one io thread.
+// packets are decoded into slots reserved in advance. no allocation per
+// packet, except the first packet of a new skeletonId.
+class UdpReceiver : public Receiver
+{
+  struct UdpReceiverImpl* m_impl = nullptr;
+
+public:
+  UdpReceiver();
+  ~UdpReceiver();
+  UdpReceiver(const UdpReceiver&) = delete;
+  UdpReceiver& operator=(const UdpReceiver&) = delete;
+
+  // loopback only by default. false to receive from other hosts
+  bool Start(uint16_t port, bool loopback = true);
+  void Stop() override;
+  bool IsRunning() const override;
+  uint16_t Port() const;
+
+  size_t StreamCount() const override;
+  ReceiverStream* Stream(size_t i) const override;
+  ReceiverStream* FindStream(uint16_t skeletonId) const override;
+
+  void SetRecorder(const std::shared_ptr<PacketRecorder>& recorder) override;
+
+  ReceiverStats Stats() const override;
+};
+
+} // namespace
+} // namespace
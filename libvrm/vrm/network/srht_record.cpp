@@ -0,0 +1,198 @@
+#include "srht_record.h"
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+
+namespace libvrm {
+namespace srht {
+
+template<typename T>
+static bool
+Read(std::span<const uint8_t> bytes, uint64_t offset, T* out)
+{
+  if (offset > bytes.size() || bytes.size() - offset < sizeof(T)) {
+    return false;
+  }
+  std::memcpy(out, bytes.data() + offset, sizeof(T));
+  return true;
+}
+
+bool
+PacketRecorder::Open(const std::filesystem::path& path)
+{
+  Close();
+  m_os.open(path, std::ios::binary | std::ios::trunc);
+  if (!m_os) {
+    return false;
+  }
+  RecordFileHeader header{};
+  std::memcpy(header.magic, SRHT_RECORD_MAGIC1, 8);
+  header.version = 1;
+  m_os.write((const char*)&header, sizeof(header));
+  m_offset = sizeof(header);
+  m_index.clear();
+  m_count = 0;
+  m_bytes = m_offset;
+  m_indexed = true;
+  m_index.reserve(IndexCapacity);
+  m_start = std::chrono::steady_clock::now();
+  return true;
+}
+
+void
+PacketRecorder::Close()
+{
+  if (!m_os.is_open()) {
+    return;
+  }
+  if (m_indexed) {
+    RecordFooter footer{
+      .indexOffset = m_offset,
+      .count = m_index.size(),
+    };
+    std::memcpy(footer.magic, SRHT_RECORD_INDEX_MAGIC1, 8);
+    m_os.write((const char*)m_index.data(),
+               m_index.size() * sizeof(RecordIndex));
+    m_os.write((const char*)&footer, sizeof(footer));
+  }
+  m_os.close();
+}
+
+void
+PacketRecorder::Write(std::chrono::steady_clock::time_point received,
+                      std::span<const uint8_t> packet)
+{
+  if (!m_os.is_open()) {
+    return;
+  }
+  auto time = std::max(std::chrono::steady_clock::duration::zero(),
+                       received - m_start);
+  RecordHeader header{
+    .time =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(time).count(),
+    .size = static_cast<uint32_t>(packet.size()),
+  };
+  if (m_index.size() == m_index.capacity()) {
+    // no allocation on the receive thread. the replay scans the records
+    m_indexed = false;
+  }
+  if (m_indexed) {
+    m_index.push_back({ header.time, m_offset });
+  }
+  m_os.write((const char*)&header, sizeof(header));
+  m_os.write((const char*)packet.data(), packet.size());
+  m_offset += sizeof(header) + packet.size();
+  m_count.fetch_add(1, std::memory_order_relaxed);
+  m_bytes.store(m_offset, std::memory_order_relaxed);
+}
+
+// the records end at the index if the footer is there
+static size_t
+RecordsEnd(std::span<const uint8_t> bytes)
+{
+  RecordFooter footer;
+  if (bytes.size() >= sizeof(RecordFileHeader) + sizeof(footer) &&
+      Read(bytes, bytes.size() - sizeof(footer), &footer) &&
+      std::string_view(footer.magic, 8) == SRHT_RECORD_INDEX_MAGIC1 &&
+      footer.indexOffset >= sizeof(RecordFileHeader) &&
+      footer.indexOffset <= bytes.size() - sizeof(footer)) {
+    return footer.indexOffset;
+  }
+  return bytes.size();
+}
+
+// the footer and every record it points are in the file
+bool
+PacketReplay::ReadIndex(std::span<const uint8_t> bytes)
+{
+  RecordFooter footer;
+  if (bytes.size() < sizeof(RecordFileHeader) + sizeof(footer) ||
+      !Read(bytes, bytes.size() - sizeof(footer), &footer) ||
+      std::string_view(footer.magic, 8) != SRHT_RECORD_INDEX_MAGIC1) {
+    return false;
+  }
+  auto end = bytes.size() - sizeof(footer);
+  if (footer.count > (end - sizeof(RecordFileHeader)) / sizeof(RecordIndex) ||
+      footer.indexOffset != end - footer.count * sizeof(RecordIndex)) {
+    return false;
+  }
+
+  m_index.resize(footer.count);
+  std::memcpy(m_index.data(),
+              bytes.data() + footer.indexOffset,
+              footer.count * sizeof(RecordIndex));
+  for (auto& index : m_index) {
+    RecordHeader record;
+    if (index.offset < sizeof(RecordFileHeader) ||
+        index.offset > footer.indexOffset - sizeof(record) ||
+        !Read(bytes, index.offset, &record) ||
+        record.size > footer.indexOffset - index.offset - sizeof(record)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool
+PacketReplay::Open(const std::filesystem::path& path)
+{
+  m_index.clear();
+  if (!m_file.Open(path)) {
+    return false;
+  }
+  auto bytes = m_file.Bytes();
+  RecordFileHeader header;
+  if (!Read(bytes, 0, &header) ||
+      std::string_view(header.magic, 8) != SRHT_RECORD_MAGIC1) {
+    return false;
+  }
+
+  if (ReadIndex(bytes)) {
+    return true;
+  }
+
+  // no footer or a broken index. scan the records until a truncated one
+  m_index.clear();
+  bytes = bytes.first(RecordsEnd(bytes));
+  uint64_t offset = sizeof(header);
+  RecordHeader record;
+  while (Read(bytes, offset, &record) &&
+         bytes.size() - offset - sizeof(record) >= record.size) {
+    m_index.push_back({ record.time, offset });
+    offset += sizeof(record) + record.size;
+  }
+  return true;
+}
+
+RecordedPacket
+PacketReplay::Packet(size_t i) const
+{
+  if (i >= m_index.size()) {
+    return {};
+  }
+  auto bytes = m_file.Bytes();
+  auto offset = m_index[i].offset;
+  RecordHeader record;
+  if (!Read(bytes, offset, &record) ||
+      bytes.size() - offset - sizeof(record) < record.size) {
+    return {};
+  }
+  return {
+    std::chrono::nanoseconds(record.time),
+    bytes.subspan(offset + sizeof(record), record.size),
+  };
+}
+
+size_t
+PacketReplay::Seek(std::chrono::nanoseconds time) const
+{
+  auto it = std::lower_bound(
+    m_index.begin(),
+    m_index.end(),
+    time.count(),
+    [](const RecordIndex& index, int64_t t) { return index.time < t; });
+  return it - m_index.begin();
+}
+
+} // namespace
+} // namespace
@@ -0,0 +1,121 @@
+#pragma once
+#include "../mapped_file.h"
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <stdint.h>
+#include <vector>
+
+namespace libvrm {
+namespace srht {
+
+// SRHT packets as received, for replay.
+//
+// [RecordFileHeader]
+// [RecordHeader][packet] x N   append only
+// [RecordIndex] x N            written on Close
+// [RecordFooter]
+//
+// a file without the footer (the recorder crashed) is indexed by a scan.
+constexpr const char* SRHT_RECORD_MAGIC1 = "SRHTREC1";
+constexpr const char* SRHT_RECORD_INDEX_MAGIC1 = "SRHTIDX1";
+
+struct RecordFileHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+};
+static_assert(sizeof(RecordFileHeader) == 16, "RecordFileHeader");
+
+struct RecordHeader
+{
+  // nanoseconds since the recording started
+  int64_t time;
+  uint32_t size;
+  uint32_t reserved;
+};
+static_assert(sizeof(RecordHeader) == 16, "RecordHeader");
+
+struct RecordIndex
+{
+  int64_t time;
+  // of the RecordHeader
+  uint64_t offset;
+};
+static_assert(sizeof(RecordIndex) == 16, "RecordIndex");
+
+struct RecordFooter
+{
+  uint64_t indexOffset;
+  uint64_t count;
+  char magic[8];
+};
+static_assert(sizeof(RecordFooter) == 24, "RecordFooter");
+
+// Write() is called from the thread that receives the packets. writes are
+// buffered by the stream. Count() and Bytes() may be read from any thread
+class PacketRecorder
+{
+  std::ofstream m_os;
+  std::chrono::steady_clock::time_point m_start;
+  uint64_t m_offset = 0;
+  std::vector<RecordIndex> m_index;
+  // false when the index is full. the file is closed without the footer
+  bool m_indexed = true;
+  std::atomic<uint64_t> m_count{ 0 };
+  std::atomic<uint64_t> m_bytes{ 0 };
+
+public:
+  // 16MB. about 2 minutes of 64 skeletons at 120Hz
+  static constexpr size_t IndexCapacity = 1 << 20;
+
+  PacketRecorder() {}
+  ~PacketRecorder() { Close(); }
+  PacketRecorder(const PacketRecorder&) = delete;
+  PacketRecorder& operator=(const PacketRecorder&) = delete;
+
+  bool Open(const std::filesystem::path& path);
+  // write the index and the footer. a full index is left to the scan
+  void Close();
+  bool IsOpen() const { return m_os.is_open(); }
+  uint64_t Count() const { return m_count.load(std::memory_order_relaxed); }
+  uint64_t Bytes() const { return m_bytes.load(std::memory_order_relaxed); }
+
+  void Write(std::chrono::steady_clock::time_point received,
+             std::span<const uint8_t> packet);
+};
+
+struct RecordedPacket
+{
+  std::chrono::nanoseconds Time;
+  std::span<const uint8_t> Data;
+};
+
+// memory mapped. packets are not copied
+class PacketReplay
+{
+  MappedFile m_file;
+  std::vector<RecordIndex> m_index;
+
+  bool ReadIndex(std::span<const uint8_t> bytes);
+
+public:
+  bool Open(const std::filesystem::path& path);
+  size_t Size() const { return m_index.size(); }
+  std::chrono::nanoseconds Duration() const
+  {
+    return std::chrono::nanoseconds(m_index.empty() ? 0
+                                                    : m_index.back().time);
+  }
+  // empty Data if the record is broken
+  RecordedPacket Packet(size_t i) const;
+  // the first packet at or after the time
+  size_t Seek(std::chrono::nanoseconds time) const;
+};
+
+} // namespace
+} // namespace
@@ -4,114 +4,197 @@
 #include "../gltfroot.h"
 #include <DirectXMath.h>
 #include <chrono>
-#include <iostream>
 
 namespace libvrm {
 namespace srht {
 
-struct Payload
+static void
+SetMagic(Packet* packet, std::string_view magic)
 {
-  std::vector<uint8_t> buffer;
-
-  Payload(const Payload&) = delete;
-  Payload& operator=(const Payload&) = delete;
-
-  Payload() { std::cout << "Payload::Payload" << std::endl; }
+  assert(magic.size() == 8);
+  std::copy(magic.begin(), magic.end(), packet->Header.begin());
+  packet->HeaderSize = magic.size();
+}
 
-  ~Payload() { std::cout << "Payload::~Payload" << std::endl; }
-  void Push(const void* begin, const void* end)
-  {
-    auto dst = buffer.size();
-    auto size = std::distance((const char*)begin, (const char*)end);
-    buffer.resize(dst + size);
-    std::copy((const char*)begin, (const char*)end, buffer.data() + dst);
-  }
+template<typename T>
+static void
+PushHeader(Packet* packet, const T& header)
+{
+  static_assert(8 + sizeof(T) <= sizeof(packet->Header));
+  std::memcpy(packet->Header.data() + packet->HeaderSize, &header, sizeof(T));
+  packet->HeaderSize += sizeof(T);
+}
 
-  template<typename T>
-  void Push(const T& t)
-  {
-    Push((const char*)&t, (const char*)&t + sizeof(T));
-  }
+void
+Packet::SetSkeleton(uint16_t skeletonId,
+                    std::span<const JointDefinition> joints,
+                    std::span<const DirectX::XMFLOAT4> rotations)
+{
+  SetMagic(this, SRHT_SKELETON_MAGIC1);
 
-  void SetMagic(std::vector<uint8_t>& buffer, std::string_view magic)
-  {
-    assert(magic.size() == 8);
-    buffer.assign(magic.data(), magic.data() + magic.size());
+  auto flags = SkeletonFlags::NONE;
+  if (rotations.size()) {
+    flags = flags | SkeletonFlags::HAS_INITIAL_ROTATION;
   }
 
-  void SetSkeleton(std::span<const JointDefinition> joints,
-                   std::span<const DirectX::XMFLOAT4> rotations)
-  {
-    SetMagic(buffer, SRHT_SKELETON_MAGIC1);
-
-    auto flags = SkeletonFlags::NONE;
-    if (rotations.size()) {
-      flags = flags | SkeletonFlags::HAS_INITIAL_ROTATION;
-    }
-
-    SkeletonHeader header{
-      .skeletonId = 0,
-      .jointCount = static_cast<uint16_t>(joints.size()),
-      .flags = flags,
-    };
-    Push((const char*)&header, (const char*)&header + sizeof(header));
-    Push(joints.data(), joints.data() + joints.size());
-    if ((flags & SkeletonFlags::HAS_INITIAL_ROTATION) != SkeletonFlags::NONE) {
-      Push(rotations.data(), rotations.data() + rotations.size());
-    }
+  SkeletonHeader header{
+    .skeletonId = skeletonId,
+    .jointCount = static_cast<uint16_t>(joints.size()),
+    .flags = flags,
+  };
+  PushHeader(this, header);
+  Push(joints.data(), joints.size_bytes());
+  if ((flags & SkeletonFlags::HAS_INITIAL_ROTATION) != SkeletonFlags::NONE) {
+    Push(rotations.data(), rotations.size_bytes());
   }
+}
 
-  void SetFrame(std::chrono::nanoseconds time,
-                float x,
-                float y,
-                float z,
-                bool usePack)
-  {
-    SetMagic(buffer, SRHT_FRAME_MAGIC1);
-
-    FrameHeader header{
-      .time = time.count(),
-      .flags = usePack ? FrameFlags::USE_QUAT32 : FrameFlags::NONE,
-      .skeletonId = 0,
-      .x = x,
-      .y = y,
-      .z = z,
-    };
-    Push((const char*)&header, (const char*)&header + sizeof(header));
-  }
-};
+void
+Packet::SetFrame(uint16_t skeletonId,
+                 std::chrono::nanoseconds time,
+                 float x,
+                 float y,
+                 float z,
+                 FrameFlags flags)
+{
+  SetMagic(this, SRHT_FRAME_MAGIC1);
+
+  FrameHeader header{
+    .time = time.count(),
+    .flags = flags,
+    .skeletonId = skeletonId,
+    .x = x,
+    .y = y,
+    .z = z,
+  };
+  PushHeader(this, header);
+}
 
 UdpSender::UdpSender(asio::io_context& io)
   : socket_(io, asio::ip::udp::endpoint(asio::ip::udp::v4(), 0))
+  , m_packets(BatchCapacity)
 {
+  for (auto& packet : m_packets) {
+    packet.Body.reserve(BodyCapacity);
+  }
+#if defined(__linux__)
+  m_messages.resize(BatchCapacity);
+  m_iovecs.resize(BatchCapacity * 2);
+#endif
   m_start = std::chrono::steady_clock::now();
 }
 
-std::shared_ptr<Payload>
-UdpSender::GetOrCreatePayload()
+void
+UdpSender::BeginBatch()
+{
+  m_batch = true;
+}
+
+void
+UdpSender::EndBatch()
 {
-  std::lock_guard<std::mutex> lock(mutex_);
-  if (payloads_.empty()) {
-    return std::make_shared<Payload>();
-  } else {
-    auto payload = payloads_.front();
-    payloads_.pop_front();
-    return payload;
+  m_batch = false;
+  Flush();
+}
+
+Packet&
+UdpSender::NextPacket(const asio::ip::udp::endpoint& ep)
+{
+  if (m_queued == m_packets.size()) {
+    Flush();
   }
+  auto& packet = m_packets[m_queued++];
+  packet.Endpoint = ep;
+  packet.HeaderSize = 0;
+  packet.Body.clear();
+  return packet;
 }
 
 void
-UdpSender::ReleasePayload(const std::shared_ptr<Payload>& payload)
+UdpSender::Commit()
 {
-  std::lock_guard<std::mutex> lock(mutex_);
-  payloads_.push_back(payload);
+  if (!m_batch) {
+    Flush();
+  }
+}
+
+void
+UdpSender::Flush()
+{
+  if (m_queued == 0) {
+    return;
+  }
+
+  if (m_shm) {
+    for (size_t i = 0; i < m_queued; ++i) {
+      auto& packet = m_packets[i];
+      if (m_shm->Send({ packet.Header.data(), packet.HeaderSize },
+                      packet.Body)) {
+        ++m_stats.Packets;
+        m_stats.Bytes += packet.Size();
+      } else {
+        ++m_stats.Errors;
+      }
+    }
+    m_queued = 0;
+    return;
+  }
+
+#if defined(__linux__)
+  for (size_t i = 0; i < m_queued; ++i) {
+    auto& packet = m_packets[i];
+    auto iov = &m_iovecs[i * 2];
+    iov[0] = { packet.Header.data(), packet.HeaderSize };
+    iov[1] = { packet.Body.data(), packet.Body.size() };
+    auto& message = m_messages[i];
+    message = {};
+    message.msg_hdr.msg_name = packet.Endpoint.data();
+    message.msg_hdr.msg_namelen =
+      static_cast<socklen_t>(packet.Endpoint.size());
+    message.msg_hdr.msg_iov = iov;
+    message.msg_hdr.msg_iovlen = 2;
+  }
+  size_t sent = 0;
+  while (sent < m_queued) {
+    auto n = ::sendmmsg(socket_.native_handle(),
+                        m_messages.data() + sent,
+                        static_cast<unsigned int>(m_queued - sent),
+                        0);
+    ++m_stats.Syscalls;
+    if (n <= 0) {
+      // the first message failed. the rest of the batch is still sent
+      ++m_stats.Errors;
+      ++sent;
+      continue;
+    }
+    for (int i = 0; i < n; ++i) {
+      m_stats.Bytes += m_messages[sent + i].msg_len;
+    }
+    m_stats.Packets += n;
+    sent += n;
+  }
+#else
+  for (size_t i = 0; i < m_queued; ++i) {
+    auto& packet = m_packets[i];
+    std::error_code ec;
+    auto size = socket_.send_to(packet.Buffers(), packet.Endpoint, 0, ec);
+    ++m_stats.Syscalls;
+    if (ec) {
+      ++m_stats.Errors;
+    } else {
+      ++m_stats.Packets;
+      m_stats.Bytes += size;
+    }
+  }
+#endif
+  m_queued = 0;
 }
 
 void
 UdpSender::SendBvhSkeleton(asio::ip::udp::endpoint ep,
-                           const std::shared_ptr<libvrm::bvh::Bvh>& bvh)
+                           const std::shared_ptr<libvrm::bvh::Bvh>& bvh,
+                           uint16_t skeletonId)
 {
-  auto payload = GetOrCreatePayload();
   m_joints.clear();
   m_rotations.clear();
   auto scaling = bvh->GuessScaling();
@@ -124,14 +207,9 @@ UdpSender::SendBvhSkeleton(asio::ip::udp::endpoint ep,
       .zFromParent = joint.localOffset.z * scaling,
     });
   }
-  payload->SetSkeleton(m_joints, {});
-
-  socket_.async_send_to(
-    asio::buffer(payload->buffer),
-    ep,
-    [self = this, payload](asio::error_code ec, std::size_t bytes_transferred) {
-      self->ReleasePayload(payload);
-    });
+  NextPacket(ep).SetSkeleton(skeletonId, m_joints, {});
+  Commit();
+  ResetStream(skeletonId);
 }
 
 static DirectX::XMFLOAT4X4
@@ -160,44 +238,68 @@ ToQuat(const DirectX::XMFLOAT3X3& rot)
   return vec4;
 }
 
+// next frame is a keyframe
+void
+UdpSender::ResetStream(uint16_t skeletonId)
+{
+  if (skeletonId < m_streams.size()) {
+    m_streams[skeletonId].Sent.clear();
+  }
+}
+
+void
+UdpSender::EncodeFrame(const asio::ip::udp::endpoint& ep,
+                       uint16_t skeletonId,
+                       std::chrono::nanoseconds time,
+                       const DirectX::XMFLOAT3& root,
+                       const FrameEncoding& encoding)
+{
+  if (skeletonId >= m_streams.size()) {
+    m_streams.resize(skeletonId + 1);
+  }
+  auto& stream = m_streams[skeletonId];
+
+  auto& packet = NextPacket(ep);
+  auto encoded = m_encoder.Encode(stream, m_rotations, encoding, packet.Body);
+  packet.SetFrame(skeletonId, time, root.x, root.y, root.z, encoded.Flags);
+
+  stream.Stats.Push(std::chrono::steady_clock::now(),
+                    packet.Size(),
+                    encoded.Rotations,
+                    m_rotations.size(),
+                    (encoded.Flags & FrameFlags::DELTA) == FrameFlags::NONE);
+  Commit();
+}
+
 void
 UdpSender::SendBvhFrame(asio::ip::udp::endpoint ep,
                         const std::shared_ptr<libvrm::bvh::Bvh>& bvh,
                         const libvrm::bvh::Frame& frame,
-                        bool pack)
+                        const FrameEncoding& encoding,
+                        uint16_t skeletonId)
 {
-  auto payload = GetOrCreatePayload();
-
+  m_rotations.clear();
+  DirectX::XMFLOAT3 root = { 0, 0, 0 };
   auto scaling = bvh->GuessScaling();
   for (auto& joint : bvh->joints) {
     auto transform = frame.Resolve(joint.channels);
     // auto rotation = ToQuat(rot);
 
     if (joint.index == 0) {
-      payload->SetFrame(
-        std::chrono::duration_cast<std::chrono::nanoseconds>(frame.time),
+      root = {
         transform.Translation.x * scaling,
         transform.Translation.y * scaling,
         transform.Translation.z * scaling,
-        pack);
-    }
-    if (pack) {
-      auto packed = libvrm::quat_packer::Pack(transform.Rotation.x,
-                                              transform.Rotation.y,
-                                              transform.Rotation.z,
-                                              transform.Rotation.w);
-      payload->Push(packed);
-    } else {
-      payload->Push(transform.Rotation);
+      };
     }
+    m_rotations.push_back(transform.Rotation);
   }
 
-  socket_.async_send_to(
-    asio::buffer(payload->buffer),
-    ep,
-    [self = this, payload](asio::error_code ec, std::size_t bytes_transferred) {
-      self->ReleasePayload(payload);
-    });
+  EncodeFrame(ep,
+              skeletonId,
+              std::chrono::duration_cast<std::chrono::nanoseconds>(frame.time),
+              root,
+              encoding);
 }
 
 static bool
@@ -249,7 +351,6 @@ UdpSender::SendSkeleton(asio::ip::udp::endpoint ep,
                         uint32_t id,
                         const std::shared_ptr<GltfRoot>& scene)
 {
-  auto payload = GetOrCreatePayload();
   m_joints.clear();
   m_rotations.clear();
 
@@ -269,33 +370,18 @@ UdpSender::SendSkeleton(asio::ip::udp::endpoint ep,
   if (hasRotation) {
     rotations = m_rotations;
   }
-  payload->SetSkeleton(m_joints, rotations);
-
-  socket_.async_send_to(
-    asio::buffer(payload->buffer),
-    ep,
-    [self = this, payload](asio::error_code ec, std::size_t bytes_transferred) {
-      self->ReleasePayload(payload);
-    });
+  NextPacket(ep).SetSkeleton(static_cast<uint16_t>(id), m_joints, rotations);
+  Commit();
+  ResetStream(static_cast<uint16_t>(id));
 }
 
 static void
-PushJoints(std::shared_ptr<Payload>& payload,
-           const std::shared_ptr<Node>& node,
-           bool pack)
+PushRotations(std::vector<DirectX::XMFLOAT4>& rotations,
+              const std::shared_ptr<Node>& node)
 {
-  if (pack) {
-    auto packed = libvrm::quat_packer::Pack(node->InitialTransform.Rotation.x,
-                                            node->InitialTransform.Rotation.y,
-                                            node->InitialTransform.Rotation.z,
-                                            node->InitialTransform.Rotation.w);
-    payload->Push(packed);
-  } else {
-    payload->Push(node->InitialTransform.Rotation);
-  }
-
+  rotations.push_back(node->InitialTransform.Rotation);
   for (auto& child : node->Children) {
-    PushJoints(payload, child, pack);
+    PushRotations(rotations, child);
   }
 }
 
@@ -303,26 +389,41 @@ void
 UdpSender::SendFrame(asio::ip::udp::endpoint ep,
                      uint32_t id,
                      const std::shared_ptr<GltfRoot>& scene,
-                     bool pack)
+                     const FrameEncoding& encoding)
 {
-  auto payload = GetOrCreatePayload();
-
   // root
   auto root = scene->m_roots[0];
-  // payload->SetFrame(std::chrono::steady_clock::now() - m_start,
-  //                   root->Transform.Translation.x,
-  //                   root->Transform.Translation.y,
-  //                   root->Transform.Translation.z,
-  //                   pack);
-
-  PushJoints(payload, root, pack);
-
-  socket_.async_send_to(
-    asio::buffer(payload->buffer),
-    ep,
-    [self = this, payload](asio::error_code ec, std::size_t bytes_transferred) {
-      self->ReleasePayload(payload);
-    });
+  m_rotations.clear();
+  PushRotations(m_rotations, root);
+
+  EncodeFrame(ep,
+              static_cast<uint16_t>(id),
+              std::chrono::steady_clock::now() - m_start,
+              root->InitialTransform.Translation,
+              encoding);
+}
+
+void
+UdpSender::SendSkeleton(asio::ip::udp::endpoint ep,
+                        uint16_t skeletonId,
+                        std::span<const JointDefinition> joints,
+                        std::span<const DirectX::XMFLOAT4> rotations)
+{
+  NextPacket(ep).SetSkeleton(skeletonId, joints, rotations);
+  Commit();
+  ResetStream(skeletonId);
+}
+
+void
+UdpSender::SendFrame(asio::ip::udp::endpoint ep,
+                     uint16_t skeletonId,
+                     std::chrono::nanoseconds time,
+                     const DirectX::XMFLOAT3& root,
+                     std::span<const DirectX::XMFLOAT4> rotations,
+                     const FrameEncoding& encoding)
+{
+  m_rotations.assign(rotations.begin(), rotations.end());
+  EncodeFrame(ep, skeletonId, time, root, encoding);
 }
 
 }
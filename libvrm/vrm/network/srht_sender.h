@@ -1,10 +1,12 @@
 #pragma once
 #include "../bvh/bvh.h"
 #include "srht.h"
+#include "srht_shm.h"
+#include "srht_update.h"
+#include <array>
 #include <chrono>
-#include <list>
+#include <cstring>
 #include <memory>
-#include <mutex>
 #include <span>
 #include <vector>
 
@@ -12,6 +14,9 @@
 #define _WIN32_WINNT 0x0601
 #endif
 #include <asio.hpp>
+#if defined(__linux__)
+#include <sys/socket.h>
+#endif
 
 namespace libvrm {
 
@@ -19,35 +24,133 @@ struct Node;
 struct GltfRoot;
 
 namespace srht {
-struct Payload;
+
+// one datagram. magic + header and the body are gathered on send.
+// the body keeps its capacity, so no allocation after the first use
+struct Packet
+{
+  asio::ip::udp::endpoint Endpoint;
+  std::array<uint8_t, 8 + sizeof(FrameHeader)> Header;
+  size_t HeaderSize = 0;
+  std::vector<uint8_t> Body;
+
+  void SetSkeleton(uint16_t skeletonId,
+                   std::span<const JointDefinition> joints,
+                   std::span<const DirectX::XMFLOAT4> rotations);
+  void SetFrame(uint16_t skeletonId,
+                std::chrono::nanoseconds time,
+                float x,
+                float y,
+                float z,
+                FrameFlags flags);
+
+  void Push(const void* src, size_t size)
+  {
+    auto dst = Body.size();
+    Body.resize(dst + size);
+    std::memcpy(Body.data() + dst, src, size);
+  }
+  template<typename T>
+  void Push(const T& t)
+  {
+    Push(&t, sizeof(T));
+  }
+
+  size_t Size() const { return HeaderSize + Body.size(); }
+  std::array<asio::const_buffer, 2> Buffers() const
+  {
+    return {
+      asio::buffer(Header.data(), HeaderSize),
+      asio::buffer(Body),
+    };
+  }
+};
+
+// send synchronously from the calling thread. not thread safe.
+// between BeginBatch and EndBatch packets are queued and sent together.
+// sendmmsg on linux
 class UdpSender
 {
   asio::ip::udp::socket socket_;
-  std::list<std::shared_ptr<Payload>> payloads_;
-  std::mutex mutex_;
+  // preallocated. the first m_queued are waiting for Flush
+  std::vector<Packet> m_packets;
+  size_t m_queued = 0;
+  bool m_batch = false;
+#if defined(__linux__)
+  std::vector<mmsghdr> m_messages;
+  std::vector<iovec> m_iovecs;
+#endif
+  SenderStats m_stats;
+  // replaces the socket if set
+  std::shared_ptr<ShmSender> m_shm;
+  // skeletonId => stream
+  std::vector<SenderStream> m_streams;
+
   std::vector<JointDefinition> m_joints;
   std::vector<DirectX::XMFLOAT4> m_rotations;
+  FrameEncoder m_encoder;
   std::chrono::steady_clock::time_point m_start;
 
 public:
+  static constexpr size_t BatchCapacity = 128;
+  // body bytes reserved per packet
+  static constexpr size_t BodyCapacity = 256 * 2 * sizeof(DirectX::XMFLOAT4);
+
   UdpSender(asio::io_context& io);
-  std::shared_ptr<Payload> GetOrCreatePayload();
-  void ReleasePayload(const std::shared_ptr<Payload>& payload);
+
+  void BeginBatch();
+  void EndBatch();
+  const SenderStats& Stats() const { return m_stats; }
+  // write the packets to the shared memory instead of the socket.
+  // the endpoints are ignored. nullptr to send again
+  void SetSharedMemory(const std::shared_ptr<ShmSender>& shm) { m_shm = shm; }
+  const StreamStats* Stats(uint16_t skeletonId) const
+  {
+    return skeletonId < m_streams.size() ? &m_streams[skeletonId].Stats
+                                         : nullptr;
+  }
 
   void SendBvhSkeleton(asio::ip::udp::endpoint ep,
-                       const std::shared_ptr<bvh::Bvh>& bvh);
+                       const std::shared_ptr<bvh::Bvh>& bvh,
+                       uint16_t skeletonId = 0);
   void SendBvhFrame(asio::ip::udp::endpoint ep,
                     const std::shared_ptr<bvh::Bvh>& bvh,
                     const bvh::Frame& frame,
-                    bool pack = true);
+                    const FrameEncoding& encoding = {},
+                    uint16_t skeletonId = 0);
 
   void SendSkeleton(asio::ip::udp::endpoint ep,
                     uint32_t id,
                     const std::shared_ptr<GltfRoot>& scene);
+  // joints in order. rotations are optional
+  void SendSkeleton(asio::ip::udp::endpoint ep,
+                    uint16_t skeletonId,
+                    std::span<const JointDefinition> joints,
+                    std::span<const DirectX::XMFLOAT4> rotations = {});
   void SendFrame(asio::ip::udp::endpoint ep,
                  uint32_t id,
                  const std::shared_ptr<GltfRoot>& scene,
-                 bool pack = true);
+                 const FrameEncoding& encoding = {});
+  // time is written as is
+  void SendFrame(asio::ip::udp::endpoint ep,
+                 uint16_t skeletonId,
+                 std::chrono::nanoseconds time,
+                 const DirectX::XMFLOAT3& root,
+                 std::span<const DirectX::XMFLOAT4> rotations,
+                 const FrameEncoding& encoding = {});
+
+private:
+  Packet& NextPacket(const asio::ip::udp::endpoint& ep);
+  // send now unless batching
+  void Commit();
+  void ResetStream(uint16_t skeletonId);
+  // m_rotations => packet
+  void EncodeFrame(const asio::ip::udp::endpoint& ep,
+                   uint16_t skeletonId,
+                   std::chrono::nanoseconds time,
+                   const DirectX::XMFLOAT3& root,
+                   const FrameEncoding& encoding);
+  void Flush();
 };
 
 } // namespace
@@ -0,0 +1,438 @@
+#include "srht_shm.h"
+#include "srht_dispatcher.h"
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <thread>
+
+namespace libvrm {
+namespace srht {
+
+// the slots start at a cache line
+constexpr size_t SHM_HEADER_SIZE = 64;
+static_assert(sizeof(ShmHeader) <= SHM_HEADER_SIZE, "ShmHeader");
+
+static size_t
+SegmentSize(uint32_t slotSize, uint32_t skeletonSlots, uint32_t frameSlots)
+{
+  return SHM_HEADER_SIZE + (size_t)slotSize * (skeletonSlots + frameSlots);
+}
+
+// skeleton slots, then frame slots
+static uint8_t*
+SlotAt(uint8_t* base, uint32_t slotSize, size_t i)
+{
+  return base + SHM_HEADER_SIZE + (size_t)slotSize * i;
+}
+
+static bool
+IsValid(const ShmHeader* header, size_t size)
+{
+  return size >= SHM_HEADER_SIZE &&
+         std::string_view(header->magic, 8) == SRHT_SHM_MAGIC1 &&
+         header->version == 1 && header->slotSize > sizeof(ShmSlot) &&
+         header->slotSize % alignof(ShmSlot) == 0 && header->frameSlots > 0 &&
+         SegmentSize(header->slotSize,
+                     header->skeletonSlots,
+                     header->frameSlots) <= size;
+}
+
+//
+// ShmSender
+//
+bool
+ShmSender::Create(std::string_view name)
+{
+  Close();
+  if (!m_memory.Create(name,
+                       SegmentSize(SlotSize, SkeletonSlots, FrameSlots))) {
+    return false;
+  }
+  auto base = m_memory.Bytes().data();
+
+  // readers of the previous writer restart on the new session
+  uint64_t session = 1;
+  auto previous = (ShmHeader*)base;
+  if (std::string_view(previous->magic, 8) == SRHT_SHM_MAGIC1) {
+    session = previous->session.load(std::memory_order_relaxed) + 1;
+  }
+
+  // the session is stored last
+  m_header = new (base) ShmHeader;
+  std::memcpy(m_header->magic, SRHT_SHM_MAGIC1, 8);
+  m_header->version = 1;
+  m_header->slotSize = SlotSize;
+  m_header->skeletonSlots = SkeletonSlots;
+  m_header->frameSlots = FrameSlots;
+  m_header->skeletonUpdates.store(0, std::memory_order_relaxed);
+  m_header->written.store(0, std::memory_order_relaxed);
+  for (size_t i = 0; i < SkeletonSlots + FrameSlots; ++i) {
+    auto slot = new (SlotAt(base, SlotSize, i)) ShmSlot;
+    slot->sequence.store(0, std::memory_order_relaxed);
+  }
+  m_header->session.store(session, std::memory_order_release);
+
+  m_written = 0;
+  m_skeletonIds.clear();
+  m_skeletonIds.reserve(SkeletonSlots);
+  m_stats = {};
+  return true;
+}
+
+void
+ShmSender::Close()
+{
+  if (m_header) {
+    // readers that are attached open the segment again
+    m_header->session.store(0, std::memory_order_release);
+    SharedMemory::Remove(m_memory.Name());
+  }
+  m_memory.Close();
+  m_header = nullptr;
+}
+
+// seqlock. odd while written
+static void
+WriteSlot(uint8_t* p,
+          uint64_t sequence,
+          std::span<const uint8_t> head,
+          std::span<const uint8_t> body)
+{
+  auto slot = (ShmSlot*)p;
+  slot->sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot->size = static_cast<uint32_t>(head.size() + body.size());
+  auto dst = p + sizeof(ShmSlot);
+  std::memcpy(dst, head.data(), head.size());
+  if (!body.empty()) {
+    std::memcpy(dst + head.size(), body.data(), body.size());
+  }
+  slot->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+bool
+ShmSender::Send(std::span<const uint8_t> head, std::span<const uint8_t> body)
+{
+  if (!m_header) {
+    return false;
+  }
+  auto size = head.size() + body.size();
+  auto id = PeekSkeletonId(head);
+  if (!id || size > SlotSize - sizeof(ShmSlot)) {
+    ++m_stats.Errors;
+    return false;
+  }
+
+  auto base = m_memory.Bytes().data();
+  if (std::string_view((const char*)head.data(), 8) == SRHT_SKELETON_MAGIC1) {
+    // overwrite the last skeleton of the id
+    auto found = std::find(m_skeletonIds.begin(), m_skeletonIds.end(), *id);
+    if (found == m_skeletonIds.end()) {
+      if (m_skeletonIds.size() == SkeletonSlots) {
+        ++m_stats.Errors;
+        return false;
+      }
+      found = m_skeletonIds.insert(found, *id);
+    }
+    auto p = SlotAt(base, SlotSize, found - m_skeletonIds.begin());
+    WriteSlot(p,
+              ((ShmSlot*)p)->sequence.load(std::memory_order_relaxed),
+              head,
+              body);
+    m_header->skeletonUpdates.fetch_add(1, std::memory_order_release);
+  } else {
+    auto n = m_written++;
+    WriteSlot(SlotAt(base, SlotSize, SkeletonSlots + n % FrameSlots),
+              n * 2,
+              head,
+              body);
+    m_header->written.store(m_written, std::memory_order_release);
+  }
+
+  ++m_stats.Packets;
+  m_stats.Bytes += size;
+  return true;
+}
+
+//
+// ShmReceiver
+//
+struct ShmReceiverImpl
+{
+  // no wakeup across processes. sleep while the ring is empty
+  static constexpr auto PollInterval = std::chrono::microseconds(100);
+  // while the writer is closed
+  static constexpr auto OpenInterval = std::chrono::milliseconds(100);
+
+  SharedMemory m_memory;
+  std::string m_name;
+  std::thread m_thread;
+  std::atomic<bool> m_stop{ false };
+  PacketDispatcher m_dispatcher;
+
+  // handed to the reader thread
+  std::mutex m_recorderMutex;
+  std::shared_ptr<PacketRecorder> m_nextRecorder;
+  std::atomic<bool> m_recorderChanged{ false };
+
+  // reader thread
+  uint64_t m_session = 0;
+  uint64_t m_read = 0;
+  uint64_t m_skeletonUpdates = 0;
+  bool m_rescan = false;
+  std::chrono::steady_clock::time_point m_nextOpen;
+  std::vector<uint64_t> m_skeletonSequences;
+  // a slot is copied once, then decoded
+  std::vector<uint8_t> m_buffer;
+  size_t m_size = 0;
+
+  ~ShmReceiverImpl() { Stop(); }
+
+  const ShmHeader* Header() const
+  {
+    return (const ShmHeader*)m_memory.Bytes().data();
+  }
+
+  // map the segment of m_name
+  bool Open()
+  {
+    if (!m_memory.Open(m_name)) {
+      return false;
+    }
+    auto header = Header();
+    if (!IsValid(header, m_memory.Bytes().size()) ||
+        header->session.load(std::memory_order_acquire) == 0) {
+      // closed by the writer
+      m_memory.Close();
+      return false;
+    }
+    m_buffer.resize(header->slotSize - sizeof(ShmSlot));
+    m_skeletonSequences.assign(header->skeletonSlots, 0);
+    // join the live stream. the skeletons are read on the first poll
+    m_session = header->session.load(std::memory_order_acquire);
+    m_read = header->written.load(std::memory_order_acquire);
+    m_rescan = true;
+    return true;
+  }
+
+  bool Start(std::string_view name)
+  {
+    Stop();
+    m_name = name;
+    if (!Open()) {
+      return false;
+    }
+
+    m_stop = false;
+    m_thread = std::thread([self = this]() {
+      while (!self->m_stop.load(std::memory_order_relaxed)) {
+        if (!self->Poll()) {
+          std::this_thread::sleep_for(PollInterval);
+        }
+      }
+    });
+    return true;
+  }
+
+  void Stop()
+  {
+    if (!m_thread.joinable()) {
+      return;
+    }
+    m_stop = true;
+    m_thread.join();
+    m_memory.Close();
+  }
+
+  void SetRecorder(const std::shared_ptr<PacketRecorder>& recorder)
+  {
+    std::lock_guard<std::mutex> lock(m_recorderMutex);
+    m_nextRecorder = recorder;
+    m_recorderChanged.store(true, std::memory_order_release);
+  }
+
+  // seqlock. copy, then check that the writer did not touch the slot
+  bool Read(const uint8_t* p, uint64_t sequence)
+  {
+    auto slot = (const ShmSlot*)p;
+    if (slot->sequence.load(std::memory_order_acquire) != sequence) {
+      return false;
+    }
+    auto size = slot->size;
+    if (size > m_buffer.size()) {
+      return false;
+    }
+    std::memcpy(m_buffer.data(), p + sizeof(ShmSlot), size);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot->sequence.load(std::memory_order_relaxed) != sequence) {
+      return false;
+    }
+    m_size = size;
+    return true;
+  }
+
+  // true if any packet is dispatched
+  bool Poll()
+  {
+    if (m_recorderChanged.exchange(false, std::memory_order_acquire)) {
+      std::lock_guard<std::mutex> lock(m_recorderMutex);
+      m_dispatcher.SetRecorder(m_nextRecorder);
+      m_nextRecorder.reset();
+    }
+
+    if (!m_memory.Bytes().data()) {
+      // the writer is closed
+      auto now = std::chrono::steady_clock::now();
+      if (now < m_nextOpen) {
+        return false;
+      }
+      m_nextOpen = now + OpenInterval;
+      if (!Open()) {
+        return false;
+      }
+    }
+
+    auto header = Header();
+    auto session = header->session.load(std::memory_order_acquire);
+    if (session == 0) {
+      // the writer is closed. open the next segment of the name
+      m_memory.Close();
+      return false;
+    }
+    if (session != m_session) {
+      // the writer is created again
+      m_session = session;
+      m_read = 0;
+      std::fill(m_skeletonSequences.begin(), m_skeletonSequences.end(), 0);
+      m_rescan = true;
+    }
+    if (header->slotSize != m_buffer.size() + sizeof(ShmSlot) ||
+        header->skeletonSlots != m_skeletonSequences.size() ||
+        !IsValid(header, m_memory.Bytes().size())) {
+      // an other layout. open again
+      m_memory.Close();
+      return false;
+    }
+
+    auto base = m_memory.Bytes().data();
+    auto received = std::chrono::steady_clock::now();
+    bool dispatched = false;
+
+    auto updates = header->skeletonUpdates.load(std::memory_order_acquire);
+    if (m_rescan || updates != m_skeletonUpdates) {
+      m_rescan = false;
+      m_skeletonUpdates = updates;
+      for (size_t i = 0; i < m_skeletonSequences.size(); ++i) {
+        auto p = SlotAt(base, header->slotSize, i);
+        auto sequence =
+          ((const ShmSlot*)p)->sequence.load(std::memory_order_acquire);
+        if (sequence == m_skeletonSequences[i]) {
+          continue;
+        }
+        if ((sequence & 1) || !Read(p, sequence)) {
+          // being written. next poll
+          m_rescan = true;
+          continue;
+        }
+        m_skeletonSequences[i] = sequence;
+        m_dispatcher.Dispatch({ m_buffer.data(), m_size }, received);
+        dispatched = true;
+      }
+    }
+
+    auto written = header->written.load(std::memory_order_acquire);
+    if (written < m_read) {
+      // the writer is being created again
+      return dispatched;
+    }
+    if (written - m_read > header->frameSlots) {
+      m_dispatcher.CountLost(written - header->frameSlots - m_read);
+      m_read = written - header->frameSlots;
+    }
+    for (; m_read < written; ++m_read) {
+      auto p = SlotAt(
+        base, header->slotSize, header->skeletonSlots + m_read % header->frameSlots);
+      if (!Read(p, m_read * 2 + 2)) {
+        // overwritten while reading
+        m_dispatcher.CountLost(1);
+        continue;
+      }
+      m_dispatcher.Dispatch({ m_buffer.data(), m_size }, received);
+      dispatched = true;
+    }
+    return dispatched;
+  }
+};
+
+ShmReceiver::ShmReceiver()
+  : m_impl(new ShmReceiverImpl)
+{
+}
+
+ShmReceiver::~ShmReceiver()
+{
+  delete m_impl;
+}
+
+bool
+ShmReceiver::Start(std::string_view name)
+{
+  return m_impl->Start(name);
+}
+
+void
+ShmReceiver::Stop()
+{
+  m_impl->Stop();
+}
+
+bool
+ShmReceiver::IsRunning() const
+{
+  return m_impl->m_thread.joinable();
+}
+
+const std::string&
+ShmReceiver::Name() const
+{
+  return m_impl->m_name;
+}
+
+size_t
+ShmReceiver::StreamCount() const
+{
+  return m_impl->m_dispatcher.StreamCount();
+}
+
+ReceiverStream*
+ShmReceiver::Stream(size_t i) const
+{
+  return m_impl->m_dispatcher.Stream(i);
+}
+
+ReceiverStream*
+ShmReceiver::FindStream(uint16_t skeletonId) const
+{
+  return m_impl->m_dispatcher.FindStream(skeletonId);
+}
+
+void
+ShmReceiver::SetRecorder(const std::shared_ptr<PacketRecorder>& recorder)
+{
+  if (IsRunning()) {
+    // the recorder is used on the reader thread
+    m_impl->SetRecorder(recorder);
+  } else {
+    m_impl->m_dispatcher.SetRecorder(recorder);
+  }
+}
+
+ReceiverStats
+ShmReceiver::Stats() const
+{
+  return m_impl->m_dispatcher.Stats();
+}
+
+} // namespace
+} // namespace
@@ -0,0 +1,117 @@
+#pragma once
+#include "../shared_memory.h"
+#include "srht_receiver.h"
+#include <atomic>
+#include <span>
+#include <stdint.h>
+#include <string_view>
+#include <vector>
+
+namespace libvrm {
+namespace srht {
+
+// SRHT packets through shared memory, for a producer on the same host.
+//
+// [ShmHeader]
+// [ShmSlot + SRHTSKL1] x SkeletonSlots   latest skeleton per skeletonId
+// [ShmSlot + SRHTFRM1] x FrameSlots      ring of frames
+//
+// one writer. each slot is a seqlock: the sequence is odd while written.
+// readers never write, so any number of them can follow the ring.
+constexpr const char* SRHT_SHM_MAGIC1 = "SRHTSHM1";
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "atomic in shared memory");
+
+struct ShmHeader
+{
+  char magic[8];
+  uint32_t version;
+  // including ShmSlot
+  uint32_t slotSize;
+  uint32_t skeletonSlots;
+  uint32_t frameSlots;
+  // changed when the writer creates the segment again. readers restart.
+  // 0 after the writer is closed. readers open the segment again
+  std::atomic<uint64_t> session;
+  // skeleton slots written
+  std::atomic<uint64_t> skeletonUpdates;
+  // frames written. frame n is in the slot n % frameSlots
+  std::atomic<uint64_t> written;
+};
+
+struct ShmSlot
+{
+  // frame n is complete when 2n + 2
+  std::atomic<uint64_t> sequence;
+  uint32_t size;
+  uint32_t reserved;
+};
+static_assert(sizeof(ShmSlot) == 16, "ShmSlot");
+
+// not thread safe
+class ShmSender
+{
+  SharedMemory m_memory;
+  ShmHeader* m_header = nullptr;
+  uint64_t m_written = 0;
+  // skeleton slot => skeletonId
+  std::vector<uint16_t> m_skeletonIds;
+  SenderStats m_stats;
+
+public:
+  // a frame of 256 joints in float4
+  static constexpr uint32_t SlotSize = 8192;
+  static constexpr uint32_t SkeletonSlots = Receiver::MaxStreams;
+  // about 2 seconds of 120Hz
+  static constexpr uint32_t FrameSlots = 256;
+
+  ShmSender() {}
+  ~ShmSender() { Close(); }
+  ShmSender(const ShmSender&) = delete;
+  ShmSender& operator=(const ShmSender&) = delete;
+
+  // create or take over the segment. readers that are attached restart
+  bool Create(std::string_view name);
+  // remove the segment. attached readers open it again when the writer
+  // creates it again
+  void Close();
+  bool IsOpen() const { return m_header != nullptr; }
+  const SenderStats& Stats() const { return m_stats; }
+
+  // a SRHTSKL1 or SRHTFRM1 packet, gathered from head and body.
+  // false if the packet is broken or larger than a slot
+  bool Send(std::span<const uint8_t> head, std::span<const uint8_t> body = {});
+};
+
+// read the segment of a ShmSender on a polling thread.
+// the writer is never blocked. a reader that falls behind the ring skips to
+// the oldest frame that is still there and counts the rest as Lost.
+// after the writer is closed, the reader tries to open the segment again
+class ShmReceiver : public Receiver
+{
+  struct ShmReceiverImpl* m_impl = nullptr;
+
+public:
+  ShmReceiver();
+  ~ShmReceiver();
+  ShmReceiver(const ShmReceiver&) = delete;
+  ShmReceiver& operator=(const ShmReceiver&) = delete;
+
+  // false if the writer has not created the segment yet
+  bool Start(std::string_view name);
+  void Stop() override;
+  bool IsRunning() const override;
+  const std::string& Name() const;
+
+  size_t StreamCount() const override;
+  ReceiverStream* Stream(size_t i) const override;
+  ReceiverStream* FindStream(uint16_t skeletonId) const override;
+
+  void SetRecorder(const std::shared_ptr<PacketRecorder>& recorder) override;
+
+  ReceiverStats Stats() const override;
+};
+
+} // namespace
+} // namespace
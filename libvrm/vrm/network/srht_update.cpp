@@ -3,6 +3,10 @@
 #include "../node.h"
 #include "srht.h"
 #include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstring>
 
 struct BinaryReader
 {
@@ -13,6 +17,8 @@ struct BinaryReader
   {
   }
 
+  size_t Remain() const { return m_data.size() - m_pos; }
+
   std::span<const uint8_t> Bytes(size_t size)
   {
     auto data = m_data.data() + m_pos;
@@ -47,89 +53,258 @@ struct BinaryReader
 namespace libvrm {
 
 namespace srht {
-void
-UpdateScene(const std::shared_ptr<GltfRoot>& scene,
-            std::span<const uint8_t> data)
+
+static void
+Append(std::vector<uint8_t>& out, const void* src, size_t size)
 {
-  BinaryReader r(data);
+  auto dst = out.size();
+  out.resize(dst + size);
+  std::memcpy(out.data() + dst, src, size);
+}
 
-  auto magic = r.View(8);
-  if (magic == "SRHTSKL1") {
-    scene->Clear();
-
-    auto header = r.Get<SkeletonHeader>();
-    std::vector<JointDefinition> joints(header.jointCount);
-    r.CopyTo(std::span(joints));
-    std::vector<DirectX::XMFLOAT4> rotations(header.jointCount);
-    // initial rotations
-    if ((header.flags & SkeletonFlags::HAS_INITIAL_ROTATION) !=
-        SkeletonFlags::NONE) {
-      rotations.resize(header.jointCount);
-      r.CopyTo(std::span(rotations));
-    } else {
-      std::fill(
-        rotations.begin(), rotations.end(), DirectX::XMFLOAT4{ 0, 0, 0, 1 });
+static void
+AppendRotations(std::vector<uint8_t>& out,
+                std::span<const DirectX::XMFLOAT4> rotations,
+                RotationEncoding encoding)
+{
+  if (rotations.empty()) {
+    return;
+  }
+  switch (encoding) {
+    case RotationEncoding::Quat32: {
+      auto offset = out.size();
+      out.resize(offset + rotations.size() * sizeof(uint32_t));
+      quat_packer::PackBatch(
+        &rotations.data()->x, (uint32_t*)(out.data() + offset), rotations.size());
+      break;
     }
-
-    // create nodes
-    for (int i = 0; i < joints.size(); ++i) {
-      char buf[256];
-      snprintf(buf, sizeof(buf), "%d", i);
-      auto ptr = std::make_shared<Node>(buf);
-      auto& joint = joints[i];
-      ptr->InitialTransform.Translation.x = joint.xFromParent;
-      ptr->InitialTransform.Translation.y = joint.yFromParent;
-      ptr->InitialTransform.Translation.z = joint.zFromParent;
-      auto& rotation = rotations[i];
-      ptr->InitialTransform.Rotation = rotation;
-
-      if (auto vrm_bone = ToVrmBone((HumanoidBones)joint.boneType)) {
-        ptr->Humanoid = *vrm_bone;
+    case RotationEncoding::Quat48:
+      for (auto& q : rotations) {
+        std::array<uint16_t, 3> packed;
+        quat_packer::Pack48(q.x, q.y, q.z, q.w, packed.data());
+        Append(out, packed.data(), sizeof(packed));
       }
-      scene->m_nodes.push_back(ptr);
+      break;
+    default:
+      Append(out, rotations.data(), rotations.size_bytes());
+      break;
+  }
+}
+
+EncodedFrame
+FrameEncoder::Encode(SenderStream& stream,
+                     std::span<const DirectX::XMFLOAT4> rotations,
+                     const FrameEncoding& encoding,
+                     std::vector<uint8_t>& out)
+{
+  auto count = rotations.size();
+  auto keyframe = !encoding.Delta || stream.Sent.size() != count ||
+                  encoding.KeyframeInterval == 0 ||
+                  stream.FrameCount % encoding.KeyframeInterval == 0;
+  ++stream.FrameCount;
+
+  if (keyframe) {
+    stream.Sent.assign(rotations.begin(), rotations.end());
+    AppendRotations(out, rotations, encoding.Rotation);
+    return { encoding.Flags(true), count };
+  }
+
+  // angle(q0, q1) > threshold <=> |dot(q0, q1)| < cos(threshold / 2)
+  auto limit = std::cos(encoding.Threshold * 0.5f);
+  m_mask.assign((count + 31) / 32, 0);
+  m_changed.clear();
+  for (size_t i = 0; i < count; ++i) {
+    auto dot = DirectX::XMVectorGetX(
+      DirectX::XMVector4Dot(DirectX::XMLoadFloat4(&stream.Sent[i]),
+                            DirectX::XMLoadFloat4(&rotations[i])));
+    if (std::abs(dot) < limit) {
+      m_mask[i / 32] |= 1u << (i % 32);
+      stream.Sent[i] = rotations[i];
+      m_changed.push_back(rotations[i]);
     }
-    for (int i = 0; i < joints.size(); ++i) {
-      auto joint = joints[i];
-      auto ptr = scene->m_nodes[i];
-      if (joints[i].parentBoneIndex == USHRT_MAX) {
-        scene->m_roots.push_back(ptr);
-      } else {
-        auto parent = scene->m_nodes[joint.parentBoneIndex];
-        Node::AddChild(parent, ptr);
-      }
+  }
+  DeltaHeader delta{ static_cast<uint16_t>(count) };
+  Append(out, &delta, sizeof(delta));
+  Append(out, m_mask.data(), m_mask.size() * sizeof(uint32_t));
+  AppendRotations(out, m_changed, encoding.Rotation);
+  return { encoding.Flags(false), m_changed.size() };
+}
+
+std::optional<uint16_t>
+PeekSkeletonId(std::span<const uint8_t> data)
+{
+  BinaryReader r(data);
+  if (r.Remain() < 8) {
+    return {};
+  }
+  auto magic = r.View(8);
+  if (magic == SRHT_SKELETON_MAGIC1 && r.Remain() >= sizeof(SkeletonHeader)) {
+    return r.Get<SkeletonHeader>().skeletonId;
+  }
+  if (magic == SRHT_FRAME_MAGIC1 && r.Remain() >= sizeof(FrameHeader)) {
+    return r.Get<FrameHeader>().skeletonId;
+  }
+  return {};
+}
+
+bool
+DecodeSkeleton(std::span<const uint8_t> data, SkeletonData* out)
+{
+  BinaryReader r(data);
+  if (r.Remain() < 8 + sizeof(SkeletonHeader) ||
+      r.View(8) != SRHT_SKELETON_MAGIC1) {
+    return false;
+  }
+
+  auto header = r.Get<SkeletonHeader>();
+  auto hasRotation = (header.flags & SkeletonFlags::HAS_INITIAL_ROTATION) !=
+                     SkeletonFlags::NONE;
+  auto size = header.jointCount * sizeof(JointDefinition);
+  if (hasRotation) {
+    size += header.jointCount * sizeof(DirectX::XMFLOAT4);
+  }
+  if (r.Remain() < size) {
+    return false;
+  }
+
+  out->SkeletonId = header.skeletonId;
+  out->Joints.resize(header.jointCount);
+  r.CopyTo(std::span(out->Joints));
+  out->InitialRotations.resize(header.jointCount);
+  if (hasRotation) {
+    r.CopyTo(std::span(out->InitialRotations));
+  } else {
+    std::fill(out->InitialRotations.begin(),
+              out->InitialRotations.end(),
+              DirectX::XMFLOAT4{ 0, 0, 0, 1 });
+  }
+  return true;
+}
+
+static void
+ReadRotation(BinaryReader& r, FrameFlags flags, DirectX::XMFLOAT4* out)
+{
+  if ((flags & FrameFlags::USE_QUAT32) != FrameFlags::NONE) {
+    quat_packer::Unpack(r.Get<uint32_t>(), &out->x);
+  } else if ((flags & FrameFlags::USE_QUAT48) != FrameFlags::NONE) {
+    auto packed = r.Get<std::array<uint16_t, 3>>();
+    quat_packer::Unpack48(packed.data(), &out->x);
+  } else {
+    *out = r.Get<DirectX::XMFLOAT4>();
+  }
+}
+
+bool
+DecodeFrame(std::span<const uint8_t> data, FrameData* out)
+{
+  BinaryReader r(data);
+  if (r.Remain() < 8 + sizeof(FrameHeader) ||
+      r.View(8) != SRHT_FRAME_MAGIC1) {
+    return false;
+  }
+
+  auto header = r.Get<FrameHeader>();
+  size_t stride = sizeof(DirectX::XMFLOAT4);
+  if ((header.flags & FrameFlags::USE_QUAT32) != FrameFlags::NONE) {
+    stride = sizeof(PackQuat);
+  } else if ((header.flags & FrameFlags::USE_QUAT48) != FrameFlags::NONE) {
+    stride = sizeof(uint16_t) * 3;
+  }
+
+  if ((header.flags & FrameFlags::DELTA) != FrameFlags::NONE) {
+    if (r.Remain() < sizeof(DeltaHeader)) {
+      return false;
     }
-    scene->InitializeNodes();
-    // scene->RaiseSceneUpdated();
-  } else if (magic == "SRHTFRM1") {
-    if (scene->m_roots.size()) {
-      auto header = r.Get<FrameHeader>();
-      auto root = scene->m_roots[0];
-      auto humanoid = root->Humanoid;
-      if (!humanoid || *humanoid == HumanBones::hips) {
-        // only move non humanoid or hips
-        // root->Transform.Translation.x = header.x;
-        // root->Transform.Translation.y = header.y;
-        // root->Transform.Translation.z = header.z;
-      }
-      std::vector<DirectX::XMFLOAT4> rotations(scene->m_nodes.size());
-      if ((int)header.flags & (int)FrameFlags::USE_QUAT32) {
-        std::vector<uint32_t> packs(scene->m_nodes.size());
-        r.CopyTo(std::span(packs));
-        for (int i = 0; i < packs.size(); ++i) {
-          quat_packer::Unpack(packs[i], &rotations[i].x);
-        }
-      } else {
-        r.CopyTo(std::span(rotations));
-      }
-      for (int i = 0; i < rotations.size(); ++i) {
-        // scene->m_nodes[i]->Transform.Rotation = rotations[i];
+    auto delta = r.Get<DeltaHeader>();
+    if (delta.jointCount != out->Rotations.size()) {
+      // wait a keyframe
+      return false;
+    }
+    auto words = (delta.jointCount + 31) / 32;
+    if (r.Remain() < words * sizeof(uint32_t)) {
+      return false;
+    }
+    auto mask = r.Bytes(words * sizeof(uint32_t));
+    auto word = [mask](size_t i) {
+      uint32_t value;
+      std::memcpy(&value, mask.data() + i * sizeof(uint32_t), sizeof(value));
+      return value;
+    };
+    size_t changed = 0;
+    for (size_t i = 0; i < words; ++i) {
+      changed += std::popcount(word(i));
+    }
+    if (r.Remain() != changed * stride) {
+      return false;
+    }
+    for (size_t i = 0; i < delta.jointCount; ++i) {
+      if (word(i / 32) & (1u << (i % 32))) {
+        ReadRotation(r, header.flags, &out->Rotations[i]);
       }
-      // scene->m_roots[0]->CalcWorldMatrix(true);
-      // scene->RaiseSceneUpdated();
     }
+    out->Keyframe = false;
+    out->Changed = static_cast<uint16_t>(changed);
   } else {
-    assert(false);
+    // the joint count is implied by the packet size
+    if (r.Remain() % stride) {
+      return false;
+    }
+    out->Rotations.resize(r.Remain() / stride);
+    if ((header.flags & FrameFlags::USE_QUAT32) != FrameFlags::NONE &&
+        out->Rotations.size()) {
+      auto packed = r.Bytes(r.Remain());
+      quat_packer::UnpackBatch((const uint32_t*)packed.data(),
+                               &out->Rotations[0].x,
+                               out->Rotations.size());
+    } else {
+      for (auto& rotation : out->Rotations) {
+        ReadRotation(r, header.flags, &rotation);
+      }
+    }
+    out->Keyframe = true;
+    out->Changed = static_cast<uint16_t>(out->Rotations.size());
+  }
+
+  out->Time = std::chrono::nanoseconds(header.time);
+  out->SkeletonId = header.skeletonId;
+  out->RootPosition = { header.x, header.y, header.z };
+  return true;
+}
+
+void
+BuildScene(const std::shared_ptr<GltfRoot>& scene, const SkeletonData& skeleton)
+{
+  scene->Clear();
+
+  auto& joints = skeleton.Joints;
+  // create nodes
+  for (int i = 0; i < joints.size(); ++i) {
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%d", i);
+    auto ptr = std::make_shared<Node>(buf);
+    auto& joint = joints[i];
+    ptr->InitialTransform.Translation.x = joint.xFromParent;
+    ptr->InitialTransform.Translation.y = joint.yFromParent;
+    ptr->InitialTransform.Translation.z = joint.zFromParent;
+    ptr->InitialTransform.Rotation = skeleton.InitialRotations[i];
+
+    if (auto vrm_bone = ToVrmBone((HumanoidBones)joint.boneType)) {
+      ptr->Humanoid = *vrm_bone;
+    }
+    scene->m_nodes.push_back(ptr);
+  }
+  for (int i = 0; i < joints.size(); ++i) {
+    auto joint = joints[i];
+    auto ptr = scene->m_nodes[i];
+    if (joint.parentBoneIndex == USHRT_MAX ||
+        joint.parentBoneIndex >= scene->m_nodes.size()) {
+      scene->m_roots.push_back(ptr);
+    } else {
+      auto parent = scene->m_nodes[joint.parentBoneIndex];
+      Node::AddChild(parent, ptr);
+    }
   }
+  scene->InitializeNodes();
 }
 
 void
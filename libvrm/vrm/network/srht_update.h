@@ -1,16 +1,179 @@
 #pragma once
+#include "srht.h"
+#include <DirectXMath.h>
+#include <chrono>
 #include <memory>
+#include <optional>
 #include <span>
 #include <stdint.h>
+#include <vector>
 
 namespace libvrm {
 
 struct GltfRoot;
 
 namespace srht {
+
+// decoded SRHTSKL1
+struct SkeletonData
+{
+  uint16_t SkeletonId = 0;
+  std::vector<JointDefinition> Joints;
+  // identity if not sent
+  std::vector<DirectX::XMFLOAT4> InitialRotations;
+};
+
+// decoded SRHTFRM1
+struct FrameData
+{
+  // sender clock
+  std::chrono::nanoseconds Time = {};
+  uint16_t SkeletonId = 0;
+  DirectX::XMFLOAT3 RootPosition = { 0, 0, 0 };
+  // joint order
+  std::vector<DirectX::XMFLOAT4> Rotations;
+  // all joints are sent
+  bool Keyframe = false;
+  // number of rotations in the packet
+  uint16_t Changed = 0;
+};
+
+enum class RotationEncoding
+{
+  Float4,
+  Quat32,
+  Quat48,
+};
+
+struct FrameEncoding
+{
+  RotationEncoding Rotation = RotationEncoding::Quat32;
+  // send only the joints that moved beyond Threshold since the last sent value
+  bool Delta = false;
+  // radians
+  float Threshold = DirectX::XMConvertToRadians(0.5f);
+  // send all joints every N frames. a lost packet is recovered by this
+  uint32_t KeyframeInterval = 30;
+
+  FrameFlags Flags(bool keyframe) const
+  {
+    auto flags = FrameFlags::NONE;
+    if (Rotation == RotationEncoding::Quat32) {
+      flags = flags | FrameFlags::USE_QUAT32;
+    } else if (Rotation == RotationEncoding::Quat48) {
+      flags = flags | FrameFlags::USE_QUAT48;
+    }
+    if (!keyframe) {
+      flags = flags | FrameFlags::DELTA;
+    }
+    return flags;
+  }
+};
+
+struct SenderStats
+{
+  uint64_t Packets = 0;
+  uint64_t Bytes = 0;
+  uint64_t Syscalls = 0;
+  uint64_t Errors = 0;
+};
+
+// bandwidth of a skeleton stream
+struct StreamStats
+{
+  uint64_t Frames = 0;
+  uint64_t Keyframes = 0;
+  uint64_t Bytes = 0;
+  // rotations carried / joints of the frames
+  uint64_t Rotations = 0;
+  uint64_t Joints = 0;
+  // updated every second
+  double BytesPerSecond = 0;
+
+  std::chrono::steady_clock::time_point m_windowStart;
+  uint64_t m_windowBytes = 0;
+
+  void Push(std::chrono::steady_clock::time_point now,
+            size_t bytes,
+            size_t rotations,
+            size_t joints,
+            bool keyframe)
+  {
+    ++Frames;
+    if (keyframe) {
+      ++Keyframes;
+    }
+    Bytes += bytes;
+    Rotations += rotations;
+    Joints += joints;
+
+    m_windowBytes += bytes;
+    auto elapsed = std::chrono::duration<double>(now - m_windowStart).count();
+    if (elapsed >= 1.0) {
+      if (m_windowStart.time_since_epoch().count()) {
+        BytesPerSecond = m_windowBytes / elapsed;
+      }
+      m_windowStart = now;
+      m_windowBytes = 0;
+    }
+  }
+
+  double BytesPerFrame() const { return Frames ? (double)Bytes / Frames : 0; }
+  double RotationRatio() const
+  {
+    return Joints ? (double)Rotations / Joints : 0;
+  }
+};
+
+// last sent rotations of a skeletonId. delta is taken against this
+struct SenderStream
+{
+  std::vector<DirectX::XMFLOAT4> Sent;
+  uint32_t FrameCount = 0;
+  StreamStats Stats;
+};
+
+struct EncodedFrame
+{
+  // for the FrameHeader
+  FrameFlags Flags = FrameFlags::NONE;
+  // number of rotations in the body
+  size_t Rotations = 0;
+};
+
+// the body of a SRHTFRM1 after the FrameHeader.
+// no allocation after the first frames. not thread safe
+class FrameEncoder
+{
+  std::vector<uint32_t> m_mask;
+  // rotations of the set bits in m_mask
+  std::vector<DirectX::XMFLOAT4> m_changed;
+
+public:
+  // append the body to out. a keyframe if the joint count changed or the
+  // KeyframeInterval is reached. stream.Sent is updated
+  EncodedFrame Encode(SenderStream& stream,
+                      std::span<const DirectX::XMFLOAT4> rotations,
+                      const FrameEncoding& encoding,
+                      std::vector<uint8_t>& out);
+};
+
+// skeletonId of a SRHTSKL1 or SRHTFRM1 packet without decoding
+std::optional<uint16_t>
+PeekSkeletonId(std::span<const uint8_t> data);
+
+// decode into the existing storage. no allocation while the joint count fits
+// the capacity. false if the packet is broken.
+// a DELTA frame updates out->Rotations in place. it needs a keyframe of the
+// same joint count before
+bool
+DecodeSkeleton(std::span<const uint8_t> data, SkeletonData* out);
+bool
+DecodeFrame(std::span<const uint8_t> data, FrameData* out);
+
+// clear scene and create nodes of the skeleton
 void
-UpdateScene(const std::shared_ptr<GltfRoot>& scene,
-            std::span<const uint8_t> data);
+BuildScene(const std::shared_ptr<GltfRoot>& scene, const SkeletonData& skeleton);
 
 // void
 // MakeSkeleton(uint32_t skeletonId,
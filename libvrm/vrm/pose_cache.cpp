@@ -0,0 +1,79 @@
+#include "pose_cache.h"
+
+namespace libvrm {
+
+std::span<const float>
+PoseCache::Find(const void* clip, int64_t tick)
+{
+  auto found = m_map.find({ clip, tick });
+  if (found == m_map.end()) {
+    ++Stats.Misses;
+    return {};
+  }
+  ++Stats.Hits;
+  // move to front
+  m_lru.splice(m_lru.begin(), m_lru, found->second);
+  return found->second->Values;
+}
+
+std::span<float>
+PoseCache::Insert(const void* clip, int64_t tick, size_t count)
+{
+  auto bytes = count * sizeof(float);
+  if (bytes > Budget) {
+    return {};
+  }
+
+  // a list node and a map node to reuse
+  std::list<Entry> spare;
+  decltype(m_map)::node_type node;
+
+  Key key{ clip, tick };
+  auto found = m_map.find(key);
+  if (found != m_map.end()) {
+    m_bytes -= found->second->Values.size() * sizeof(float);
+    spare.splice(spare.begin(), m_lru, found->second);
+    node = m_map.extract(found);
+  }
+  // evict least recently used
+  while (m_bytes + bytes > Budget && !m_lru.empty()) {
+    auto last = std::prev(m_lru.end());
+    m_bytes -= last->Values.size() * sizeof(float);
+    auto evicted = m_map.extract(last->CacheKey);
+    if (spare.empty()) {
+      spare.splice(spare.begin(), m_lru, last);
+      node = std::move(evicted);
+    } else {
+      m_lru.erase(last);
+    }
+  }
+
+  if (spare.empty()) {
+    spare.emplace_back();
+  }
+  auto entry = spare.begin();
+  entry->CacheKey = key;
+  // keeps the capacity
+  entry->Values.resize(count);
+  m_lru.splice(m_lru.begin(), spare, entry);
+  if (node) {
+    node.key() = key;
+    node.mapped() = entry;
+    m_map.insert(std::move(node));
+  } else {
+    m_map.insert({ key, entry });
+  }
+  m_bytes += bytes;
+  return entry->Values;
+}
+
+void
+PoseCache::Clear()
+{
+  m_lru.clear();
+  m_map.clear();
+  m_bytes = 0;
+  Stats = {};
+}
+
+} // namespace
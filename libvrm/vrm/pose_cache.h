@@ -0,0 +1,80 @@
+#pragma once
+#include "timeline.h"
+#include <cmath>
+#include <functional>
+#include <list>
+#include <span>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+namespace libvrm {
+
+struct PoseCacheStats
+{
+  uint64_t Hits = 0;
+  uint64_t Misses = 0;
+  float HitRate() const
+  {
+    auto total = Hits + Misses;
+    return total ? static_cast<float>(Hits) / total : 0;
+  }
+};
+
+// LRU cache of sampled local poses keyed by (clip, quantized time).
+// serves seeks and scrubs. playback samples the exact time
+struct PoseCache
+{
+  struct Key
+  {
+    const void* Clip;
+    int64_t Tick;
+    bool operator==(const Key& rhs) const
+    {
+      return Clip == rhs.Clip && Tick == rhs.Tick;
+    }
+  };
+  struct KeyHash
+  {
+    size_t operator()(const Key& key) const
+    {
+      return std::hash<const void*>()(key.Clip) ^
+             (std::hash<int64_t>()(key.Tick) << 1);
+    }
+  };
+  struct Entry
+  {
+    Key CacheKey;
+    std::vector<float> Values;
+  };
+
+  // front is the most recently used
+  std::list<Entry> m_lru;
+  std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> m_map;
+  size_t m_bytes = 0;
+
+  // memory budget of the cached values
+  size_t Budget = 16 * 1024 * 1024;
+  // time key resolution
+  double TicksPerSecond = 120;
+  // a jump of the time longer than this is a seek
+  Time SeekThreshold = Time(0.25);
+  PoseCacheStats Stats;
+
+  int64_t ToTick(Time time) const
+  {
+    return static_cast<int64_t>(std::llround(time.count() * TicksPerSecond));
+  }
+  Time FromTick(int64_t tick) const { return Time(tick / TicksPerSecond); }
+  size_t Bytes() const { return m_bytes; }
+  size_t Size() const { return m_map.size(); }
+
+  // empty if not found
+  std::span<const float> Find(const void* clip, int64_t tick);
+  // storage of count values to fill. empty if over the budget.
+  // the evicted entry is reused, so a full cache does not allocate
+  std::span<float> Insert(const void* clip, int64_t tick, size_t count);
+  void Clear();
+};
+
+} // namespace
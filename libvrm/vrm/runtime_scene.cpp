@@ -1,9 +1,12 @@
 #include "runtime_scene.h"
 #include "animation.h"
+#include "animation_layer.h"
+#include "compressed_animation.h"
 #include "dmath.h"
 #include "expression.h"
 #include "gizmo.h"
 #include "humanoid/humanskeleton.h"
+#include "pose_cache.h"
 #include "runtime_node.h"
 #include "spring_collision.h"
 #include <boneskin/node_state.h>
@@ -11,6 +14,7 @@
 #include <gltfjson/gltf_typing_vrm0.h>
 #include <gltfjson/gltf_typing_vrm1.h>
 #include <gltfjson/json_tree_exporter.h>
+#include <limits>
 
 namespace libvrm {
 
@@ -355,9 +359,15 @@ ParseAnimation(const gltfjson::Root& root, const gltfjson::Bin& bin, int i)
         if (auto values = bin.GetAccessorBytes<float>(root, output_index)) {
           auto node = root.Nodes[node_index];
           if (auto mesh = node.MeshId()) {
+            // CUBICSPLINE has in-tangent, value, out-tangent per key
+            size_t elements = sampler.InterpolationEnum() ==
+                                  gltfjson::AnimationInterpolationModes::
+                                    CUBICSPLINE
+                                ? 3
+                                : 1;
             if (values->size() !=
                 root.Meshes[*mesh].Primitives[0].Targets.size() *
-                  times->size()) {
+                  times->size() * elements) {
               // return std::unexpected{ "animation-weights: size not match" };
               return {};
             }
@@ -390,6 +400,7 @@ ParseAnimation(const gltfjson::Root& root, const gltfjson::Bin& bin, int i)
 RuntimeScene::RuntimeScene(const std::shared_ptr<GltfRoot>& table)
   : m_base(table)
   , m_timeline(new Timeline)
+  , m_poseCache(new PoseCache)
 {
   Reset();
 }
@@ -415,6 +426,7 @@ RuntimeScene::Load(const std::shared_ptr<GltfRoot>& base)
     }
 
     ParseConstraint(ptr.get());
+    ptr->CompileConstraints();
 
     for (int i = 0; i < base->m_gltf->Animations.size(); ++i) {
       if (auto animation = ParseAnimation(*base->m_gltf, base->m_bin, i)) {
@@ -460,33 +472,149 @@ RuntimeScene::Load(const std::shared_ptr<GltfRoot>& base)
 }
 
 void
-RuntimeScene::SetActiveAnimation(uint32_t index)
+RuntimeScene::SetActiveAnimation(uint32_t index, bool compressed)
 {
   if (index >= m_animations.size()) {
     return;
   }
 
   m_timeline->Tracks.clear();
+  m_activeAnimation = ActiveAnimation{ index, compressed };
+  m_playLayers = false;
+  if (compressed) {
+    auto animation = GetOrCreateCompressedAnimation(index);
+    auto track = m_timeline->AddTrack("gltf", animation->Duration());
+    track->Callbacks.push_back(
+      [animation, scene = this](auto time, bool repeat) {
+        animation->Update(time, *scene, repeat);
+        return true;
+      });
+    return;
+  }
+
   auto animation = m_animations[index];
+  auto binding = animation->Bind(*this);
   auto track = m_timeline->AddTrack("gltf", animation->Duration());
-  track->Callbacks.push_back([animation, scene = this](auto time, bool repeat) {
-    animation->Update(time, *scene, repeat);
+  track->Callbacks.push_back([animation,
+                              binding,
+                              cache = m_poseCache,
+                              timeline = m_timeline.get(),
+                              last = Time(-1)](auto time, bool repeat) mutable {
+    auto seek = !timeline->IsPlaying || time < last ||
+                (cache && time - last > cache->SeekThreshold);
+    last = time;
+    if (!cache || !seek) {
+      binding->Update(time, repeat);
+      return true;
+    }
+
+    // same key for the same pose
+    auto duration = animation->Duration();
+    if (repeat) {
+      time = Time(WrapTime(time.count(), duration.count()));
+    } else if (time > duration) {
+      time = duration;
+    }
+    auto tick = cache->ToTick(time);
+    auto values = cache->Find(animation.get(), tick);
+    if (values.size() == binding->ValueCount()) {
+      binding->Load(values);
+      return true;
+    }
+    // the output is the pose of the tick, whether the cache is warm or not
+    binding->Update(cache->FromTick(tick), false);
+    auto stored =
+      cache->Insert(animation.get(), tick, binding->ValueCount());
+    if (!stored.empty()) {
+      binding->Store(stored);
+    }
     return true;
   });
 }
 
 void
-RuntimeScene::SetMorphWeights(uint32_t nodeIndex, std::span<const float> values)
+RuntimeScene::PlayAnimationLayers()
+{
+  if (!m_animationLayers) {
+    m_animationLayers = std::make_shared<AnimationLayerStack>();
+    m_animationLayers->Initialize(*this);
+  }
+  m_timeline->Tracks.clear();
+  m_activeAnimation = {};
+  m_playLayers = true;
+  auto layers = m_animationLayers;
+  auto track = m_timeline->AddTrack("layers", layers->Duration());
+  track->Callbacks.push_back(
+    [layers, scene = this, track = track.get()](auto time, bool repeat) {
+      // layers are added and removed while playing
+      track->Duration = layers->Duration();
+      layers->Update(time, *scene, repeat);
+      return true;
+    });
+}
+
+std::shared_ptr<CompressedAnimation>
+RuntimeScene::GetOrCreateCompressedAnimation(uint32_t index)
+{
+  if (index >= m_animations.size()) {
+    return {};
+  }
+  auto found = m_compressedAnimations.find(index);
+  if (found != m_compressedAnimations.end()) {
+    return found->second;
+  }
+  auto compressed = CompressedAnimation::Compress(*m_animations[index]);
+  m_compressedAnimations.insert({ index, compressed });
+  return compressed;
+}
+
+KeyframeReduction
+RuntimeScene::ReduceAnimation(uint32_t index,
+                              const KeyframeTolerance& tolerance)
+{
+  if (index >= m_animations.size()) {
+    return {};
+  }
+  auto result = ReduceKeyframes(*m_animations[index], tolerance);
+  // derived from the old keys
+  m_compressedAnimations.erase(index);
+  if (m_poseCache) {
+    m_poseCache->Clear();
+  }
+  return result;
+}
+
+void
+RuntimeScene::GetLocalPose(std::span<float> dst) const
 {
-  auto found = m_moprhWeigts.find(nodeIndex);
-  std::vector<float>* pWeights = nullptr;
-  if (found != m_moprhWeigts.end()) {
-    pWeights = &found->second;
-  } else {
-    auto inserted = m_moprhWeigts.insert({ nodeIndex, {} });
-    pWeights = &inserted.first->second;
+  auto p = dst.data();
+  for (auto& node : m_nodes) {
+    p = std::copy_n(&node->Transform.Translation.x, 3, p);
+    p = std::copy_n(&node->Transform.Rotation.x, 4, p);
   }
-  pWeights->assign(values.begin(), values.end());
+}
+
+void
+RuntimeScene::SetLocalPose(std::span<const float> src)
+{
+  auto p = src.data();
+  for (auto& node : m_nodes) {
+    std::copy_n(p, 3, &node->Transform.Translation.x);
+    std::copy_n(p + 3, 4, &node->Transform.Rotation.x);
+    p += 7;
+  }
+}
+
+std::span<float>
+RuntimeScene::MorphWeights(uint32_t nodeIndex, size_t count)
+{
+  if (nodeIndex >= m_morphWeightsRanges.size()) {
+    return {};
+  }
+  auto& range = m_morphWeightsRanges[nodeIndex];
+  range.Bound = true;
+  return std::span(m_morphWeights)
+    .subspan(range.Offset, std::min<size_t>(range.Count, count));
 }
 
 void
@@ -494,6 +622,8 @@ RuntimeScene::Reset()
 {
   m_nodes.clear();
   m_roots.clear();
+  m_springTimestep.Reset();
+  m_springChainMap.clear();
 
   if (m_base) {
     std::unordered_map<std::shared_ptr<Node>, std::shared_ptr<RuntimeNode>>
@@ -516,17 +646,82 @@ RuntimeScene::Reset()
       }
     }
   }
+
+  ResetMorphWeights();
+  BuildHumanRetarget();
+
+  // the bindings of the timeline point to the old nodes and weights
+  if (m_poseCache) {
+    m_poseCache->Clear();
+  }
+  if (m_activeAnimation) {
+    m_timeline->Tracks.clear();
+    SetActiveAnimation(m_activeAnimation->Index,
+                       m_activeAnimation->Compressed);
+  } else if (m_playLayers && m_animationLayers) {
+    m_animationLayers->Rebind(*this);
+    PlayAnimationLayers();
+  }
+}
+
+static uint32_t
+MorphTargetCount(const gltfjson::Root& gltf, uint32_t nodeIndex)
+{
+  if (nodeIndex >= gltf.Nodes.size()) {
+    return 0;
+  }
+  auto node = gltf.Nodes[nodeIndex];
+  if (auto mesh = node.MeshId()) {
+    if (*mesh < gltf.Meshes.size()) {
+      auto primitives = gltf.Meshes[*mesh].Primitives;
+      if (primitives.size()) {
+        return static_cast<uint32_t>(primitives[0].Targets.size());
+      }
+    }
+  }
+  return 0;
+}
+
+void
+RuntimeScene::ResetMorphWeights()
+{
+  m_morphWeightsRanges.assign(m_nodes.size(), {});
+  uint32_t offset = 0;
+  if (m_base && m_base->m_gltf) {
+    for (uint32_t i = 0; i < m_nodes.size(); ++i) {
+      auto& range = m_morphWeightsRanges[i];
+      range.Offset = offset;
+      range.Count = MorphTargetCount(*m_base->m_gltf, i);
+      offset += range.Count;
+    }
+  }
+  m_morphWeights.assign(offset, 0.0f);
+}
+
+void
+RuntimeScene::BuildHumanRetarget()
+{
+  m_humanRetarget.Clear();
+  for (uint32_t i = 0; i < m_nodes.size(); ++i) {
+    auto& base = m_nodes[i]->Base;
+    if (auto humanoid = base->Humanoid) {
+      m_humanRetarget.Push(*humanoid,
+                           i,
+                           base->InitialTransform.Rotation,
+                           base->WorldInitialTransform.Rotation,
+                           base->WorldInitialTransform.Translation);
+    }
+  }
+  // UpdateHumanPose does not allocate
+  m_humanBoneMap.reserve(m_humanRetarget.Slots.size());
+  m_rotations.reserve(m_humanRetarget.Slots.size());
 }
 
 std::shared_ptr<RuntimeNode>
 RuntimeScene::GetBoneNode(HumanBones bone)
 {
-  for (auto& node : m_nodes) {
-    if (auto humanoid = node->Base->Humanoid) {
-      if (*humanoid == bone) {
-        return node;
-      }
-    }
+  if (auto slot = m_humanRetarget.Find(bone)) {
+    return m_nodes[slot->NodeIndex];
   }
   return {};
 }
@@ -573,13 +768,12 @@ RuntimeScene::UpdateNodeStates(std::span<boneskin::NodeState> nodestates)
   };
 
   // glTF morph animation
-  for (int i = 0; i < m_nodes.size(); ++i) {
-    auto found = m_moprhWeigts.find(i);
-    if (found != m_moprhWeigts.end()) {
+  for (int i = 0; i < m_morphWeightsRanges.size(); ++i) {
+    auto& range = m_morphWeightsRanges[i];
+    if (range.Bound) {
       auto& item = nodestates[i];
-      auto& weights = found->second;
-      for (int j = 0; j < weights.size(); ++j) {
-        item.MorphMap[j] = weights[j];
+      for (uint32_t j = 0; j < range.Count; ++j) {
+        item.MorphMap[j] = m_morphWeights[range.Offset + j];
       }
     }
   }
@@ -595,18 +789,62 @@ RuntimeScene::UpdateNodeStates(std::span<boneskin::NodeState> nodestates)
   // 5. SpringBoneを解決
 
   // constraint
-  for (auto& node : m_nodes) {
-    if (auto constraint = node->Constraint) {
-      NodeConstraintProcess(*constraint, node);
-    }
-  }
-  for (auto& root : m_roots) {
-    root->CalcWorldMatrix(true);
+  for (auto& constraint : m_constraints) {
+    NodeConstraintProcess(constraint);
   }
 
   // springbone
-  for (auto& spring : m_springBones) {
-    SpringUpdate(spring, NextSpringDelta);
+  // 描画フレームに依存しないように固定ステップで進める
+  if (NextSpringDelta.count() > 0) {
+    // 親が動いたら起こす
+    for (auto& spring : m_springBones) {
+      auto& chain = m_springChainMap[spring];
+      if (chain.Sleeping && SpringChainParentMoved(spring, chain)) {
+        chain.Sleeping = false;
+        chain.StillSteps = 0;
+      }
+    }
+
+    auto steps = m_springTimestep.Advance(NextSpringDelta);
+    for (int i = 0; i < steps; ++i) {
+      for (auto& spring : m_springBones) {
+        auto& chain = m_springChainMap[spring];
+        if (chain.Sleeping) {
+          continue;
+        }
+        if (++chain.LodCounter < chain.LodInterval) {
+          continue;
+        }
+        chain.LodCounter = 0;
+        auto speed =
+          SpringUpdate(spring, m_springTimestep.Step() * chain.LodInterval);
+        if (m_springSleepSteps > 0 && speed < m_springSleepSpeed) {
+          if (++chain.StillSteps >= m_springSleepSteps) {
+            chain.Sleeping = true;
+            SpringChainStoreParent(spring, &chain);
+          }
+        } else {
+          chain.StillSteps = 0;
+        }
+      }
+    }
+
+    auto alpha = m_springTimestep.Alpha();
+    m_springStats = {};
+    for (auto& spring : m_springBones) {
+      auto& chain = m_springChainMap[spring];
+      if (chain.Sleeping) {
+        ++m_springStats.Sleeping;
+        continue;
+      }
+      if (chain.LodInterval > 1) {
+        ++m_springStats.LodReduced;
+      } else {
+        ++m_springStats.Active;
+      }
+      SpringInterpolate(spring,
+                        (chain.LodCounter + alpha) / chain.LodInterval);
+    }
   }
   NextSpringDelta = {};
 
@@ -659,20 +897,119 @@ RuntimeScene::DrawGizmo(IGizmoDrawer* gizmo)
   }
 }
 
-void
+float
 RuntimeScene::SpringUpdate(const std::shared_ptr<SpringBone>& spring,
                            Time delta)
 {
   bool doUpdate = delta.count() > 0;
   if (!doUpdate) {
-    return;
+    return 0;
   }
 
+  float maxSpeed = 0;
   auto collision = GetOrCreateRuntimeSpringCollision(spring);
   for (auto& joint : spring->Joints) {
     collision->Clear();
     auto runtime = GetOrCreateRuntimeJoint(joint);
     runtime->Update(delta, collision.get());
+    auto move = DirectX::XMVectorGetX(DirectX::XMVector3Length(
+      DirectX::XMVectorSubtract(
+        DirectX::XMLoadFloat3(&runtime->m_currentTailPosotion),
+        DirectX::XMLoadFloat3(&runtime->m_lastTailPosotion))));
+    maxSpeed = std::max(maxSpeed, static_cast<float>(move / delta.count()));
+  }
+  return maxSpeed;
+}
+
+void
+RuntimeScene::SpringLodUpdate(const DirectX::XMFLOAT4X4& view,
+                              const DirectX::XMFLOAT4X4& projection,
+                              float viewportHeight,
+                              float thresholdPixels)
+{
+  auto viewProjection = DirectX::XMMatrixMultiply(
+    DirectX::XMLoadFloat4x4(&view), DirectX::XMLoadFloat4x4(&projection));
+  for (auto& spring : m_springBones) {
+    if (spring->Joints.empty()) {
+      continue;
+    }
+    // chain の長さを根本の位置で投影する
+    float length = 0;
+    for (auto& joint : spring->Joints) {
+      length += GetOrCreateRuntimeJoint(joint)->m_tailLength;
+    }
+    auto head = DirectX::XMLoadFloat3(
+      &spring->Joints.front()->Head->WorldTransform.Translation);
+    auto clip = DirectX::XMVector4Transform(
+      DirectX::XMVectorSetW(head, 1), viewProjection);
+    auto w = std::abs(DirectX::XMVectorGetW(clip));
+    auto pixels = std::numeric_limits<float>::infinity();
+    if (w > 0) {
+      pixels = length * projection._22 / w * viewportHeight * 0.5f;
+    }
+
+    auto& chain = m_springChainMap[spring];
+    int interval = 1;
+    if (pixels < thresholdPixels * 0.25f) {
+      interval = 4;
+    } else if (pixels < thresholdPixels) {
+      interval = 2;
+    }
+    if (interval != chain.LodInterval) {
+      chain.LodInterval = interval;
+      chain.LodCounter = 0;
+    }
+  }
+}
+
+static std::shared_ptr<RuntimeNode>
+SpringChainParent(const std::shared_ptr<SpringBone>& spring)
+{
+  if (spring->Joints.empty()) {
+    return {};
+  }
+  auto head = spring->Joints.front()->Head;
+  if (auto parent = head->Parent.lock()) {
+    return parent;
+  }
+  return head;
+}
+
+void
+RuntimeScene::SpringChainStoreParent(const std::shared_ptr<SpringBone>& spring,
+                                     RuntimeSpringChain* chain)
+{
+  if (auto parent = SpringChainParent(spring)) {
+    chain->ParentPosition = parent->WorldTransform.Translation;
+    chain->ParentRotation = parent->WorldTransform.Rotation;
+  }
+}
+
+bool
+RuntimeScene::SpringChainParentMoved(const std::shared_ptr<SpringBone>& spring,
+                                     const RuntimeSpringChain& chain)
+{
+  auto parent = SpringChainParent(spring);
+  if (!parent) {
+    return false;
+  }
+  auto move = DirectX::XMVectorGetX(DirectX::XMVector3Length(
+    DirectX::XMVectorSubtract(
+      DirectX::XMLoadFloat3(&parent->WorldTransform.Translation),
+      DirectX::XMLoadFloat3(&chain.ParentPosition))));
+  auto dot = std::abs(DirectX::XMVectorGetX(DirectX::XMVector4Dot(
+    DirectX::XMLoadFloat4(&parent->WorldTransform.Rotation),
+    DirectX::XMLoadFloat4(&chain.ParentRotation))));
+  return move > 1e-5f || dot < 1 - 1e-5f;
+}
+
+void
+RuntimeScene::SpringInterpolate(const std::shared_ptr<SpringBone>& spring,
+                                float alpha)
+{
+  for (auto& joint : spring->Joints) {
+    auto runtime = GetOrCreateRuntimeJoint(joint);
+    runtime->Interpolate(alpha);
   }
 }
 
@@ -734,49 +1071,30 @@ RuntimeScene::SpringColliderPosition(
 HumanPose
 RuntimeScene::UpdateHumanPose()
 {
-  auto mult4 = [](const DirectX::XMVECTOR& q0,
-                  const DirectX::XMVECTOR& q1,
-                  const DirectX::XMVECTOR& q2,
-                  const DirectX::XMVECTOR& q3) -> DirectX::XMVECTOR {
-    return DirectX::XMQuaternionMultiply(
-      DirectX::XMQuaternionMultiply(DirectX::XMQuaternionMultiply(q0, q1), q2),
-      q3);
-  };
-
   // retarget human pose
   m_humanBoneMap.clear();
   m_rotations.clear();
-  for (auto& node : m_nodes) {
-    if (auto humanoid = node->Base->Humanoid) {
-      m_humanBoneMap.push_back(*humanoid);
-      if (m_humanBoneMap.back() == HumanBones::hips) {
-        // delta move
-        DirectX::XMStoreFloat3(
-          &m_pose.RootPosition,
-          DirectX::XMVectorSubtract(
-            DirectX::XMLoadFloat3(&node->WorldTransform.Translation),
-            DirectX::XMLoadFloat3(
-              &node->Base->WorldInitialTransform.Translation)));
-      }
+  for (auto& slot : m_humanRetarget.Slots) {
+    auto& node = m_nodes[slot.NodeIndex];
+    if (slot.Bone == HumanBones::hips) {
+      // delta move
+      DirectX::XMStoreFloat3(
+        &m_pose.RootPosition,
+        DirectX::XMVectorSubtract(
+          DirectX::XMLoadFloat3(&node->WorldTransform.Translation),
+          DirectX::XMLoadFloat3(&slot.WorldInitialPosition)));
+    }
 
-      // retarget
-      auto normalized = mult4(
-        DirectX::XMQuaternionInverse(
-          DirectX::XMLoadFloat4(&node->Base->WorldInitialTransform.Rotation)),
-        DirectX::XMLoadFloat4(&node->Transform.Rotation),
-        DirectX::XMQuaternionInverse(
-          DirectX::XMLoadFloat4(&node->Base->InitialTransform.Rotation)),
-        DirectX::XMLoadFloat4(&node->Base->WorldInitialTransform.Rotation));
-
-      if (*humanoid != HumanBones::hips &&
-          DirectX::XMQuaternionIsIdentity(normalized)) {
-        // skip
-        m_humanBoneMap.pop_back();
-      } else {
-        m_rotations.push_back({});
-        DirectX::XMStoreFloat4(&m_rotations.back(), normalized);
-      }
+    auto normalized = HumanRetargetTable::ToNormalized(
+      slot, DirectX::XMLoadFloat4(&node->Transform.Rotation));
+    if (slot.Bone != HumanBones::hips &&
+        DirectX::XMQuaternionIsIdentity(normalized)) {
+      // skip
+      continue;
     }
+    m_humanBoneMap.push_back(slot.Bone);
+    m_rotations.push_back({});
+    DirectX::XMStoreFloat4(&m_rotations.back(), normalized);
   }
   m_pose.Bones = m_humanBoneMap;
   m_pose.Rotations = m_rotations;
@@ -788,34 +1106,27 @@ RuntimeScene::SetHumanPose(const HumanPose& pose)
 {
   assert(pose.Bones.size() == pose.Rotations.size());
 
-  for (int i = 0; i < pose.Bones.size(); ++i) {
-    if (auto node = GetBoneNode(pose.Bones[i])) {
-      auto init = node->Base;
-      if (i == 0) {
-        // hips move
-        // TODO: position from Model Root ?
-        auto pos = pose.RootPosition;
-        auto init_pos = init->WorldInitialTransform.Translation;
-        node->SetWorldMatrix(DirectX::XMMatrixTranslation(
-          init_pos.x + pos.x, init_pos.y + pos.y, init_pos.z + pos.z));
-      }
-
-      auto worldInitial =
-        DirectX::XMLoadFloat4(&init->WorldInitialTransform.Rotation);
-      auto q = DirectX::XMLoadFloat4(&pose.Rotations[i]);
-      auto worldInitialInv = DirectX::XMQuaternionInverse(worldInitial);
-      auto localInitial =
-        DirectX::XMLoadFloat4(&init->InitialTransform.Rotation);
-
-      // # retarget
-      // normalized local rotation to unormalized hierarchy.
-      DirectX::XMStoreFloat4(
-        &node->Transform.Rotation,
-        DirectX::XMQuaternionMultiply(
-          DirectX::XMQuaternionMultiply(
-            DirectX::XMQuaternionMultiply(worldInitial, q), worldInitialInv),
-          localInitial));
+  for (size_t i = 0; i < pose.Bones.size(); ++i) {
+    auto slot = m_humanRetarget.Find(pose.Bones[i]);
+    if (!slot) {
+      continue;
     }
+    auto& node = m_nodes[slot->NodeIndex];
+    if (i == 0) {
+      // hips move
+      // TODO: position from Model Root ?
+      auto pos = pose.RootPosition;
+      auto init_pos = slot->WorldInitialPosition;
+      node->SetWorldMatrix(DirectX::XMMatrixTranslation(
+        init_pos.x + pos.x, init_pos.y + pos.y, init_pos.z + pos.z));
+    }
+
+    // # retarget
+    // normalized local rotation to unormalized hierarchy.
+    DirectX::XMStoreFloat4(
+      &node->Transform.Rotation,
+      HumanRetargetTable::ToLocal(*slot,
+                                  DirectX::XMLoadFloat4(&pose.Rotations[i])));
   }
 
   SyncHierarchy();
@@ -830,22 +1141,19 @@ RuntimeScene::SyncHierarchy()
 }
 
 static void
-Constraint_Rotation(const std::shared_ptr<RuntimeNode>& src,
-                    const std::shared_ptr<RuntimeNode>& dst,
-                    float weight)
+Constraint_Rotation(const CompiledNodeConstraint& c,
+                    const std::shared_ptr<RuntimeNode>& src,
+                    const std::shared_ptr<RuntimeNode>& dst)
 {
+  auto dstInitial = DirectX::XMLoadFloat4(&c.DestinationInitialRotation);
   auto delta = DirectX::XMQuaternionMultiply(
     DirectX::XMLoadFloat4(&src->Transform.Rotation),
-    DirectX::XMQuaternionInverse(
-      DirectX::XMLoadFloat4(&src->Base->InitialTransform.Rotation)));
+    DirectX::XMLoadFloat4(&c.SourceInitialRotationInverse));
 
   DirectX::XMStoreFloat4(
     &dst->Transform.Rotation,
     DirectX::XMQuaternionSlerp(
-      DirectX::XMLoadFloat4(&dst->Base->InitialTransform.Rotation),
-      DirectX::XMQuaternionMultiply(
-        delta, DirectX::XMLoadFloat4(&dst->Base->InitialTransform.Rotation)),
-      weight));
+      dstInitial, DirectX::XMQuaternionMultiply(delta, dstInitial), c.Weight));
 }
 
 static DirectX::XMVECTOR
@@ -865,49 +1173,44 @@ mul4(DirectX::XMVECTOR q0,
 }
 
 static void
-Constraint_Roll(const std::shared_ptr<RuntimeNode>& src,
-                const std::shared_ptr<RuntimeNode>& dst,
-                float weight,
-                DirectX::XMVECTOR axis)
+Constraint_Roll(const CompiledNodeConstraint& c,
+                const std::shared_ptr<RuntimeNode>& src,
+                const std::shared_ptr<RuntimeNode>& dst)
 {
+  auto srcInitial = DirectX::XMLoadFloat4(&c.SourceInitialRotation);
+  auto srcInitialInv = DirectX::XMLoadFloat4(&c.SourceInitialRotationInverse);
+  auto dstInitial = DirectX::XMLoadFloat4(&c.DestinationInitialRotation);
+  auto axis = DirectX::XMLoadFloat3(&c.Axis);
+
   auto deltaSrcQuat = DirectX::XMQuaternionMultiply(
-    DirectX::XMLoadFloat4(&src->Transform.Rotation),
-    DirectX::XMQuaternionInverse(
-      DirectX::XMLoadFloat4(&src->Base->InitialTransform.Rotation)));
-  auto deltaSrcQuatInParent =
-    mul3(DirectX::XMQuaternionInverse(
-           DirectX::XMLoadFloat4(&src->Base->InitialTransform.Rotation)),
-         deltaSrcQuat,
-         DirectX::XMLoadFloat4(&src->Base->InitialTransform.Rotation));
+    DirectX::XMLoadFloat4(&src->Transform.Rotation), srcInitialInv);
+  auto deltaSrcQuatInParent = mul3(srcInitialInv, deltaSrcQuat, srcInitial);
   auto deltaSrcQuatInDst =
-    mul3(DirectX::XMLoadFloat4(&dst->Base->InitialTransform.Rotation),
+    mul3(dstInitial,
          deltaSrcQuatInParent,
-         DirectX::XMQuaternionInverse(
-           DirectX::XMLoadFloat4(&dst->Base->InitialTransform.Rotation)));
+         DirectX::XMLoadFloat4(&c.DestinationInitialRotationInverse));
   auto toVec = DirectX::XMQuaternionMultiply(axis, deltaSrcQuatInDst);
   auto fromToQuat = dmath::rotate_from_to(axis, toVec);
 
   DirectX::XMStoreFloat4(
     &dst->Transform.Rotation,
     DirectX::XMQuaternionSlerp(
-      DirectX::XMLoadFloat4(&dst->Base->InitialTransform.Rotation),
+      dstInitial,
       DirectX::XMQuaternionMultiply(DirectX::XMQuaternionInverse(fromToQuat),
                                     deltaSrcQuatInDst),
-      weight));
+      c.Weight));
 }
 
 static void
-Constraint_Aim(const std::shared_ptr<RuntimeNode>& src,
-               const std::shared_ptr<RuntimeNode>& dst,
-               float weight,
-               const DirectX::XMVECTOR axis)
+Constraint_Aim(const CompiledNodeConstraint& c,
+               const std::shared_ptr<RuntimeNode>& src,
+               const std::shared_ptr<RuntimeNode>& dst)
 {
+  auto dstInitial = DirectX::XMLoadFloat4(&c.DestinationInitialRotation);
   auto dstParentWorldQuat = dst->ParentWorldRotation();
   auto fromVec = DirectX::XMVector3Rotate(
-    axis,
-    DirectX::XMQuaternionMultiply(
-      DirectX::XMLoadFloat4(&dst->Base->InitialTransform.Rotation),
-      dstParentWorldQuat));
+    DirectX::XMLoadFloat3(&c.Axis),
+    DirectX::XMQuaternionMultiply(dstInitial, dstParentWorldQuat));
   auto toVec = DirectX::XMVector3Normalize(DirectX::XMVectorSubtract(
     DirectX::XMLoadFloat3(&src->WorldTransform.Translation),
     DirectX::XMLoadFloat3(&dst->WorldTransform.Translation)));
@@ -916,38 +1219,142 @@ Constraint_Aim(const std::shared_ptr<RuntimeNode>& src,
   DirectX::XMStoreFloat4(
     &dst->Transform.Rotation,
     DirectX::XMQuaternionSlerp(
-      DirectX::XMLoadFloat4(&dst->Base->InitialTransform.Rotation),
-      mul4(DirectX::XMLoadFloat4(&dst->Base->InitialTransform.Rotation),
+      dstInitial,
+      mul4(dstInitial,
            dstParentWorldQuat,
            fromToQuat,
            DirectX::XMQuaternionInverse(dstParentWorldQuat)),
-      weight));
+      c.Weight));
+}
+
+// ancestor が node 自身か祖先
+static bool
+IsAncestorOrSelf(const std::shared_ptr<RuntimeNode>& ancestor,
+                 std::shared_ptr<RuntimeNode> node)
+{
+  for (; node; node = node->Parent.lock()) {
+    if (node == ancestor) {
+      return true;
+    }
+  }
+  return false;
 }
 
 void
-RuntimeScene::NodeConstraintProcess(const NodeConstraint& constraint,
-                                    const std::shared_ptr<RuntimeNode>& dst)
+RuntimeScene::CompileConstraints()
 {
-  auto src = constraint.Source.lock();
-  if (!src) {
-    return;
+  std::vector<CompiledNodeConstraint> list;
+  for (uint32_t i = 0; i < m_nodes.size(); ++i) {
+    auto& dst = m_nodes[i];
+    auto& constraint = dst->Constraint;
+    if (!constraint) {
+      continue;
+    }
+    auto src = constraint->Source.lock();
+    if (!src) {
+      continue;
+    }
+    auto srcIndex = IndexOf(src);
+    if (!srcIndex) {
+      continue;
+    }
+
+    CompiledNodeConstraint c{
+      .Source = static_cast<uint32_t>(*srcIndex),
+      .Destination = i,
+      .Type = constraint->Type,
+      .Weight = constraint->Weight,
+      .SourceInitialRotation = src->Base->InitialTransform.Rotation,
+      .DestinationInitialRotation = dst->Base->InitialTransform.Rotation,
+    };
+    switch (constraint->Type) {
+      case NodeConstraintTypes::Roll:
+        DirectX::XMStoreFloat3(&c.Axis, GetRollVector(constraint->RollAxis));
+        break;
+      case NodeConstraintTypes::Aim:
+        DirectX::XMStoreFloat3(&c.Axis, GetAxisVector(constraint->AimAxis));
+        break;
+      default:
+        c.Axis = { 0, 0, 0 };
+        break;
+    }
+    DirectX::XMStoreFloat4(&c.SourceInitialRotationInverse,
+                           DirectX::XMQuaternionInverse(DirectX::XMLoadFloat4(
+                             &c.SourceInitialRotation)));
+    DirectX::XMStoreFloat4(&c.DestinationInitialRotationInverse,
+                           DirectX::XMQuaternionInverse(DirectX::XMLoadFloat4(
+                             &c.DestinationInitialRotation)));
+    list.push_back(c);
+  }
+
+  // b depends on a when a moves b's source or b's destination parent
+  auto dependsOn = [&nodes = m_nodes](const CompiledNodeConstraint& b,
+                                     const CompiledNodeConstraint& a) {
+    auto aDst = nodes[a.Destination];
+    return IsAncestorOrSelf(aDst, nodes[b.Source]) ||
+           IsAncestorOrSelf(aDst, nodes[b.Destination]->Parent.lock());
+  };
+
+  // topological sort (Kahn)
+  std::vector<int> inDegree(list.size());
+  for (size_t b = 0; b < list.size(); ++b) {
+    for (size_t a = 0; a < list.size(); ++a) {
+      if (a != b && dependsOn(list[b], list[a])) {
+        ++inDegree[b];
+      }
+    }
+  }
+  m_constraints.clear();
+  std::vector<bool> done(list.size());
+  while (m_constraints.size() < list.size()) {
+    bool progress = false;
+    for (size_t a = 0; a < list.size(); ++a) {
+      if (done[a] || inDegree[a] > 0) {
+        continue;
+      }
+      done[a] = true;
+      progress = true;
+      m_constraints.push_back(list[a]);
+      for (size_t b = 0; b < list.size(); ++b) {
+        if (!done[b] && dependsOn(list[b], list[a])) {
+          --inDegree[b];
+        }
+      }
+    }
+    if (!progress) {
+      // cycle. keep node order
+      for (size_t a = 0; a < list.size(); ++a) {
+        if (!done[a]) {
+          done[a] = true;
+          m_constraints.push_back(list[a]);
+        }
+      }
+    }
   }
+}
+
+void
+RuntimeScene::NodeConstraintProcess(const CompiledNodeConstraint& constraint)
+{
+  auto& src = m_nodes[constraint.Source];
+  auto& dst = m_nodes[constraint.Destination];
 
   switch (constraint.Type) {
     case NodeConstraintTypes::Rotation:
-      Constraint_Rotation(src, dst, constraint.Weight);
+      Constraint_Rotation(constraint, src, dst);
       break;
 
     case NodeConstraintTypes::Roll:
-      Constraint_Roll(
-        src, dst, constraint.Weight, GetRollVector(constraint.RollAxis));
+      Constraint_Roll(constraint, src, dst);
       break;
 
     case NodeConstraintTypes::Aim:
-      Constraint_Aim(
-        src, dst, constraint.Weight, GetAxisVector(constraint.AimAxis));
+      Constraint_Aim(constraint, src, dst);
       break;
   }
+
+  // destination 以下だけ更新する
+  dst->CalcWorldMatrix(true);
 }
 
 std::string
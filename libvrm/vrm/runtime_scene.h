@@ -1,15 +1,21 @@
 #pragma once
 #include "gltfroot.h"
 #include "humanoid/humanpose.h"
+#include "humanoid/humanretarget.h"
+#include "keyframe_reducer.h"
 #include "runtime_springjoint.h"
 #include "spring_bone.h"
 #include "vrm/expression.h"
+#include <optional>
 #include <unordered_map>
 
 namespace libvrm {
 struct RuntimeNode;
 struct RuntimeSpringCollision;
 struct Animation;
+struct CompressedAnimation;
+struct AnimationLayerStack;
+struct PoseCache;
 
 inline DirectX::XMFLOAT3
 ToVec3(const gltfjson::tree::NodePtr& json)
@@ -59,8 +65,31 @@ struct RuntimeScene
   std::vector<std::shared_ptr<RuntimeNode>> m_nodes;
   std::vector<std::shared_ptr<RuntimeNode>> m_roots;
   std::vector<std::shared_ptr<Animation>> m_animations;
+  std::unordered_map<uint32_t, std::shared_ptr<CompressedAnimation>>
+    m_compressedAnimations;
+  std::shared_ptr<AnimationLayerStack> m_animationLayers;
   std::shared_ptr<Timeline> m_timeline;
-  std::unordered_map<uint32_t, std::vector<float>> m_moprhWeigts;
+  // what the timeline plays. bound again at Reset
+  struct ActiveAnimation
+  {
+    uint32_t Index = 0;
+    bool Compressed = false;
+  };
+  std::optional<ActiveAnimation> m_activeAnimation;
+  bool m_playLayers = false;
+  // used by SetActiveAnimation if not null
+  std::shared_ptr<PoseCache> m_poseCache;
+  // morph weights of all nodes in one array. sized at Reset.
+  // animation bindings keep spans into it
+  struct MorphWeightsRange
+  {
+    uint32_t Offset = 0;
+    uint32_t Count = 0;
+    // written by an animation
+    bool Bound = false;
+  };
+  std::vector<float> m_morphWeights;
+  std::vector<MorphWeightsRange> m_morphWeightsRanges;
 
   // extensions
   std::shared_ptr<Expressions> m_expressions;
@@ -85,6 +114,7 @@ struct RuntimeScene
   }
 
   Time NextSpringDelta = libvrm::Time(0.0);
+  FixedTimestep m_springTimestep;
   std::shared_ptr<GltfRoot> m_lastScene;
 
   std::unordered_map<std::shared_ptr<SpringJoint>,
@@ -93,6 +123,12 @@ struct RuntimeScene
   std::unordered_map<std::shared_ptr<SpringBone>,
                      std::shared_ptr<RuntimeSpringCollision>>
     m_springCollisionMap;
+  std::unordered_map<std::shared_ptr<SpringBone>, RuntimeSpringChain>
+    m_springChainMap;
+  // sleep when tail speed(m/s) stays below for steps. 0 to disable
+  float m_springSleepSpeed = 0.01f;
+  int m_springSleepSteps = 30;
+  RuntimeSpringStats m_springStats;
 
   HumanPose m_pose;
 
@@ -101,10 +137,23 @@ struct RuntimeScene
   static std::shared_ptr<RuntimeScene> Load(
     const std::shared_ptr<GltfRoot>& table);
   void Reset();
-
-  void SetActiveAnimation(uint32_t index);
-
-  void SetMorphWeights(uint32_t nodeIndex, std::span<const float> values);
+  void ResetMorphWeights();
+
+  void SetActiveAnimation(uint32_t index, bool compressed = false);
+  std::shared_ptr<CompressedAnimation> GetOrCreateCompressedAnimation(
+    uint32_t index);
+  // drop redundant keys of the clip. call SetActiveAnimation again to play it
+  KeyframeReduction ReduceAnimation(uint32_t index,
+                                    const KeyframeTolerance& tolerance);
+  // play m_animationLayers instead of a single clip
+  void PlayAnimationLayers();
+
+  // translation and rotation of all nodes. 7 floats per node
+  size_t LocalPoseSize() const { return m_nodes.size() * 7; }
+  void GetLocalPose(std::span<float> dst) const;
+  void SetLocalPose(std::span<const float> src);
+  // storage for the node, up to count. stable until Reset
+  std::span<float> MorphWeights(uint32_t nodeIndex, size_t count);
 
   std::shared_ptr<RuntimeNode> GetBoneNode(HumanBones bone);
 
@@ -118,8 +167,19 @@ struct RuntimeScene
   std::vector<DirectX::XMFLOAT4X4> m_shapeMatrices;
   std::span<const DirectX::XMFLOAT4X4> ShapeMatrices();
 
-  void SpringUpdate(const std::shared_ptr<SpringBone>& solver,
-                    Time deltaForSimulation);
+  // return max tail speed
+  float SpringUpdate(const std::shared_ptr<SpringBone>& solver,
+                     Time deltaForSimulation);
+  void SpringLodUpdate(const DirectX::XMFLOAT4X4& view,
+                       const DirectX::XMFLOAT4X4& projection,
+                       float viewportHeight,
+                       float thresholdPixels);
+  void SpringChainStoreParent(const std::shared_ptr<SpringBone>& spring,
+                              RuntimeSpringChain* chain);
+  bool SpringChainParentMoved(const std::shared_ptr<SpringBone>& spring,
+                              const RuntimeSpringChain& chain);
+  void SpringInterpolate(const std::shared_ptr<SpringBone>& solver,
+                         float alpha);
   void SpringDrawGizmo(const std::shared_ptr<SpringBone>& solver,
                        IGizmoDrawer* gizmo);
   void SpringColliderDrawGizmo(const std::shared_ptr<SpringCollider>& collider,
@@ -127,10 +187,15 @@ struct RuntimeScene
   DirectX::XMVECTOR SpringColliderPosition(
     const std::shared_ptr<SpringCollider>& collider);
 
-  void NodeConstraintProcess(const NodeConstraint& constraint,
-                             const std::shared_ptr<RuntimeNode>& dst);
+  // sorted by dependency
+  std::vector<CompiledNodeConstraint> m_constraints;
+  void CompileConstraints();
+  void NodeConstraintProcess(const CompiledNodeConstraint& constraint);
 
   // humanpose
+  HumanRetargetTable m_humanRetarget;
+  // call after humanoid bones or the initial pose are modified
+  void BuildHumanRetarget();
   std::vector<HumanBones> m_humanBoneMap;
   std::vector<DirectX::XMFLOAT4> m_rotations;
   HumanPose UpdateHumanPose();
@@ -81,6 +81,22 @@ RuntimeSpringJoint::Update(libvrm::Time time, RuntimeSpringCollision* collision)
   DirectX::XMStoreFloat3(&m_currentTailPosotion, nextTail);
   DirectX::XMStoreFloat3(&m_lastTailPosotion, currentTail);
 
+  ApplyTailPosition(nextTail);
+}
+
+void
+RuntimeSpringJoint::Interpolate(float alpha)
+{
+  // 直近2ステップの間を補間して描画フレームに合わせる
+  auto tail = DirectX::XMVectorLerp(DirectX::XMLoadFloat3(&m_lastTailPosotion),
+                                    DirectX::XMLoadFloat3(&m_currentTailPosotion),
+                                    alpha);
+  ApplyTailPosition(ConstraintTailPosition(tail));
+}
+
+void
+RuntimeSpringJoint::ApplyTailPosition(const DirectX::XMVECTOR& nextTail)
+{
   auto position =
     DirectX::XMLoadFloat3(&Joint->Head->WorldTransform.Translation);
   auto nextTailDir =
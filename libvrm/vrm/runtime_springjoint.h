@@ -21,10 +21,35 @@ struct RuntimeSpringJoint
   RuntimeSpringJoint(const std::shared_ptr<SpringJoint>& joint);
 
   void Update(Time time, RuntimeSpringCollision* collision);
+  // alpha: 0 => last step, 1 => current step
+  void Interpolate(float alpha);
+  void ApplyTailPosition(const DirectX::XMVECTOR& nextTail);
   DirectX::XMVECTOR ConstraintTailPosition(const DirectX::XMVECTOR& src);
   DirectX::XMVECTOR WorldPosToLocalRotation(
     const DirectX::XMVECTOR& nextTail) const;
   void DrawGizmo(IGizmoDrawer* gizmo, const DirectX::XMFLOAT4& color);
 };
 
+// SpringBone(chain) 単位の更新スケジュール
+struct RuntimeSpringChain
+{
+  // sleep
+  int StillSteps = 0;
+  bool Sleeping = false;
+  // parent world transform at sleep
+  DirectX::XMFLOAT3 ParentPosition = {};
+  DirectX::XMFLOAT4 ParentRotation = { 0, 0, 0, 1 };
+
+  // level of detail. simulate every LodInterval steps
+  int LodInterval = 1;
+  int LodCounter = 0;
+};
+
+struct RuntimeSpringStats
+{
+  int Active = 0;
+  int Sleeping = 0;
+  int LodReduced = 0;
+};
+
 } // namespace
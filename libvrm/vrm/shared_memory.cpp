@@ -0,0 +1,165 @@
+#include "shared_memory.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace libvrm {
+
+#ifdef _WIN32
+// per session namespace. Global\ requires a privilege
+static std::string
+ToMappingName(std::string_view name)
+{
+  return "Local\\" + std::string(name);
+}
+
+bool
+SharedMemory::Create(std::string_view name, size_t size)
+{
+  Close();
+  auto mapping = CreateFileMappingA(INVALID_HANDLE_VALUE,
+                                    nullptr,
+                                    PAGE_READWRITE,
+                                    static_cast<DWORD>((uint64_t)size >> 32),
+                                    static_cast<DWORD>(size),
+                                    ToMappingName(name).c_str());
+  if (!mapping) {
+    return false;
+  }
+  m_handle = mapping;
+  m_data = (uint8_t*)MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+  if (!m_data) {
+    Close();
+    return false;
+  }
+  m_size = size;
+  m_name = name;
+  return true;
+}
+
+bool
+SharedMemory::Open(std::string_view name)
+{
+  Close();
+  auto mapping =
+    OpenFileMappingA(FILE_MAP_READ, FALSE, ToMappingName(name).c_str());
+  if (!mapping) {
+    return false;
+  }
+  m_handle = mapping;
+  m_data = (uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (!m_data) {
+    Close();
+    return false;
+  }
+  // rounded up to the page size
+  MEMORY_BASIC_INFORMATION info;
+  if (!VirtualQuery(m_data, &info, sizeof(info))) {
+    Close();
+    return false;
+  }
+  m_size = info.RegionSize;
+  m_name = name;
+  return true;
+}
+
+void
+SharedMemory::Close()
+{
+  if (m_data) {
+    UnmapViewOfFile(m_data);
+    m_data = nullptr;
+  }
+  if (m_handle) {
+    CloseHandle(m_handle);
+    m_handle = nullptr;
+  }
+  m_size = 0;
+  m_name.clear();
+}
+
+void
+SharedMemory::Remove(std::string_view name)
+{
+  // the mapping is released with the last handle
+}
+#else
+// a portable shm name has one leading slash
+static std::string
+ToShmName(std::string_view name)
+{
+  return "/" + std::string(name);
+}
+
+bool
+SharedMemory::Create(std::string_view name, size_t size)
+{
+  Close();
+  auto fd = shm_open(ToShmName(name).c_str(), O_CREAT | O_RDWR, 0600);
+  if (fd < 0) {
+    return false;
+  }
+  if (ftruncate(fd, size) != 0) {
+    close(fd);
+    return false;
+  }
+  auto p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  // the mapping keeps the object
+  close(fd);
+  if (p == MAP_FAILED) {
+    return false;
+  }
+  m_data = (uint8_t*)p;
+  m_size = size;
+  m_name = name;
+  return true;
+}
+
+bool
+SharedMemory::Open(std::string_view name)
+{
+  Close();
+  auto fd = shm_open(ToShmName(name).c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return false;
+  }
+  auto p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    return false;
+  }
+  m_data = (uint8_t*)p;
+  m_size = st.st_size;
+  m_name = name;
+  return true;
+}
+
+void
+SharedMemory::Close()
+{
+  if (m_data) {
+    munmap(m_data, m_size);
+    m_data = nullptr;
+  }
+  m_size = 0;
+  m_name.clear();
+}
+
+void
+SharedMemory::Remove(std::string_view name)
+{
+  shm_unlink(ToShmName(name).c_str());
+}
+#endif
+
+} // namespace
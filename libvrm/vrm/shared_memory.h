@@ -0,0 +1,36 @@
+#pragma once
+#include <span>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+
+namespace libvrm {
+
+// named memory shared between processes of the host.
+// posix shm_open or a windows file mapping backed by the paging file
+class SharedMemory
+{
+  void* m_handle = nullptr;
+  uint8_t* m_data = nullptr;
+  size_t m_size = 0;
+  std::string m_name;
+
+public:
+  SharedMemory() {}
+  ~SharedMemory() { Close(); }
+  SharedMemory(const SharedMemory&) = delete;
+  SharedMemory& operator=(const SharedMemory&) = delete;
+
+  // create or resize. the contents are undefined
+  bool Create(std::string_view name, size_t size);
+  // read only. the whole segment
+  bool Open(std::string_view name);
+  void Close();
+  // remove the name. mapped views stay valid
+  static void Remove(std::string_view name);
+
+  const std::string& Name() const { return m_name; }
+  std::span<uint8_t> Bytes() const { return { m_data, m_size }; }
+};
+
+} // namespace
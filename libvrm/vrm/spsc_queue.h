@@ -0,0 +1,52 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <stdint.h>
+
+namespace libvrm {
+
+// lock-free fixed capacity queue between one producer and one consumer.
+// slots are reused, so T keeps the storage reserved by Initialize().
+template<typename T, size_t N>
+class SpscQueue
+{
+  static_assert((N & (N - 1)) == 0, "power of 2");
+
+  std::array<T, N> m_slots;
+  std::atomic<uint64_t> m_head{ 0 };
+  std::atomic<uint64_t> m_tail{ 0 };
+
+public:
+  // before the threads start
+  template<typename F>
+  void Initialize(const F& init)
+  {
+    for (auto& slot : m_slots) {
+      init(slot);
+    }
+  }
+
+  // producer. nullptr if full
+  T* Back()
+  {
+    auto tail = m_tail.load(std::memory_order_relaxed);
+    if (tail - m_head.load(std::memory_order_acquire) == N) {
+      return nullptr;
+    }
+    return &m_slots[tail & (N - 1)];
+  }
+  void Push() { m_tail.fetch_add(1, std::memory_order_release); }
+
+  // consumer. nullptr if empty
+  const T* Front() const
+  {
+    auto head = m_head.load(std::memory_order_relaxed);
+    if (head == m_tail.load(std::memory_order_acquire)) {
+      return nullptr;
+    }
+    return &m_slots[head & (N - 1)];
+  }
+  void Pop() { m_head.fetch_add(1, std::memory_order_release); }
+};
+
+} // namespace
@@ -11,41 +11,89 @@ namespace libvrm {
 class IntervalTimerImpl
 {
   asio::steady_timer m_timer;
+  std::chrono::nanoseconds m_interval;
+  OnTimer m_onTimer;
+  TimerPacing m_pacing;
   std::chrono::steady_clock::time_point m_startTime;
+  // the next tick. deadline is m_startTime + m_interval * m_tick
+  int64_t m_tick = 1;
 
 public:
+  TimerStats m_stats;
+
   IntervalTimerImpl(asio::io_context& io,
                     std::chrono::nanoseconds interval,
-                    const OnTimer& onTimer)
+                    const OnTimer& onTimer,
+                    const TimerPacing& pacing)
     : m_timer(asio::steady_timer(io))
+    , m_interval(interval)
+    , m_onTimer(onTimer)
+    , m_pacing(pacing)
     , m_startTime(std::chrono::steady_clock::now())
   {
-    AsyncWait(interval, onTimer);
+    AsyncWait();
   }
 
   ~IntervalTimerImpl() { m_timer.cancel(); }
 
-  void AsyncWait(std::chrono::nanoseconds interval, const OnTimer& onTimer)
+  void SetPacing(const TimerPacing& pacing) { m_pacing = pacing; }
+
+  std::chrono::steady_clock::time_point Deadline() const
+  {
+    return m_startTime + m_interval * m_tick;
+  }
+
+  void AsyncWait()
   {
     try {
-      m_timer.expires_after(interval);
-      m_timer.async_wait(
-        [self = this, interval, onTimer, startTime = m_startTime](
-          const std::error_code&) {
-          auto elapsed = std::chrono::steady_clock::now() - startTime;
-          onTimer(elapsed);
-          self->AsyncWait(interval, onTimer);
-        });
+      m_timer.expires_at(Deadline() - m_pacing.BusyWait);
+      m_timer.async_wait([self = this](const std::error_code& ec) {
+        if (ec == asio::error::operation_aborted) {
+          // destroyed
+          return;
+        }
+        self->OnTick();
+      });
     } catch (std::exception const& e) {
       std::cout << "AsyncWait catch: " << e.what() << std::endl;
     }
   }
+
+  void OnTick()
+  {
+    auto deadline = Deadline();
+    auto now = std::chrono::steady_clock::now();
+    while (now < deadline) {
+      // the last part of BusyWait
+      now = std::chrono::steady_clock::now();
+    }
+
+    auto missed = (now - deadline) / m_interval;
+    if (missed > 0) {
+      if (m_pacing.Late == LatePolicy::CatchUp &&
+          missed <= m_pacing.MaxCatchUp) {
+        // the next ticks are already due. fired without waiting
+      } else {
+        // the latest deadline that is passed
+        m_tick += missed;
+        m_stats.Skipped += missed;
+        deadline = Deadline();
+      }
+    }
+    m_stats.Push(
+      std::chrono::duration<double, std::micro>(now - deadline).count());
+
+    m_onTimer(deadline - m_startTime);
+    ++m_tick;
+    AsyncWait();
+  }
 };
 
 IntervalTimer::IntervalTimer(asio::io_context& io,
                              std::chrono::nanoseconds interval,
-                             const OnTimer& onTimer)
-  : m_impl(new IntervalTimerImpl(io, interval, onTimer))
+                             const OnTimer& onTimer,
+                             const TimerPacing& pacing)
+  : m_impl(new IntervalTimerImpl(io, interval, onTimer, pacing))
 {
 }
 
@@ -54,4 +102,16 @@ IntervalTimer::~IntervalTimer()
   delete m_impl;
 }
 
+void
+IntervalTimer::SetPacing(const TimerPacing& pacing)
+{
+  m_impl->SetPacing(pacing);
+}
+
+const TimerStats&
+IntervalTimer::Stats() const
+{
+  return m_impl->m_stats;
+}
+
 } // namespace
@@ -1,5 +1,7 @@
 #pragma once
+#include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <functional>
 #include <list>
 #include <memory>
@@ -18,6 +20,49 @@ using Time = std::chrono::duration<double, std::ratio<1, 1>>;
 
 using OnTime = std::function<bool(Time, bool loop)>;
 
+// accumulate frame delta and consume it by fixed size steps.
+// simulation result is independent from display refresh rate.
+struct FixedTimestep
+{
+  // steps per second. 60, 90, 120 ...
+  int Rate = 60;
+  // upper bound of steps in one frame. the rest of a hitch is dropped.
+  int MaxSubSteps = 4;
+  Time Accumulator = {};
+
+  Time Step() const { return Time(1.0 / Rate); }
+
+  void Reset() { Accumulator = {}; }
+
+  // return step count for this frame
+  int Advance(Time delta)
+  {
+    if (delta.count() <= 0 || Rate <= 0) {
+      return 0;
+    }
+    auto step = Step();
+    Accumulator += delta;
+    auto count = static_cast<int>(Accumulator / step);
+    if (count > MaxSubSteps) {
+      count = MaxSubSteps;
+      // keep phase only
+      Accumulator = Time(std::fmod(Accumulator.count(), step.count()));
+    } else {
+      Accumulator -= step * count;
+    }
+    return count;
+  }
+
+  // position between the last two steps. [0, 1)
+  float Alpha() const
+  {
+    if (Rate <= 0) {
+      return 1.0f;
+    }
+    return static_cast<float>(Accumulator / Step());
+  }
+};
+
 struct Track
 {
   std::string Name;
@@ -85,6 +130,47 @@ struct Timeline
   }
 };
 
+// what a tick later than an interval does
+enum class LatePolicy
+{
+  // drop the missed ticks. the next tick keeps the phase
+  Skip,
+  // fire the missed ticks back to back, up to MaxCatchUp
+  CatchUp,
+};
+
+struct TimerPacing
+{
+  LatePolicy Late = LatePolicy::Skip;
+  int MaxCatchUp = 8;
+  // wake up this much earlier and spin to the deadline.
+  // a timer wakes up late by the os scheduler, 1ms or more on windows
+  std::chrono::nanoseconds BusyWait = {};
+};
+
+// lateness of the ticks against the deadlines. microseconds
+struct TimerStats
+{
+  uint64_t Ticks = 0;
+  // dropped by LatePolicy::Skip
+  uint64_t Skipped = 0;
+  double Last = 0;
+  // exponential moving average
+  double Average = 0;
+  double Max = 0;
+
+  void Push(double us)
+  {
+    Last = us;
+    Average = Ticks ? Average + (us - Average) * 0.05 : us;
+    Max = std::max(Max, us);
+    ++Ticks;
+  }
+};
+
+// the argument is the deadline of the tick, start + n * interval.
+// deadlines are absolute, so the error does not accumulate.
+// the callback, SetPacing and Stats run on the io_context thread
 using OnTimer = std::function<void(libvrm::Time)>;
 class IntervalTimer
 {
@@ -93,8 +179,14 @@ class IntervalTimer
 public:
   IntervalTimer(asio::io_context& io,
                 std::chrono::nanoseconds interval,
-                const OnTimer& onTimer);
+                const OnTimer& onTimer,
+                const TimerPacing& pacing = {});
   ~IntervalTimer();
+  IntervalTimer(const IntervalTimer&) = delete;
+  IntervalTimer& operator=(const IntervalTimer&) = delete;
+
+  void SetPacing(const TimerPacing& pacing);
+  const TimerStats& Stats() const;
 };
 
 } // namespace
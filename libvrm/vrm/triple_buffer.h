@@ -0,0 +1,57 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <stdint.h>
+
+namespace libvrm {
+
+// lock-free latest-value handoff between one producer and one consumer.
+// the producer writes Back() and Publish(). the consumer calls Consume() and
+// reads Front(). the three slots are swapped, never copied.
+template<typename T>
+class TripleBuffer
+{
+  // bit 0-1: slot index, bit 2: not consumed yet
+  static constexpr uint8_t Fresh = 4;
+  static constexpr uint8_t IndexMask = 3;
+
+  std::array<T, 3> m_slots;
+  std::atomic<uint8_t> m_middle{ 1 };
+  // producer only
+  uint8_t m_back = 0;
+  // consumer only
+  uint8_t m_front = 2;
+
+public:
+  // before the threads start. reserve storage of every slot
+  template<typename F>
+  void Initialize(const F& init)
+  {
+    for (auto& slot : m_slots) {
+      init(slot);
+    }
+  }
+
+  T& Back() { return m_slots[m_back]; }
+
+  void Publish()
+  {
+    auto prev = m_middle.exchange(m_back | Fresh, std::memory_order_acq_rel);
+    m_back = prev & IndexMask;
+  }
+
+  // true if a new value is published since the last call
+  bool Consume()
+  {
+    if (!(m_middle.load(std::memory_order_relaxed) & Fresh)) {
+      return false;
+    }
+    auto prev = m_middle.exchange(m_front, std::memory_order_acq_rel);
+    m_front = prev & IndexMask;
+    return true;
+  }
+
+  const T& Front() const { return m_slots[m_front]; }
+};
+
+} // namespace
@@ -1,5 +1,7 @@
 #include "BvhPanel.h"
+#include <atomic>
 #include <imgui.h>
+#include <mutex>
 #include <thread>
 #include <vrm/bvh/bvhscene.h>
 #include <vrm/gltfroot.h>
@@ -17,14 +19,32 @@ class BvhPanelImpl
   asio::io_context m_io;
   asio::executor_work_guard<asio::io_context::executor_type> m_work;
 
+  // io thread. frames are paced and sent apart from the gui refresh
   libvrm::srht::UdpSender m_sender;
-  std::shared_ptr<libvrm::bvh::Bvh> m_bvh;
   asio::ip::udp::endpoint m_ep;
-  bool m_enablePackQuat = false;
+  std::shared_ptr<libvrm::bvh::Bvh> m_playing;
+  libvrm::srht::FrameEncoding m_sendEncoding;
+  int m_sendSkeletons = 1;
+  std::shared_ptr<libvrm::IntervalTimer> m_clock;
+
+  // io thread => gui thread
+  std::atomic<int> m_sentIndex{ -1 };
+  std::mutex m_statsMutex;
+  libvrm::srht::SenderStats m_senderStats;
+  std::vector<libvrm::srht::StreamStats> m_streamStats;
+  libvrm::TimerStats m_timerStats;
 
+  // gui thread
+  std::shared_ptr<libvrm::bvh::Bvh> m_bvh;
+  libvrm::srht::FrameEncoding m_encoding;
+  // same motion as skeletonId 0, 1, 2...
+  int m_skeletons = 1;
+  libvrm::TimerPacing m_pacing;
+  int m_drawnIndex = -1;
   std::vector<cuber::Instance> m_instances;
   std::shared_ptr<libvrm::RuntimeScene> m_scene;
-  std::shared_ptr<libvrm::IntervalTimer> m_clock;
+
+  std::thread m_thread;
 
 public:
   BvhPanelImpl()
@@ -34,9 +54,17 @@ public:
   {
     auto scene = std::make_shared<libvrm::GltfRoot>();
     m_scene = libvrm::RuntimeScene::Load(scene);
+    // covers the timer slack of windows
+    m_pacing.BusyWait = std::chrono::milliseconds(1);
+    m_thread = std::thread([this]() { m_io.run(); });
   }
 
-  ~BvhPanelImpl() { m_work.reset(); }
+  ~BvhPanelImpl()
+  {
+    m_work.reset();
+    m_io.stop();
+    m_thread.join();
+  }
 
   void PushInstance(const libvrm::Instance& instance)
   {
@@ -46,47 +74,157 @@ public:
   void SetBvh(const std::shared_ptr<libvrm::bvh::Bvh>& bvh)
   {
     m_bvh = bvh;
+    m_drawnIndex = -1;
     if (!m_bvh) {
       return;
     }
 
     libvrm::bvh::InitializeSceneFromBvh(m_scene->m_base, m_bvh);
     m_scene->Reset();
+    m_instances.clear();
     m_scene->m_roots[0]->UpdateShapeInstanceRecursive(
       DirectX::XMMatrixIdentity(),
       std::bind(&BvhPanelImpl::PushInstance, this, std::placeholders::_1));
 
-    m_sender.SendBvhSkeleton(m_ep, m_bvh);
+    asio::post(m_io, [this, bvh, pacing = m_pacing]() { Play(bvh, pacing); });
+  }
 
+  // io thread
+  void Play(const std::shared_ptr<libvrm::bvh::Bvh>& bvh,
+            const libvrm::TimerPacing& pacing)
+  {
+    m_clock.reset();
+    m_sentIndex = -1;
+    m_playing = bvh;
+    SendSkeletons();
     m_clock = std::make_shared<libvrm::IntervalTimer>(
       m_io,
-      std::chrono::duration_cast<std::chrono::nanoseconds>(m_bvh->frame_time),
-      [this](auto time) {
-        auto index = m_bvh->TimeToIndex(time);
-        auto frame = m_bvh->GetFrame(index);
+      std::chrono::duration_cast<std::chrono::nanoseconds>(bvh->frame_time),
+      [this](auto time) { OnTick(time); },
+      pacing);
+  }
 
-        m_sender.SendBvhFrame(m_ep, m_bvh, frame, m_enablePackQuat);
+  // io thread
+  void OnTick(libvrm::Time time)
+  {
+    auto index = m_playing->TimeToIndex(time);
+    auto frame = m_playing->GetFrame(index);
 
-        UpdateScene(frame);
-      });
+    m_sender.BeginBatch();
+    for (int i = 0; i < m_sendSkeletons; ++i) {
+      m_sender.SendBvhFrame(m_ep, m_playing, frame, m_sendEncoding, i);
+    }
+    m_sender.EndBatch();
+    m_sentIndex = index;
+
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    m_senderStats = m_sender.Stats();
+    m_streamStats.resize(m_sendSkeletons);
+    for (int i = 0; i < m_sendSkeletons; ++i) {
+      if (auto stream = m_sender.Stats(i)) {
+        m_streamStats[i] = *stream;
+      }
+    }
+    m_timerStats = m_clock->Stats();
   }
 
-  void UpdateGui()
+  // io thread
+  void SendSkeletons()
   {
-    m_io.poll();
+    if (!m_playing) {
+      return;
+    }
+    m_sender.BeginBatch();
+    for (int i = 0; i < m_sendSkeletons; ++i) {
+      m_sender.SendBvhSkeleton(m_ep, m_playing, i);
+    }
+    m_sender.EndBatch();
+  }
 
+  void UpdateGui()
+  {
     if (!m_bvh) {
       return;
     }
+
+    // the last sent frame
+    auto index = m_sentIndex.load();
+    if (index >= 0 && index != m_drawnIndex &&
+        index < static_cast<int>(m_bvh->FrameCount())) {
+      m_drawnIndex = index;
+      UpdateScene(m_bvh->GetFrame(index));
+    }
+
     // bvh panel
     ImGui::Begin("BVH");
 
     ImGui::LabelText("bvh", "%zu joints", m_bvh->joints.size());
 
-    ImGui::Checkbox("use quaternion pack32", &m_enablePackQuat);
+    bool encodingChanged = false;
+    const char* rotations[] = { "float4", "quat32", "quat48" };
+    encodingChanged |=
+      ImGui::Combo("rotation", (int*)&m_encoding.Rotation, rotations, 3);
+    encodingChanged |= ImGui::Checkbox("delta", &m_encoding.Delta);
+    encodingChanged |=
+      ImGui::SliderAngle("threshold", &m_encoding.Threshold, 0, 10);
+    int interval = m_encoding.KeyframeInterval;
+    if (ImGui::SliderInt("keyframe interval", &interval, 1, 240)) {
+      m_encoding.KeyframeInterval = interval;
+      encodingChanged = true;
+    }
+    if (encodingChanged) {
+      asio::post(m_io,
+                 [this, encoding = m_encoding]() { m_sendEncoding = encoding; });
+    }
+
+    bool sendSkeletons = ImGui::SliderInt("skeletons", &m_skeletons, 1, 256);
+    sendSkeletons |= ImGui::Button("send skeleton");
+    if (sendSkeletons) {
+      asio::post(m_io, [this, skeletons = m_skeletons]() {
+        m_sendSkeletons = skeletons;
+        SendSkeletons();
+      });
+    }
+
+    bool pacingChanged = false;
+    const char* policies[] = { "skip", "catch up" };
+    pacingChanged |= ImGui::Combo("late", (int*)&m_pacing.Late, policies, 2);
+    int busyWait = static_cast<int>(
+      std::chrono::duration_cast<std::chrono::microseconds>(m_pacing.BusyWait)
+        .count());
+    if (ImGui::SliderInt("busy wait(us)", &busyWait, 0, 2000)) {
+      m_pacing.BusyWait = std::chrono::microseconds(busyWait);
+      pacingChanged = true;
+    }
+    if (pacingChanged) {
+      asio::post(m_io, [this, pacing = m_pacing]() {
+        if (m_clock) {
+          m_clock->SetPacing(pacing);
+        }
+      });
+    }
 
-    if (ImGui::Button("send skeleton")) {
-      m_sender.SendBvhSkeleton(m_ep, m_bvh);
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    auto& timer = m_timerStats;
+    ImGui::Text("tick late: %.0f us, avg %.0f us, max %.0f us",
+                timer.Last,
+                timer.Average,
+                timer.Max);
+    ImGui::Text("ticks: %llu, skipped: %llu",
+                (unsigned long long)timer.Ticks,
+                (unsigned long long)timer.Skipped);
+    auto& stats = m_senderStats;
+    ImGui::Text("sent: %llu packets, %llu syscalls, %llu errors",
+                (unsigned long long)stats.Packets,
+                (unsigned long long)stats.Syscalls,
+                (unsigned long long)stats.Errors);
+    for (size_t i = 0; i < m_streamStats.size(); ++i) {
+      auto stream = &m_streamStats[i];
+      ImGui::Text("[%zu] %.1f kB/s, %.0f bytes/frame, %.0f%% joints",
+                  i,
+                  stream->BytesPerSecond / 1024,
+                  stream->BytesPerFrame(),
+                  stream->RotationRatio() * 100);
     }
 
     ImGui::End();
@@ -95,7 +233,7 @@ public:
   void UpdateScene(const libvrm::bvh::Frame& frame)
   {
     libvrm::bvh::UpdateSceneFromBvhFrame(
-      m_scene, m_scene->m_roots[0], m_bvh, frame, m_bvh->GuessScaling());
+      m_scene, m_bvh, frame, m_bvh->GuessScaling());
     m_scene->m_roots[0]->CalcWorldMatrix(true);
     m_instances.clear();
     m_scene->m_roots[0]->UpdateShapeInstanceRecursive(
@@ -0,0 +1,482 @@
+// SRHT loopback benchmark.
+// UdpSender => 127.0.0.1 => UdpReceiver in one process. the frame time is the
+// steady_clock of the sender, so the latency is measured without clock sync.
+// --transport shm writes the same packets to ShmSender => ShmReceiver.
+//
+// srhtbench [--bvh file] [--skeletons 8] [--joints 60] [--rate 120]
+//           [--seconds 2] [--port 54346] [--encoding all|float|quat32|quat48]
+//           [--delta] [--record file.srhtrec] [--transport udp|shm]
+// srhtbench --replay file.srhtrec
+//   decode a recording as fast as possible
+#include <DirectXMath.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <stdio.h>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <vrm/bvh/bvh.h>
+#include <vrm/network/srht_receiver.h>
+#include <vrm/network/srht_record.h>
+#include <vrm/network/srht_sender.h>
+#include <vrm/network/srht_shm.h>
+
+using Clock = std::chrono::steady_clock;
+
+constexpr const char* SHM_NAME = "srhtbench";
+
+struct Options
+{
+  std::string_view BvhPath;
+  int Skeletons = 8;
+  int Joints = 60;
+  // frames per second of each skeleton. 0 is as fast as possible
+  double Rate = 120;
+  double Seconds = 2;
+  uint16_t Port = 54346;
+  std::vector<libvrm::srht::RotationEncoding> Encodings = {
+    libvrm::srht::RotationEncoding::Float4,
+    libvrm::srht::RotationEncoding::Quat32,
+    libvrm::srht::RotationEncoding::Quat48,
+  };
+  bool Delta = false;
+  bool Shm = false;
+  std::string_view RecordPath;
+  std::string_view ReplayPath;
+
+  bool Parse(int argc, char** argv)
+  {
+    for (int i = 1; i < argc; ++i) {
+      std::string_view arg = argv[i];
+      if (arg == "--delta") {
+        Delta = true;
+        continue;
+      }
+      if (i + 1 >= argc) {
+        return false;
+      }
+      std::string_view value = argv[++i];
+      if (arg == "--bvh") {
+        BvhPath = value;
+      } else if (arg == "--skeletons") {
+        Skeletons = std::clamp(atoi(value.data()),
+                               1,
+                               (int)libvrm::srht::UdpReceiver::MaxStreams);
+      } else if (arg == "--joints") {
+        Joints = std::clamp(atoi(value.data()), 1, 256);
+      } else if (arg == "--rate") {
+        Rate = std::max(0.0, atof(value.data()));
+      } else if (arg == "--seconds") {
+        Seconds = atof(value.data());
+      } else if (arg == "--transport") {
+        if (value == "udp") {
+          Shm = false;
+        } else if (value == "shm") {
+          Shm = true;
+        } else {
+          return false;
+        }
+      } else if (arg == "--record") {
+        RecordPath = value;
+      } else if (arg == "--replay") {
+        ReplayPath = value;
+      } else if (arg == "--port") {
+        Port = static_cast<uint16_t>(atoi(value.data()));
+      } else if (arg == "--encoding") {
+        if (value == "all") {
+          // default
+        } else if (value == "float") {
+          Encodings = { libvrm::srht::RotationEncoding::Float4 };
+        } else if (value == "quat32") {
+          Encodings = { libvrm::srht::RotationEncoding::Quat32 };
+        } else if (value == "quat48") {
+          Encodings = { libvrm::srht::RotationEncoding::Quat48 };
+        } else {
+          return false;
+        }
+      } else {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+static const char*
+ToString(libvrm::srht::RotationEncoding encoding)
+{
+  switch (encoding) {
+    case libvrm::srht::RotationEncoding::Float4:
+      return "float";
+    case libvrm::srht::RotationEncoding::Quat32:
+      return "quat32";
+    case libvrm::srht::RotationEncoding::Quat48:
+      return "quat48";
+  }
+  return "?";
+}
+
+// a skeleton and its motion. the bvh or a waving chain
+struct Source
+{
+  std::vector<libvrm::srht::JointDefinition> Joints;
+  std::shared_ptr<libvrm::bvh::Bvh> Bvh;
+  float Scaling = 1.0f;
+
+  std::vector<DirectX::XMFLOAT4> Rotations;
+  DirectX::XMFLOAT3 Root = { 0, 0, 0 };
+
+  bool Load(const Options& options)
+  {
+    if (options.BvhPath.size()) {
+      Bvh = libvrm::bvh::Bvh::FromFile(options.BvhPath);
+      if (!Bvh || Bvh->FrameCount() == 0) {
+        std::cerr << "fail to load: " << options.BvhPath << std::endl;
+        return false;
+      }
+      Scaling = Bvh->GuessScaling();
+      for (auto& joint : Bvh->joints) {
+        Joints.push_back({
+          .parentBoneIndex = joint.parent.value_or(-1),
+          .boneType = 0,
+          .xFromParent = joint.localOffset.x * Scaling,
+          .yFromParent = joint.localOffset.y * Scaling,
+          .zFromParent = joint.localOffset.z * Scaling,
+        });
+      }
+    } else {
+      for (int i = 0; i < options.Joints; ++i) {
+        Joints.push_back({
+          .parentBoneIndex = static_cast<uint16_t>(i - 1),
+          .boneType = 0,
+          .xFromParent = 0,
+          .yFromParent = i ? 0.1f : 1.0f,
+          .zFromParent = 0,
+        });
+      }
+    }
+    Rotations.resize(Joints.size());
+    return true;
+  }
+
+  void Update(int skeleton, int frame, double seconds)
+  {
+    if (Bvh) {
+      auto bvhFrame = Bvh->GetFrame((frame + skeleton * 7) % Bvh->FrameCount());
+      for (size_t i = 0; i < Bvh->joints.size(); ++i) {
+        auto transform = bvhFrame.Resolve(Bvh->joints[i].channels);
+        if (i == 0) {
+          Root = {
+            transform.Translation.x * Scaling,
+            transform.Translation.y * Scaling,
+            transform.Translation.z * Scaling,
+          };
+        }
+        Rotations[i] = transform.Rotation;
+      }
+    } else {
+      Root = { static_cast<float>(skeleton), 0, 0 };
+      for (size_t i = 0; i < Rotations.size(); ++i) {
+        auto angle =
+          static_cast<float>(std::sin(seconds * 3 + i * 0.3 + skeleton) * 0.5);
+        DirectX::XMStoreFloat4(
+          &Rotations[i], DirectX::XMQuaternionRotationRollPitchYaw(0, 0, angle));
+      }
+    }
+  }
+};
+
+struct Result
+{
+  double Seconds = 0;
+  uint64_t SentFrames = 0;
+  uint64_t ReceivedFrames = 0;
+  libvrm::srht::SenderStats Sender;
+  libvrm::srht::ReceiverStats Receiver;
+  // microseconds, sorted
+  std::vector<double> Latency;
+
+  double Percentile(double p) const
+  {
+    if (Latency.empty()) {
+      return 0;
+    }
+    auto i = static_cast<size_t>(p * (Latency.size() - 1) + 0.5);
+    return Latency[i];
+  }
+};
+
+static std::optional<Result>
+Run(const Options& options,
+    Source& source,
+    libvrm::srht::RotationEncoding rotation)
+{
+  std::shared_ptr<libvrm::srht::ShmSender> shm;
+  std::unique_ptr<libvrm::srht::Receiver> receiver;
+  if (options.Shm) {
+    // the writer creates the segment
+    shm = std::make_shared<libvrm::srht::ShmSender>();
+    if (!shm->Create(SHM_NAME)) {
+      std::cerr << "fail to create shm: " << SHM_NAME << std::endl;
+      return {};
+    }
+    auto shmReceiver = std::make_unique<libvrm::srht::ShmReceiver>();
+    if (!shmReceiver->Start(SHM_NAME)) {
+      return {};
+    }
+    receiver = std::move(shmReceiver);
+  } else {
+    auto udpReceiver = std::make_unique<libvrm::srht::UdpReceiver>();
+    if (!udpReceiver->Start(options.Port)) {
+      return {};
+    }
+    receiver = std::move(udpReceiver);
+  }
+
+  if (!options.RecordPath.empty()) {
+    // a file per encoding
+    std::filesystem::path path(options.RecordPath);
+    if (options.Encodings.size() > 1) {
+      path.replace_filename(path.stem().string() + "_" + ToString(rotation) +
+                            path.extension().string());
+    }
+    auto recorder = std::make_shared<libvrm::srht::PacketRecorder>();
+    if (!recorder->Open(path)) {
+      std::cerr << "fail to open: " << path.string() << std::endl;
+      return {};
+    }
+    receiver->SetRecorder(recorder);
+  }
+
+  Result result;
+  auto frameCount = static_cast<size_t>(
+    options.Rate > 0 ? options.Rate * options.Seconds * options.Skeletons
+                     : 0);
+  result.Latency.reserve(std::max<size_t>(frameCount, 1024));
+
+  // drain the queues of all skeletons
+  std::atomic<bool> done = false;
+  std::thread consumer([&receiver, &result, &done]() {
+    while (!done.load(std::memory_order_relaxed)) {
+      bool empty = true;
+      for (size_t i = 0; i < receiver->StreamCount(); ++i) {
+        auto stream = receiver->Stream(i);
+        stream->Skeleton.Consume();
+        while (auto frame = stream->Frames.Front()) {
+          auto now = Clock::now();
+          result.Latency.push_back(
+            std::chrono::duration<double, std::micro>(
+              now - Clock::time_point(
+                      std::chrono::duration_cast<Clock::duration>(frame->Time)))
+              .count());
+          ++result.ReceivedFrames;
+          stream->Frames.Pop();
+          empty = false;
+        }
+      }
+      if (empty) {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  asio::io_context io;
+  libvrm::srht::UdpSender sender(io);
+  sender.SetSharedMemory(shm);
+  asio::ip::udp::endpoint ep(asio::ip::address_v4::loopback(), options.Port);
+
+  libvrm::srht::FrameEncoding encoding;
+  encoding.Rotation = rotation;
+  encoding.Delta = options.Delta;
+
+  sender.BeginBatch();
+  for (int i = 0; i < options.Skeletons; ++i) {
+    sender.SendSkeleton(ep, static_cast<uint16_t>(i), source.Joints);
+  }
+  sender.EndBatch();
+  // the receiver creates the streams
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  auto start = Clock::now();
+  auto end = start + std::chrono::duration_cast<Clock::duration>(
+                       std::chrono::duration<double>(options.Seconds));
+  auto interval =
+    options.Rate > 0 ? std::chrono::duration_cast<Clock::duration>(
+                         std::chrono::duration<double>(1.0 / options.Rate))
+                     : Clock::duration{};
+  // absolute deadlines. no drift
+  auto next = start;
+  for (int frame = 0;; ++frame) {
+    auto now = Clock::now();
+    if (now >= end) {
+      break;
+    }
+    sender.BeginBatch();
+    for (int i = 0; i < options.Skeletons; ++i) {
+      source.Update(
+        i, frame, std::chrono::duration<double>(now - start).count());
+      sender.SendFrame(
+        ep,
+        static_cast<uint16_t>(i),
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+          Clock::now().time_since_epoch()),
+        source.Root,
+        source.Rotations,
+        encoding);
+      ++result.SentFrames;
+    }
+    sender.EndBatch();
+    if (interval.count()) {
+      next += interval;
+      std::this_thread::sleep_until(next);
+    }
+  }
+  result.Seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+  // in flight
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  done = true;
+  consumer.join();
+  receiver->Stop();
+  if (shm) {
+    shm->Close();
+    libvrm::SharedMemory::Remove(SHM_NAME);
+  }
+
+  result.Sender = sender.Stats();
+  result.Receiver = receiver->Stats();
+  std::sort(result.Latency.begin(), result.Latency.end());
+  return result;
+}
+
+// decode all packets of the recording in order
+static int
+Replay(const std::filesystem::path& path)
+{
+  libvrm::srht::PacketReplay replay;
+  if (!replay.Open(path)) {
+    std::cerr << "fail to open: " << path.string() << std::endl;
+    return 1;
+  }
+
+  // delta frames are applied per skeletonId
+  std::unordered_map<uint16_t, libvrm::srht::FrameData> states;
+  libvrm::srht::SkeletonData skeleton;
+  uint64_t bytes = 0;
+  uint64_t frames = 0;
+  uint64_t errors = 0;
+  auto start = Clock::now();
+  for (size_t i = 0; i < replay.Size(); ++i) {
+    auto packet = replay.Packet(i);
+    bytes += packet.Data.size();
+    auto id = libvrm::srht::PeekSkeletonId(packet.Data);
+    if (!id) {
+      ++errors;
+    } else if (std::string_view((const char*)packet.Data.data(), 8) ==
+               libvrm::srht::SRHT_SKELETON_MAGIC1) {
+      if (!libvrm::srht::DecodeSkeleton(packet.Data, &skeleton)) {
+        ++errors;
+      }
+    } else if (libvrm::srht::DecodeFrame(packet.Data, &states[*id])) {
+      ++frames;
+    } else {
+      ++errors;
+    }
+  }
+  auto seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+  printf("%zu packets, %zu skeletons, %.1f s recorded\n",
+         replay.Size(),
+         states.size(),
+         std::chrono::duration<double>(replay.Duration()).count());
+  printf("frames: %llu, errors: %llu\n",
+         (unsigned long long)frames,
+         (unsigned long long)errors);
+  printf("decode: %.0f packets/s, %.1f MB/s\n",
+         seconds > 0 ? replay.Size() / seconds : 0.0,
+         seconds > 0 ? bytes / seconds / (1024 * 1024) : 0.0);
+  return frames ? 0 : 1;
+}
+
+int
+main(int argc, char** argv)
+{
+  Options options;
+  if (!options.Parse(argc, argv)) {
+    std::cerr << "usage: srhtbench [--bvh file] [--skeletons N] [--joints N] "
+                 "[--rate Hz] [--seconds S] [--port N] "
+                 "[--encoding all|float|quat32|quat48] [--delta] "
+                 "[--transport udp|shm] [--record file] | --replay file"
+              << std::endl;
+    return 1;
+  }
+  if (!options.ReplayPath.empty()) {
+    return Replay(options.ReplayPath);
+  }
+
+  Source source;
+  if (!source.Load(options)) {
+    return 1;
+  }
+
+  printf("%d skeletons x %zu joints, %.0f Hz, %.1f s, %s%s\n",
+         options.Skeletons,
+         source.Joints.size(),
+         options.Rate,
+         options.Seconds,
+         options.Shm ? "shm" : "udp",
+         options.Delta ? ", delta" : "");
+  printf("%-8s %10s %10s %10s %10s %10s %10s %8s\n",
+         "encoding",
+         "packets/s",
+         "kB/s",
+         "B/frame",
+         "p50(us)",
+         "p99(us)",
+         "max(us)",
+         "loss(%)");
+  bool ok = true;
+  for (auto rotation : options.Encodings) {
+    auto result = Run(options, source, rotation);
+    if (!result) {
+      return 1;
+    }
+    auto lost = result->SentFrames - result->ReceivedFrames;
+    auto loss = result->SentFrames
+                  ? 100.0 * lost / static_cast<double>(result->SentFrames)
+                  : 0.0;
+    printf("%-8s %10.0f %10.1f %10.1f %10.1f %10.1f %10.1f %8.2f\n",
+           ToString(rotation),
+           result->Sender.Packets / result->Seconds,
+           result->Sender.Bytes / result->Seconds / 1024,
+           result->Sender.Packets
+             ? result->Sender.Bytes / static_cast<double>(result->Sender.Packets)
+             : 0.0,
+           result->Percentile(0.5),
+           result->Percentile(0.99),
+           result->Latency.empty() ? 0.0 : result->Latency.back(),
+           loss);
+    if (result->Sender.Errors || result->Receiver.Errors ||
+        result->Receiver.Overflow || result->Receiver.Lost) {
+      printf("  send errors: %llu, receive errors: %llu, overflow: %llu, "
+             "lost: %llu\n",
+             (unsigned long long)result->Sender.Errors,
+             (unsigned long long)result->Receiver.Errors,
+             (unsigned long long)result->Receiver.Overflow,
+             (unsigned long long)result->Receiver.Lost);
+    }
+    if (result->ReceivedFrames == 0) {
+      ok = false;
+    }
+  }
+
+  return ok ? 0 : 1;
+}
@@ -352,6 +352,9 @@ public:
     if (extension == ".bvh") {
       return humanpose::HumanPoseStream::Instance().LoadMotion(path);
     }
+    if (extension == ".srhtrec") {
+      return humanpose::HumanPoseStream::Instance().LoadRecord(path);
+    }
     if (extension == ".fbx") {
       return LoadFbx(path);
     }
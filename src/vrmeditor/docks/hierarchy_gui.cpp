@@ -66,10 +66,12 @@ DescendantHasHumanoid(const std::shared_ptr<libvrm::RuntimeNode>& node)
   return DescendantHasHumanoid(node->Base);
 }
 
+// return true if humanoid or initial pose is modified
 template<typename T, typename N>
-void
+bool
 Traverse(const std::shared_ptr<T>& scene, const std::shared_ptr<N>& node)
 {
+  bool modified = false;
   static ImGuiTreeNodeFlags base_flags = ImGuiTreeNodeFlags_OpenOnArrow |
                                          ImGuiTreeNodeFlags_OpenOnDoubleClick |
                                          ImGuiTreeNodeFlags_SpanAvailWidth;
@@ -106,36 +108,44 @@ Traverse(const std::shared_ptr<T>& scene, const std::shared_ptr<N>& node)
   ImGui::TableNextColumn();
   ImGui::SetNextItemWidth(-1);
   // ImGui::TextUnformatted(libvrm::HumanBoneToNameWithIcon(*humanoid));
-  node->SetHumanBone(BoneSelector("##bone", node->GetHumanBone()));
+  auto bone = BoneSelector("##bone", node->GetHumanBone());
+  if (bone != node->GetHumanBone()) {
+    node->SetHumanBone(bone);
+    modified = true;
+  }
 
   // T
   ImGui::TableNextColumn();
   ImGui::SetNextItemWidth(-1);
   if (ImGui::InputFloat3("##translation", &node->GetTranslation().x)) {
     node->Calc(true);
+    modified = true;
   }
   // R
   ImGui::TableNextColumn();
   ImGui::SetNextItemWidth(-1);
   if (ImGui::InputFloat4("##rotation", &node->GetRotation().x)) {
     node->Calc(true);
+    modified = true;
   }
   // S
   ImGui::TableNextColumn();
   ImGui::SetNextItemWidth(-1);
   if (ImGui::InputFloat3("##scale", &node->GetScale().x)) {
     node->Calc(true);
+    modified = true;
   }
 
   ImGui::PopID();
   if (node_open) {
     for (auto& child : node->Children) {
-      Traverse(scene, child);
+      modified |= Traverse(scene, child);
     }
     if (!is_leaf) {
       ImGui::TreePop();
     }
   }
+  return modified;
 }
 
 struct HierarchyGuiImpl
@@ -149,15 +159,23 @@ struct HierarchyGuiImpl
 
   void ShowRuntime()
   {
+    bool modified = false;
     for (auto& root : m_runtime->m_roots) {
-      Traverse(m_runtime, root);
+      modified |= Traverse(m_runtime, root);
+    }
+    if (modified) {
+      m_runtime->BuildHumanRetarget();
     }
   }
 
   void ShowAsset()
   {
+    bool modified = false;
     for (auto& root : m_runtime->m_base->m_roots) {
-      Traverse(m_runtime->m_base, root);
+      modified |= Traverse(m_runtime->m_base, root);
+    }
+    if (modified) {
+      m_runtime->BuildHumanRetarget();
     }
   }
 
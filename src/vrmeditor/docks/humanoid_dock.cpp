@@ -46,6 +46,7 @@ struct ImHumanoid
             }
           }
           node->Humanoid = bone;
+          m_runtime->BuildHumanRetarget();
         }
 
         // Set the initial focus when opening the combo (scrolling +
@@ -27,6 +27,8 @@ BvhNode::SetBvh(const std::shared_ptr<libvrm::bvh::Bvh>& bvh,
                 const std::shared_ptr<libvrm::HumanBoneMap>& map)
 {
   m_bvh = bvh;
+  m_stream = {};
+  m_cache.Clear();
 
   if (map) {
 
@@ -38,15 +40,25 @@ BvhNode::SetBvh(const std::shared_ptr<libvrm::bvh::Bvh>& bvh,
   m_scene->Reset();
 }
 
+void
+BvhNode::SetBvhStream(const std::shared_ptr<libvrm::bvh::BvhStream>& stream,
+                      const std::shared_ptr<libvrm::HumanBoneMap>& map)
+{
+  SetBvh(stream->Header(), map);
+  m_stream = stream;
+}
+
 void
 BvhNode::TimeUpdate(libvrm::Time time)
 {
   if (m_initialPose) {
     Outputs[0].Value = libvrm::HumanPose::Initial();
     // m_scene->SetInitialPose();
+  } else if (m_stream) {
+    libvrm::bvh::UpdateSceneFromBvhFrame(m_scene, *m_stream, time);
   } else {
     // update scene from bvh
-    libvrm::bvh::UpdateSceneFromBvhFrame(m_scene, m_bvh, time);
+    libvrm::bvh::UpdateSceneFromBvhFrame(m_scene, m_bvh, time, &m_cache);
   }
 
   Outputs[0].Value = m_scene->UpdateHumanPose();
@@ -56,6 +68,24 @@ void
 BvhNode::DrawContent()
 {
   ImGui::Checkbox("init pose", &m_initialPose);
+  if (m_stream) {
+    ImGui::Text("stream: %u frames, indexed %zu/%zu MB",
+                m_stream->FrameCount(),
+                m_stream->IndexedBytes() / (1024 * 1024),
+                m_stream->TotalBytes() / (1024 * 1024));
+  } else if (m_bvh && !m_bvh->baked.empty()) {
+    ImGui::Text("baked: %zu MB", m_bvh->BakedBytes() / (1024 * 1024));
+  } else if (m_bvh) {
+    ImGui::Text("cache: %zu frames, hit %.0f%%",
+                m_cache.Size(),
+                m_cache.Stats.HitRate() * 100);
+    if (ImGui::Button("bake")) {
+      m_bvh->Bake(m_bvh->GuessScaling());
+      m_cache.Clear();
+    }
+    ImGui::SameLine();
+    ImGui::Text("%zu MB", m_bvh->BakedBytes() / (1024 * 1024));
+  }
   auto sc = ImGui::GetCursorScreenPos();
 
   static float color[] = {
@@ -1,7 +1,9 @@
 #pragma once
 #include "graphnode_base.h"
 #include <vrm/bvh/bvh.h>
+#include <vrm/bvh/bvhstream.h>
 #include <vrm/bvh/humanbone_map.h>
+#include <vrm/pose_cache.h>
 
 class ScenePreview;
 
@@ -15,15 +17,21 @@ struct BvhNode : public GraphNodeBase
 {
   std::shared_ptr<libvrm::RuntimeScene> m_scene;
   std::shared_ptr<libvrm::bvh::Bvh> m_bvh;
+  // frames are decoded on demand if not null
+  std::shared_ptr<libvrm::bvh::BvhStream> m_stream;
 
   std::shared_ptr<ScenePreview> m_preview;
 
   bool m_initialPose = false;
+  // resolved euler channels per frame
+  libvrm::PoseCache m_cache;
 
   // constructor
   BvhNode(int id, std::string_view name);
   void SetBvh(const std::shared_ptr<libvrm::bvh::Bvh>& bvh,
               const std::shared_ptr<libvrm::HumanBoneMap>& map);
+  void SetBvhStream(const std::shared_ptr<libvrm::bvh::BvhStream>& stream,
+                    const std::shared_ptr<libvrm::HumanBoneMap>& map);
   void TimeUpdate(libvrm::Time time) override;
   void DrawContent() override;
 };
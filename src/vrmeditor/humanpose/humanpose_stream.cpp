@@ -2,6 +2,10 @@
 #include "app.h"
 #include "bvhnode.h"
 #include "posenode.h"
+#include "replaynode.h"
+#if __has_include(<asio.hpp>)
+#include "udpnode.h"
+#endif
 #include <gltfjson/gltf_typing_vrm1.h>
 #include <imnodes.h>
 #include <plog/Log.h>
@@ -101,11 +105,13 @@ HumanPoseStream::HumanPoseStream()
   };
 
   // source nodes
-  // CreateNode<UdpNode>(
-  //   "Udp",
-  //   "SrcNode",
-  //   {},
-  //   std::vector<PinNameWithType>{ { "HumanPose", PinDataTypes::HumanPose } });
+#if __has_include(<asio.hpp>)
+  CreateNode<UdpNode>(
+    "Udp",
+    "SrcNode",
+    {},
+    std::vector<PinNameWithType>{ { "HumanPose", PinDataTypes::HumanPose } });
+#endif
 
   CreateNode<PoseNode>(
     "InitialPose",
@@ -221,22 +227,36 @@ HumanPoseStream::TryRemoveLink(int link_id)
 bool
 HumanPoseStream::LoadMotion(const std::filesystem::path& path)
 {
-  auto bytes = libvrm::ReadAllBytes(path);
-  if (bytes.empty()) {
-    PLOG_ERROR << "fail to read: " + path.string();
-    return false;
+  // decode frames on demand instead of parsing all
+  std::error_code ec;
+  if (std::filesystem::file_size(path, ec) > StreamingBytes) {
+    auto stream = std::make_shared<libvrm::bvh::BvhStream>();
+    if (!stream->Open(path)) {
+      PLOG_ERROR << "LoadMotion: " << path.string();
+      return false;
+    }
+    PLOG_INFO << "LoadMotion(stream): " << path.string();
+    auto node = CreateNode<BvhNode>(
+      "Bvh",
+      "SrcNode",
+      {},
+      std::vector<PinNameWithType>{ { "HumanPose", PinDataTypes::HumanPose } });
+    node->SetBvhStream(stream, FindHumanBoneMap(*stream->Header()));
+    return true;
   }
 
-  // load bvh
-  auto bvh = std::make_shared<libvrm::bvh::Bvh>();
-  if (auto parsed = bvh->Parse({ (const char*)bytes.data(), bytes.size() })) {
-  } else {
+  // load bvh. memory mapped
+  auto bvh = libvrm::bvh::Bvh::FromFile(path);
+  if (!bvh) {
     PLOG_ERROR << "LoadMotion: " << path.string();
-    // PLOG_ERROR << "LoadMotion: " << parsed.error();
     return false;
   }
   auto scaling = bvh->GuessScaling();
   PLOG_INFO << "LoadMotion: " << scaling << ", " << path.string();
+  if (bvh->BakedBytes() <= BakingBytes) {
+    // quaternion per joint per frame
+    bvh->Bake(scaling);
+  }
 
   auto node = CreateNode<BvhNode>(
     "Bvh",
@@ -249,6 +269,25 @@ HumanPoseStream::LoadMotion(const std::filesystem::path& path)
   return true;
 }
 
+bool
+HumanPoseStream::LoadRecord(const std::filesystem::path& path)
+{
+  auto replay = std::make_shared<libvrm::srht::PacketReplay>();
+  if (!replay->Open(path)) {
+    PLOG_ERROR << "LoadRecord: " << path.string();
+    return false;
+  }
+  PLOG_INFO << "LoadRecord: " << replay->Size() << " packets, "
+            << path.string();
+  auto node = CreateNode<ReplayNode>(
+    "Replay",
+    "SrcNode",
+    {},
+    std::vector<PinNameWithType>{ { "HumanPose", PinDataTypes::HumanPose } });
+  node->SetReplay(replay);
+  return true;
+}
+
 bool
 HumanPoseStream::LoadVrmPose(const std::string& json)
 {
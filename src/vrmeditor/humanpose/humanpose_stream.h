@@ -5,7 +5,6 @@
 #include <vrm/bvh/humanbone_map.h>
 
 class Cuber;
-class UdpReceiver;
 
 namespace humanpose {
 using HumanPoseFunc = std::function<bool(const libvrm::HumanPose& pose)>;
@@ -102,7 +101,13 @@ public:
     return {};
   }
 
+  // larger bvh is streamed
+  size_t StreamingBytes = 64 * 1024 * 1024;
+  // baked on load if the baked frames fit. larger bvh uses the pose cache
+  size_t BakingBytes = 32 * 1024 * 1024;
   bool LoadMotion(const std::filesystem::path& path);
+  // SRHT packets recorded by UdpNode
+  bool LoadRecord(const std::filesystem::path& path);
   bool LoadVrmPose(const std::string &json);
   void ShowGui();
   void Update(libvrm::Time time, std::shared_ptr<GraphNodeBase> node = {});
@@ -0,0 +1,205 @@
+#include "replaynode.h"
+#include <algorithm>
+#include <imgui.h>
+#include <string_view>
+#include <vrm/gltfroot.h>
+#include <vrm/humanoid/humanpose.h>
+#include <vrm/runtime_node.h>
+#include <vrm/runtime_scene.h>
+
+namespace humanpose {
+
+static bool
+IsSkeleton(std::span<const uint8_t> data)
+{
+  return data.size() >= 8 &&
+         std::string_view((const char*)data.data(), 8) ==
+           libvrm::srht::SRHT_SKELETON_MAGIC1;
+}
+
+// constructor
+ReplayNode::ReplayNode(int id, std::string_view name)
+  : GraphNodeBase(id, name)
+{
+  auto table = std::make_shared<libvrm::GltfRoot>();
+  m_scene = libvrm::RuntimeScene::Load(table);
+  m_state.Rotations.reserve(256);
+}
+
+void
+ReplayNode::SetReplay(
+  const std::shared_ptr<libvrm::srht::PacketReplay>& replay)
+{
+  m_replay = replay;
+  Seek({});
+}
+
+void
+ReplayNode::Seek(std::chrono::nanoseconds time)
+{
+  m_cursor = time;
+  m_next = m_replay ? m_replay->Seek(time) : 0;
+  // delta frames wait a keyframe
+  m_state.Rotations.clear();
+  if (!m_replay) {
+    return;
+  }
+  // the last skeleton before
+  for (auto i = m_next; i-- > 0;) {
+    auto packet = m_replay->Packet(i);
+    if (IsSkeleton(packet.Data) &&
+        libvrm::srht::PeekSkeletonId(packet.Data) == m_skeletonId) {
+      if (libvrm::srht::DecodeSkeleton(packet.Data, &m_skeleton)) {
+        SetSkeleton();
+      }
+      break;
+    }
+  }
+}
+
+void
+ReplayNode::SetSkeleton()
+{
+  libvrm::srht::BuildScene(m_scene->m_base, m_skeleton);
+  m_scene->Reset();
+  m_state.Rotations.clear();
+}
+
+bool
+ReplayNode::Process(const libvrm::srht::RecordedPacket& packet)
+{
+  ++m_packets;
+  auto id = libvrm::srht::PeekSkeletonId(packet.Data);
+  if (!id) {
+    ++m_errors;
+    return false;
+  }
+  if (*id != m_skeletonId) {
+    return false;
+  }
+  if (IsSkeleton(packet.Data)) {
+    if (libvrm::srht::DecodeSkeleton(packet.Data, &m_skeleton)) {
+      SetSkeleton();
+    } else {
+      ++m_errors;
+    }
+    return false;
+  }
+  if (libvrm::srht::DecodeFrame(packet.Data, &m_state)) {
+    ++m_frames;
+    return true;
+  }
+  // a delta frame before the keyframe too
+  ++m_errors;
+  return false;
+}
+
+void
+ReplayNode::TimeUpdate(libvrm::Time time)
+{
+  if (!m_replay || m_replay->Size() == 0) {
+    return;
+  }
+
+  auto delta = m_lastTime ? time - *m_lastTime : libvrm::Time{};
+  m_lastTime = time;
+  if (delta.count() < 0) {
+    // the timeline is rewound
+    Seek({});
+    delta = {};
+  }
+
+  size_t end;
+  switch (m_mode) {
+    case ReplayMode::Original:
+      m_cursor += std::chrono::duration_cast<std::chrono::nanoseconds>(delta);
+      end = m_replay->Seek(m_cursor + std::chrono::nanoseconds(1));
+      break;
+    case ReplayMode::Accelerated:
+      m_cursor +=
+        std::chrono::duration_cast<std::chrono::nanoseconds>(delta * m_speed);
+      end = m_replay->Seek(m_cursor + std::chrono::nanoseconds(1));
+      break;
+    default:
+      end = std::min(m_next + std::max(m_batch, 1), m_replay->Size());
+      break;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  auto count = end - std::min(m_next, end);
+  bool updated = false;
+  for (; m_next < end; ++m_next) {
+    if (Process(m_replay->Packet(m_next))) {
+      updated = true;
+    }
+  }
+  auto elapsed = std::chrono::duration<double>(
+                   std::chrono::steady_clock::now() - start)
+                   .count();
+  if (count && elapsed > 0) {
+    m_packetsPerSecond = count / elapsed;
+  }
+  if (m_mode == ReplayMode::AsFastAsPossible) {
+    m_cursor = m_next < m_replay->Size() ? m_replay->Packet(m_next).Time
+                                         : m_replay->Duration();
+  }
+
+  if (m_next >= m_replay->Size() && m_loop) {
+    Seek({});
+  }
+
+  if (!updated || m_scene->m_roots.empty() ||
+      m_state.Rotations.size() != m_scene->m_nodes.size()) {
+    return;
+  }
+  for (size_t i = 0; i < m_state.Rotations.size(); ++i) {
+    m_scene->m_nodes[i]->Transform.Rotation = m_state.Rotations[i];
+  }
+  m_scene->m_roots[0]->Transform.Translation = m_state.RootPosition;
+  m_scene->m_roots[0]->CalcWorldMatrix(true);
+  Outputs[0].Value = m_scene->UpdateHumanPose();
+}
+
+void
+ReplayNode::DrawContent()
+{
+  if (!m_replay) {
+    return;
+  }
+  auto duration = std::chrono::duration<float>(m_replay->Duration()).count();
+  ImGui::Text("%zu packets, %.1f s", m_replay->Size(), duration);
+
+  ImGui::SetNextItemWidth(NodeWidth * 0.5f);
+  if (ImGui::InputInt("skeletonId", &m_skeletonId)) {
+    m_skeletonId = std::clamp(m_skeletonId, 0, 0xFFFF);
+    Seek(m_cursor);
+  }
+
+  ImGui::SetNextItemWidth(NodeWidth * 0.5f);
+  ImGui::Combo("mode",
+               (int*)&m_mode,
+               "original\0accelerated\0as fast as possible\0");
+  ImGui::SetNextItemWidth(NodeWidth * 0.5f);
+  if (m_mode == ReplayMode::Accelerated) {
+    ImGui::SliderFloat("speed", &m_speed, 0.1f, 16.0f);
+  } else if (m_mode == ReplayMode::AsFastAsPossible) {
+    ImGui::InputInt("packets/update", &m_batch);
+  }
+  ImGui::Checkbox("loop", &m_loop);
+
+  auto seconds = std::chrono::duration<float>(m_cursor).count();
+  ImGui::SetNextItemWidth(NodeWidth);
+  if (ImGui::SliderFloat("##time", &seconds, 0, duration, "%.2f s")) {
+    Seek(std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::duration<float>(seconds)));
+  }
+
+  ImGui::Text("%zu joints", m_scene->m_nodes.size());
+  ImGui::Text("packets: %llu, frames: %llu, errors: %llu",
+              (unsigned long long)m_packets,
+              (unsigned long long)m_frames,
+              (unsigned long long)m_errors);
+  ImGui::Text("decode: %.0f packets/s", m_packetsPerSecond);
+}
+
+} // namespace
@@ -0,0 +1,64 @@
+#pragma once
+#include "graphnode_base.h"
+#include <chrono>
+#include <optional>
+#include <vrm/network/srht_record.h>
+#include <vrm/network/srht_update.h>
+
+namespace libvrm {
+struct RuntimeScene;
+}
+
+namespace humanpose {
+
+enum class ReplayMode
+{
+  // the recorded timing
+  Original,
+  // the recorded timing x Speed
+  Accelerated,
+  // Batch packets per update. for throughput measurement
+  AsFastAsPossible,
+};
+
+// play a skeletonId of a SRHT recording
+struct ReplayNode : public GraphNodeBase
+{
+  std::shared_ptr<libvrm::srht::PacketReplay> m_replay;
+  int m_skeletonId = 0;
+  ReplayMode m_mode = ReplayMode::Original;
+  float m_speed = 2.0f;
+  int m_batch = 1000;
+  bool m_loop = true;
+
+  // next packet
+  size_t m_next = 0;
+  // recording time
+  std::chrono::nanoseconds m_cursor = {};
+  std::optional<libvrm::Time> m_lastTime;
+
+  // delta frames are applied to this
+  libvrm::srht::FrameData m_state;
+  libvrm::srht::SkeletonData m_skeleton;
+  std::shared_ptr<libvrm::RuntimeScene> m_scene;
+
+  uint64_t m_packets = 0;
+  uint64_t m_frames = 0;
+  uint64_t m_errors = 0;
+  // decode throughput of the last update
+  double m_packetsPerSecond = 0;
+
+  // constructor
+  ReplayNode(int id, std::string_view name);
+  void SetReplay(const std::shared_ptr<libvrm::srht::PacketReplay>& replay);
+  void Seek(std::chrono::nanoseconds time);
+  void TimeUpdate(libvrm::Time time) override;
+  void DrawContent() override;
+
+private:
+  // true if a frame of m_skeletonId is decoded
+  bool Process(const libvrm::srht::RecordedPacket& packet);
+  void SetSkeleton();
+};
+
+} // namespace
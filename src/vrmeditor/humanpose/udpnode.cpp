@@ -0,0 +1,393 @@
+#include "udpnode.h"
+#include "humanpose_stream.h"
+#include <cstdio>
+#include <ctime>
+#include <imgui.h>
+#include <map>
+#include <misc/cpp/imgui_stdlib.h>
+#include <optional>
+#include <plog/Log.h>
+#include <vrm/gltfroot.h>
+#include <vrm/humanoid/humanpose.h>
+#include <vrm/runtime_node.h>
+#include <vrm/runtime_scene.h>
+
+namespace humanpose {
+
+// one socket and one io thread per port, for any number of skeletons.
+// the socket is opened by the listen button
+static std::shared_ptr<libvrm::srht::UdpReceiver>
+GetReceiver(uint16_t port)
+{
+  static std::map<uint16_t, std::weak_ptr<libvrm::srht::UdpReceiver>>
+    s_receivers;
+  if (auto receiver = s_receivers[port].lock()) {
+    return receiver;
+  }
+  auto receiver = std::make_shared<libvrm::srht::UdpReceiver>();
+  s_receivers[port] = receiver;
+  return receiver;
+}
+
+// one reader thread per segment
+static std::shared_ptr<libvrm::srht::ShmReceiver>
+GetShmReceiver(const std::string& name)
+{
+  static std::map<std::string, std::weak_ptr<libvrm::srht::ShmReceiver>>
+    s_receivers;
+  if (auto receiver = s_receivers[name].lock()) {
+    return receiver;
+  }
+  auto receiver = std::make_shared<libvrm::srht::ShmReceiver>();
+  if (!receiver->Start(name)) {
+    // the writer is not started yet
+    PLOG_WARNING << "UdpNode: fail to open shm " << name;
+  }
+  s_receivers[name] = receiver;
+  return receiver;
+}
+
+// constructor
+UdpNode::UdpNode(int id, std::string_view name)
+  : GraphNodeBase(id, name)
+{
+  auto table = std::make_shared<libvrm::GltfRoot>();
+  m_scene = libvrm::RuntimeScene::Load(table);
+  m_frame.Rotations.reserve(libvrm::srht::UdpReceiver::JointCapacity);
+}
+
+UdpNode::~UdpNode()
+{
+  StopRecording();
+  Release();
+}
+
+void
+UdpNode::Listen(uint16_t port)
+{
+  StopRecording();
+  Release();
+  m_useShm = false;
+  m_port = port;
+  m_receiver = GetReceiver(port);
+}
+
+void
+UdpNode::OpenShm(const std::string& name)
+{
+  StopRecording();
+  Release();
+  m_useShm = true;
+  m_shmName = name;
+  m_receiver = GetShmReceiver(name);
+}
+
+void
+UdpNode::SetSkeletonId(uint16_t skeletonId)
+{
+  Release();
+  m_skeletonId = skeletonId;
+}
+
+bool
+UdpNode::StartRecording(const std::filesystem::path& path)
+{
+  if (!m_receiver) {
+    return false;
+  }
+  static std::map<libvrm::srht::Receiver*, std::weak_ptr<Recording>>
+    s_recordings;
+  if (auto recording = s_recordings[m_receiver.get()].lock()) {
+    // started by an other node of the receiver
+    m_recording = recording;
+    return true;
+  }
+  auto recorder = std::make_shared<libvrm::srht::PacketRecorder>();
+  if (!recorder->Open(path)) {
+    PLOG_ERROR << "UdpNode: fail to record " << path.string();
+    return false;
+  }
+  PLOG_INFO << "UdpNode: record " << path.string();
+  m_receiver->SetRecorder(recorder);
+  m_recording.reset(new Recording{ m_receiver, recorder });
+  s_recordings[m_receiver.get()] = m_recording;
+  return true;
+}
+
+void
+UdpNode::StopRecording()
+{
+  // the other nodes of the receiver may keep recording
+  m_recording.reset();
+}
+
+bool
+UdpNode::Claim()
+{
+  if (!m_receiver) {
+    return false;
+  }
+  auto source = m_receiver->FindStream(static_cast<uint16_t>(m_skeletonId));
+  if (!source || source->Claimed) {
+    // not received yet or used by an other node
+    return false;
+  }
+  source->Claimed = true;
+  m_source = source;
+  m_stream = {};
+  m_mismatch = 0;
+  m_latency.Clear();
+
+  // the skeleton may be consumed by the previous node
+  source->Skeleton.Consume();
+  if (source->Skeleton.Front().Generation) {
+    SetSkeleton(source->Skeleton.Front());
+  }
+  return true;
+}
+
+void
+UdpNode::Release()
+{
+  if (m_source) {
+    m_source->PublishPose = false;
+    m_source->Claimed = false;
+    m_source = nullptr;
+  }
+  m_jitter.Clear();
+}
+
+void
+UdpNode::SetSkeleton(const libvrm::srht::ReceivedSkeleton& skeleton)
+{
+  libvrm::srht::BuildScene(m_scene->m_base, skeleton);
+  m_scene->Reset();
+  m_jitter.Clear();
+}
+
+void
+UdpNode::TimeUpdate(libvrm::Time time)
+{
+  if (!m_source && !Claim()) {
+    return;
+  }
+
+  if (m_source->Skeleton.Consume()) {
+    SetSkeleton(m_source->Skeleton.Front());
+  }
+  // without the jitter buffer, the latest pose is converted on the io thread
+  m_source->PublishPose = !m_useJitterBuffer;
+
+  // drain all frames in order
+  auto now = std::chrono::steady_clock::now();
+  std::optional<std::chrono::steady_clock::time_point> newest;
+  while (auto frame = m_source->Frames.Front()) {
+    if (frame->Rotations.size() == m_scene->m_nodes.size()) {
+      if (m_useJitterBuffer) {
+        m_jitter.Push(*frame, frame->Received);
+      }
+      m_stream = frame->Stats;
+      newest = frame->Received;
+    } else {
+      ++m_mismatch;
+    }
+    m_source->Frames.Pop();
+  }
+
+  if (m_useJitterBuffer) {
+    if (!m_jitter.Sample(now, &m_frame)) {
+      return;
+    }
+    if (m_scene->m_roots.empty() ||
+        m_frame.Rotations.size() != m_scene->m_nodes.size()) {
+      return;
+    }
+    for (size_t i = 0; i < m_frame.Rotations.size(); ++i) {
+      m_scene->m_nodes[i]->Transform.Rotation = m_frame.Rotations[i];
+    }
+    m_scene->m_roots[0]->Transform.Translation = m_frame.RootPosition;
+    m_scene->m_roots[0]->CalcWorldMatrix(true);
+    Outputs[0].Value = m_scene->UpdateHumanPose();
+  } else {
+    if (!m_source->Pose.Consume()) {
+      // keep the last pose
+      return;
+    }
+    // valid until the next Consume
+    Outputs[0].Value = m_source->Pose.Latest().GetPose();
+  }
+
+  if (newest) {
+    m_latency.Push(std::chrono::duration<double, std::milli>(
+                     std::chrono::steady_clock::now() - *newest)
+                     .count());
+  }
+}
+
+void
+UdpNode::DrawContent()
+{
+  int transport = m_useShm ? 1 : 0;
+  ImGui::SetNextItemWidth(NodeWidth * 0.5f);
+  if (ImGui::Combo("transport", &transport, "udp\0shm\0")) {
+    if (transport) {
+      OpenShm(m_shmName);
+    } else {
+      Listen(static_cast<uint16_t>(m_port));
+    }
+  }
+
+  if (m_useShm) {
+    ImGui::SetNextItemWidth(NodeWidth * 0.5f);
+    ImGui::InputText("name", &m_shmName);
+    auto shm = dynamic_cast<libvrm::srht::ShmReceiver*>(m_receiver.get());
+    if (shm && shm->IsRunning() && shm->Name() == m_shmName) {
+      if (ImGui::Button("stop")) {
+        // other nodes of the name are also stopped
+        shm->Stop();
+      }
+    } else {
+      if (ImGui::Button("open")) {
+        OpenShm(m_shmName);
+        shm = dynamic_cast<libvrm::srht::ShmReceiver*>(m_receiver.get());
+        if (!shm->IsRunning() && !shm->Start(m_shmName)) {
+          PLOG_WARNING << "UdpNode: fail to open shm " << m_shmName;
+        }
+      }
+    }
+  } else {
+    ImGui::SetNextItemWidth(NodeWidth * 0.5f);
+    ImGui::InputInt("port", &m_port, 0);
+    ImGui::Checkbox("loopback only", &m_loopback);
+    auto udp = dynamic_cast<libvrm::srht::UdpReceiver*>(m_receiver.get());
+    if (udp && udp->IsRunning() && udp->Port() == m_port) {
+      if (ImGui::Button("stop")) {
+        // other nodes of the port are also stopped
+        udp->Stop();
+      }
+    } else {
+      if (ImGui::Button("listen")) {
+        auto port = static_cast<uint16_t>(m_port);
+        Listen(port);
+        udp = dynamic_cast<libvrm::srht::UdpReceiver*>(m_receiver.get());
+        if (!udp->IsRunning() && !udp->Start(port, m_loopback)) {
+          PLOG_WARNING << "UdpNode: fail to listen " << m_port;
+        }
+      }
+    }
+  }
+
+  if (m_recording) {
+    auto& recorder = m_recording->Recorder;
+    ImGui::Text("rec: %llu packets, %.1f MB, %ld nodes",
+                (unsigned long long)recorder->Count(),
+                recorder->Bytes() / (1024.0 * 1024.0),
+                m_recording.use_count());
+    if (ImGui::Button("stop recording")) {
+      StopRecording();
+    }
+  } else if (m_receiver && ImGui::Button("record")) {
+    char path[64];
+    snprintf(path,
+             sizeof(path),
+             "srht_%lld.srhtrec",
+             static_cast<long long>(std::time(nullptr)));
+    StartRecording(path);
+  }
+
+  ImGui::SetNextItemWidth(NodeWidth * 0.5f);
+  if (ImGui::InputInt("skeletonId", &m_skeletonId)) {
+    SetSkeletonId(static_cast<uint16_t>(std::clamp(m_skeletonId, 0, 0xFFFF)));
+  }
+  if (!m_receiver) {
+    return;
+  }
+
+  // skeletonIds on the port without a node
+  for (size_t i = 0; i < m_receiver->StreamCount(); ++i) {
+    auto source = m_receiver->Stream(i);
+    if (source->Claimed || source->SkeletonId == m_skeletonId) {
+      continue;
+    }
+    char label[32];
+    snprintf(label, sizeof(label), "+%u", source->SkeletonId);
+    if (ImGui::Button(label)) {
+      auto node = HumanPoseStream::Instance().CreateNode<UdpNode>(
+        Name,
+        Prefix,
+        {},
+        std::vector<PinNameWithType>{
+          { "HumanPose", PinDataTypes::HumanPose } });
+      if (m_useShm) {
+        node->OpenShm(m_shmName);
+      } else {
+        node->Listen(static_cast<uint16_t>(m_port));
+      }
+      node->SetSkeletonId(source->SkeletonId);
+    }
+    ImGui::SameLine();
+  }
+  ImGui::NewLine();
+
+  auto stats = m_receiver->Stats();
+  ImGui::Text("%zu skeletons, %zu joints",
+              m_receiver->StreamCount(),
+              m_scene->m_nodes.size());
+  ImGui::Text("packets: %llu, errors: %llu, rejected: %llu",
+              (unsigned long long)stats.Packets,
+              (unsigned long long)stats.Errors,
+              (unsigned long long)stats.Rejected);
+  ImGui::Text("frames: %llu, skipped: %llu, overflow: %llu",
+              (unsigned long long)stats.Frames,
+              (unsigned long long)m_mismatch,
+              (unsigned long long)stats.Overflow);
+  if (m_useShm) {
+    // the writer went round the ring
+    ImGui::Text("lost: %llu", (unsigned long long)stats.Lost);
+  }
+  if (!m_source) {
+    ImGui::TextUnformatted(m_receiver->FindStream(m_skeletonId)
+                             ? "used by an other node"
+                             : "waiting the skeletonId");
+    return;
+  }
+
+  auto& stream = m_stream;
+  ImGui::Text("%.1f kB/s, %.0f bytes/frame",
+              stream.BytesPerSecond / 1024,
+              stream.BytesPerFrame());
+  ImGui::Text("%.0f%% joints, keyframes: %llu",
+              stream.RotationRatio() * 100,
+              (unsigned long long)stream.Keyframes);
+  ImGui::Text("latency: %.2f, avg %.2f, max %.2f ms",
+              m_latency.Last,
+              m_latency.Average,
+              m_latency.Max);
+  if (ImGui::Button("reset")) {
+    m_latency.Clear();
+  }
+
+  ImGui::Checkbox("jitter buffer", &m_useJitterBuffer);
+  if (!m_useJitterBuffer) {
+    // overwritten on the io thread before consumed
+    ImGui::Text("dropped: %llu",
+                (unsigned long long)m_source->Pose.Dropped());
+  } else {
+    auto& jitter = m_jitter.Stats();
+    ImGui::Text("delay: %.1f (%.1f) ms, %zu frames",
+                jitter.Delay,
+                jitter.TargetDelay,
+                m_jitter.Size());
+    ImGui::Text("jitter: %.2f ms, interval: %.2f ms",
+                jitter.Jitter,
+                jitter.Interval);
+    ImGui::Text("lost: %llu, late: %llu",
+                (unsigned long long)jitter.Lost,
+                (unsigned long long)jitter.Late);
+    ImGui::Text("extrapolated: %llu, underrun: %llu",
+                (unsigned long long)jitter.Extrapolated,
+                (unsigned long long)jitter.Underrun);
+  }
+}
+
+} // namespace
@@ -0,0 +1,95 @@
+#pragma once
+#include "graphnode_base.h"
+#include <algorithm>
+#include <memory>
+#include <vrm/network/srht_jitter.h>
+#include <vrm/network/srht_receiver.h>
+#include <vrm/network/srht_record.h>
+#include <vrm/network/srht_shm.h>
+
+namespace libvrm {
+struct RuntimeScene;
+}
+
+namespace humanpose {
+
+// milliseconds
+struct LatencyStats
+{
+  double Last = 0;
+  double Average = 0;
+  double Max = 0;
+  uint64_t Count = 0;
+
+  void Push(double ms)
+  {
+    Last = ms;
+    // exponential moving average
+    Average = Count ? Average + (ms - Average) * 0.05 : ms;
+    Max = std::max(Max, ms);
+    ++Count;
+  }
+  void Clear() { *this = {}; }
+};
+
+// all packets of a receiver. shared by the nodes of the receiver, and
+// detached from it when the last node stops recording
+struct Recording
+{
+  std::shared_ptr<libvrm::srht::Receiver> Receiver;
+  std::shared_ptr<libvrm::srht::PacketRecorder> Recorder;
+
+  ~Recording()
+  {
+    // the file is closed when the io thread releases it
+    Receiver->SetRecorder({});
+  }
+};
+
+// a skeletonId of the SRHT receiver. udp, or shared memory for a producer
+// on the same host. nodes of the same port or name share a receiver.
+// frames are played out through the jitter buffer
+struct UdpNode : public GraphNodeBase
+{
+  bool m_useShm = false;
+  int m_port = 54345;
+  // other hosts can not send
+  bool m_loopback = true;
+  std::string m_shmName = "srht";
+  int m_skeletonId = 0;
+  std::shared_ptr<libvrm::srht::Receiver> m_receiver;
+  // claimed by this node
+  libvrm::srht::ReceiverStream* m_source = nullptr;
+  // all packets of the port
+  std::shared_ptr<Recording> m_recording;
+  bool m_useJitterBuffer = true;
+  libvrm::srht::JitterBuffer m_jitter;
+  // applied to m_scene
+  libvrm::srht::FrameData m_frame;
+  libvrm::srht::StreamStats m_stream;
+  std::shared_ptr<libvrm::RuntimeScene> m_scene;
+  // frame is skipped until the skeleton arrives
+  uint64_t m_mismatch = 0;
+  // packet arrival to pose output
+  LatencyStats m_latency;
+
+  // constructor
+  UdpNode(int id, std::string_view name);
+  ~UdpNode();
+  // share the receiver of the port
+  void Listen(uint16_t port);
+  // share the reader of the shared memory
+  void OpenShm(const std::string& name);
+  void SetSkeletonId(uint16_t skeletonId);
+  bool StartRecording(const std::filesystem::path& path);
+  void StopRecording();
+  void TimeUpdate(libvrm::Time time) override;
+  void DrawContent() override;
+
+private:
+  bool Claim();
+  void Release();
+  void SetSkeleton(const libvrm::srht::ReceivedSkeleton& skeleton);
+};
+
+} // namespace
@@ -2,10 +2,17 @@
 #include <gltfjson.h>
 #include <grapho/imgui/printfbuffer.h>
 #include <grapho/imgui/widgets.h>
+#include <vrm/animation_layer.h>
+#include <vrm/compressed_animation.h>
+#include <vrm/keyframe_reducer.h>
+#include <vrm/pose_cache.h>
 
 struct AnimationViewImpl
 {
   uint32_t m_selected = -1;
+  bool m_compressed = false;
+  libvrm::KeyframeTolerance m_tolerance;
+  libvrm::KeyframeReduction m_reduction;
   std::shared_ptr<libvrm::RuntimeScene> m_runtime;
 
   void SetRuntime(const std::shared_ptr<libvrm::RuntimeScene>& runtime)
@@ -45,6 +52,29 @@ struct AnimationViewImpl
       }
 
       ImGui::Text("%lf", m_runtime->m_timeline->CurrentTime.count());
+
+      // 16bit quantized clip
+      if (ImGui::Checkbox("compressed", &m_compressed)) {
+        m_runtime->SetActiveAnimation(m_selected, m_compressed);
+      }
+      if (m_compressed) {
+        if (auto compressed =
+              m_runtime->GetOrCreateCompressedAnimation(m_selected)) {
+          auto& stats = compressed->Stats;
+          ImGui::Text("%zu => %zu bytes (x%.1f), %u constant tracks",
+                      stats.RawBytes,
+                      stats.CompressedBytes,
+                      stats.Ratio(),
+                      stats.ConstantTracks);
+          ImGui::Text("max error: t %.5f, r %.4f deg, s %.5f, w %.5f",
+                      stats.MaxTranslationError,
+                      DirectX::XMConvertToDegrees(stats.MaxRotationError),
+                      stats.MaxScaleError,
+                      stats.MaxWeightError);
+        }
+      }
+
+      ShowReduce();
     }
 
     std::array<const char*, 3> cols = {
@@ -70,7 +100,8 @@ struct AnimationViewImpl
                   buf.Printf("%s##_animation_%d", (const char*)name.c_str(), i),
                   i == m_selected)) {
               m_selected = i;
-              m_runtime->SetActiveAnimation(i);
+              m_reduction = {};
+              m_runtime->SetActiveAnimation(i, m_compressed);
             }
 
             ImGui::TableNextColumn();
@@ -94,6 +125,127 @@ struct AnimationViewImpl
       }
       ImGui::EndTable();
     }
+
+    ShowPoseCache();
+    ShowLayers();
+  }
+
+  void ShowReduce()
+  {
+    ImGui::SetNextItemWidth(100);
+    ImGui::InputFloat("pos m", &m_tolerance.Position, 0, 0, "%.4f");
+    ImGui::SameLine();
+    float degrees = DirectX::XMConvertToDegrees(m_tolerance.Angle);
+    ImGui::SetNextItemWidth(100);
+    if (ImGui::InputFloat("rot deg", &degrees, 0, 0, "%.3f")) {
+      m_tolerance.Angle = DirectX::XMConvertToRadians(degrees);
+    }
+    ImGui::SetNextItemWidth(100);
+    ImGui::InputFloat("scale", &m_tolerance.Scale, 0, 0, "%.4f");
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(100);
+    ImGui::InputFloat("weight", &m_tolerance.Weight, 0, 0, "%.4f");
+    if (ImGui::Button("reduce keys")) {
+      m_reduction = m_runtime->ReduceAnimation(m_selected, m_tolerance);
+      m_runtime->SetActiveAnimation(m_selected, m_compressed);
+    }
+    if (m_reduction.Before) {
+      ImGui::SameLine();
+      ImGui::Text("%zu => %zu keys", m_reduction.Before, m_reduction.After);
+    }
+  }
+
+  void ShowPoseCache()
+  {
+    auto cache = m_runtime->m_poseCache;
+    if (!cache) {
+      return;
+    }
+    int mb = static_cast<int>(cache->Budget / (1024 * 1024));
+    ImGui::SetNextItemWidth(100);
+    if (ImGui::SliderInt("cache MB", &mb, 1, 256)) {
+      cache->Budget = static_cast<size_t>(mb) * 1024 * 1024;
+    }
+    ImGui::SameLine();
+    ImGui::Text("%zu poses, %zu KB, hit %.1f%%",
+                cache->Size(),
+                cache->Bytes() / 1024,
+                cache->Stats.HitRate() * 100);
+    ImGui::SameLine();
+    if (ImGui::Button("clear")) {
+      cache->Clear();
+    }
+  }
+
+  void ShowLayers()
+  {
+    if (!ImGui::CollapsingHeader("Layers")) {
+      return;
+    }
+
+    if (m_selected < m_runtime->m_animations.size()) {
+      if (ImGui::Button("add selected")) {
+        if (!m_runtime->m_animationLayers) {
+          m_runtime->m_animationLayers =
+            std::make_shared<libvrm::AnimationLayerStack>();
+          m_runtime->m_animationLayers->Initialize(*m_runtime);
+        }
+        m_runtime->m_animationLayers->AddLayer(
+          *m_runtime, m_runtime->m_animations[m_selected]);
+      }
+      ImGui::SameLine();
+    }
+    if (ImGui::Button("play layers")) {
+      m_runtime->PlayAnimationLayers();
+    }
+
+    auto layers = m_runtime->m_animationLayers;
+    if (!layers) {
+      return;
+    }
+    static const libvrm::HumanBones s_upper[] = {
+      libvrm::HumanBones::spine,
+    };
+    static const libvrm::HumanBones s_lower[] = {
+      libvrm::HumanBones::leftUpperLeg,
+      libvrm::HumanBones::rightUpperLeg,
+    };
+    std::shared_ptr<libvrm::AnimationLayer> remove;
+    for (int i = 0; i < layers->Layers.size(); ++i) {
+      auto& layer = layers->Layers[i];
+      ImGui::PushID(i);
+      ImGui::Checkbox("##enabled", &layer->Enabled);
+      ImGui::SameLine();
+      ImGui::TextUnformatted(layer->Name.c_str());
+      ImGui::SetNextItemWidth(100);
+      ImGui::SliderFloat("weight", &layer->Weight, 0, 1);
+      ImGui::SameLine();
+      bool additive = layer->Mode == libvrm::AnimationBlendModes::Additive;
+      if (ImGui::Checkbox("additive", &additive)) {
+        layer->Mode = additive ? libvrm::AnimationBlendModes::Additive
+                               : libvrm::AnimationBlendModes::Override;
+      }
+      ImGui::SameLine();
+      if (ImGui::Button("all")) {
+        libvrm::AnimationLayerStack::SetBoneMask(*layer, *m_runtime, {});
+      }
+      ImGui::SameLine();
+      if (ImGui::Button("upper")) {
+        libvrm::AnimationLayerStack::SetBoneMask(*layer, *m_runtime, s_upper);
+      }
+      ImGui::SameLine();
+      if (ImGui::Button("lower")) {
+        libvrm::AnimationLayerStack::SetBoneMask(*layer, *m_runtime, s_lower);
+      }
+      ImGui::SameLine();
+      if (ImGui::Button("x")) {
+        remove = layer;
+      }
+      ImGui::PopID();
+    }
+    if (remove) {
+      layers->RemoveLayer(remove);
+    }
   }
 };
 
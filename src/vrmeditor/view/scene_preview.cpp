@@ -21,6 +21,7 @@ struct ScenePreviewImpl
   std::shared_ptr<glr::RenderingEnv> m_env;
   std::shared_ptr<glr::ViewSettings> m_settings;
   std::shared_ptr<glr::SceneRenderer> m_renderer;
+  std::shared_ptr<libvrm::RuntimeScene> m_runtime;
   bool m_showSpring = false;
 
   glr::RenderFunc m_show;
@@ -47,6 +48,7 @@ struct ScenePreviewImpl
       m_env->SetShadowHeight(min.y);
     }
 
+    m_runtime = {};
     m_showSpring = false;
   }
 
@@ -64,9 +66,41 @@ struct ScenePreviewImpl
       m_env->SetShadowHeight(min.y);
     }
 
+    m_runtime = runtime;
     m_showSpring = true;
   }
 
+  void ShowSpringTimestep()
+  {
+    if (!m_runtime) {
+      return;
+    }
+    auto& timestep = m_runtime->m_springTimestep;
+    ImGui::SetNextItemWidth(80);
+    if (ImGui::BeginCombo("##spring_rate",
+                          (std::to_string(timestep.Rate) + "Hz").c_str())) {
+      for (auto rate : { 60, 90, 120 }) {
+        if (ImGui::Selectable((std::to_string(rate) + "Hz").c_str(),
+                              rate == timestep.Rate)) {
+          timestep.Rate = rate;
+          timestep.Reset();
+        }
+      }
+      ImGui::EndCombo();
+    }
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(80);
+    ImGui::SliderInt("substeps", &timestep.MaxSubSteps, 1, 8);
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(80);
+    ImGui::DragFloat("lod px", &m_settings->SpringLodPixels, 1, 0, 512);
+    ImGui::SameLine();
+    ImGui::Text("active %d, sleep %d, lod %d",
+                m_settings->SpringActive,
+                m_settings->SpringSleeping,
+                m_settings->SpringLodReduced);
+  }
+
   void ShowScreenRect(const char* title,
                       const float color[4],
                       float x,
@@ -110,6 +144,8 @@ struct ScenePreviewImpl
     if (m_showSpring) {
       ImGui::SameLine();
       ImGui::Checkbox("spring", &m_renderer->m_settings->ShowSpring);
+      ImGui::SameLine();
+      ShowSpringTimestep();
     }
     ShowFullWindow(m_title.c_str(), m_clear.data());
   }
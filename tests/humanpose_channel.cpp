@@ -0,0 +1,105 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+#include <vrm/humanoid/humanpose_channel.h>
+
+using namespace libvrm;
+
+// every rotation is { value, value, value, 1 }
+struct TestPose
+{
+  std::vector<HumanBones> Bones;
+  std::vector<DirectX::XMFLOAT4> Rotations;
+
+  TestPose(size_t count)
+  {
+    for (size_t i = 0; i < count; ++i) {
+      Bones.push_back(static_cast<HumanBones>(i));
+      Rotations.push_back({ 0, 0, 0, 1 });
+    }
+  }
+
+  HumanPose Get(float value)
+  {
+    for (auto& r : Rotations) {
+      r = { value, value, value, 1 };
+    }
+    return { { value, 0, 0 }, Bones, Rotations };
+  }
+};
+
+TEST(HumanPoseChannel, PublishConsume)
+{
+  HumanPoseChannel channel;
+  EXPECT_FALSE(channel.Consume());
+  EXPECT_EQ(channel.Latest().BoneCount, 0);
+
+  TestPose pose(20);
+  channel.Publish(pose.Get(1), Time(0.5));
+  ASSERT_TRUE(channel.Consume());
+  auto& latest = channel.Latest();
+  EXPECT_EQ(latest.Timestamp, Time(0.5));
+  EXPECT_EQ(latest.RootPosition.x, 1);
+  auto got = latest.GetPose();
+  ASSERT_EQ(got.Bones.size(), 20);
+  ASSERT_EQ(got.Rotations.size(), 20);
+  EXPECT_EQ(got.Bones[19], static_cast<HumanBones>(19));
+  EXPECT_EQ(got.Rotations[19].y, 1);
+  // nothing new
+  EXPECT_FALSE(channel.Consume());
+  EXPECT_EQ(channel.Dropped(), 0);
+
+  // the consumer takes the latest
+  channel.Publish(pose.Get(2), Time(1.0));
+  channel.Publish(pose.Get(3), Time(1.5));
+  channel.Publish(pose.Get(4), Time(2.0));
+  ASSERT_TRUE(channel.Consume());
+  EXPECT_EQ(channel.Latest().Timestamp, Time(2.0));
+  EXPECT_EQ(channel.Latest().Rotations[0].x, 4);
+  EXPECT_EQ(channel.Dropped(), 2);
+}
+
+TEST(HumanPoseChannel, Capacity)
+{
+  HumanPoseChannel channel;
+  TestPose pose(HumanPoseFrame::Capacity + 10);
+  channel.Publish(pose.Get(1), Time(0));
+  ASSERT_TRUE(channel.Consume());
+  EXPECT_EQ(channel.Latest().BoneCount, HumanPoseFrame::Capacity);
+}
+
+TEST(HumanPoseChannel, Threads)
+{
+  static constexpr int Count = 100000;
+  HumanPoseChannel channel;
+
+  std::thread producer([&channel]() {
+    TestPose pose(HumanPoseFrame::Capacity);
+    for (int i = 1; i <= Count; ++i) {
+      channel.Publish(pose.Get(static_cast<float>(i)), Time(i));
+    }
+  });
+
+  // a frame is never torn and never goes back
+  uint64_t consumed = 0;
+  double last = 0;
+  while (last < Count) {
+    if (!channel.Consume()) {
+      std::this_thread::yield();
+      continue;
+    }
+    ++consumed;
+    auto& latest = channel.Latest();
+    auto value = latest.Timestamp.count();
+    ASSERT_GT(value, last);
+    ASSERT_EQ(latest.BoneCount, HumanPoseFrame::Capacity);
+    for (size_t i = 0; i < latest.BoneCount; ++i) {
+      ASSERT_EQ(latest.Rotations[i].x, value) << i;
+    }
+    last = value;
+  }
+  producer.join();
+
+  EXPECT_FALSE(channel.Consume());
+  EXPECT_EQ(channel.Dropped(), Count - consumed);
+}
@@ -0,0 +1,117 @@
+#include <gtest/gtest.h>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <vrm/network/quat_packer.h>
+
+using namespace libvrm::quat_packer;
+
+// unit quaternions on a grid of x, y, z with both signs of w.
+// axis aligned, ties and negative zero are included
+static std::vector<std::array<float, 4>>
+Quaternions()
+{
+  std::vector<std::array<float, 4>> list;
+  const int N = 48;
+  for (int i = -N; i <= N; ++i) {
+    for (int j = -N; j <= N; ++j) {
+      for (int k = -N; k <= N; ++k) {
+        float x = float(i) / N;
+        float y = float(j) / N;
+        float z = float(k) / N;
+        auto l = x * x + y * y + z * z;
+        if (l > 1) {
+          auto s = 1 / std::sqrt(l);
+          list.push_back({ x * s, y * s, z * s, 0 });
+        } else {
+          auto w = std::sqrt(1 - l);
+          list.push_back({ x, y, z, w });
+          list.push_back({ x, y, z, -w });
+        }
+      }
+    }
+  }
+  for (auto v : { 0.5f, -0.5f }) {
+    list.push_back({ v, v, v, v });
+    list.push_back({ v, -v, v, -v });
+  }
+  for (auto v : { 0.70710678f, -0.70710678f }) {
+    list.push_back({ v, v, 0, 0 });
+    list.push_back({ 0, v, -v, 0 });
+    list.push_back({ 0, 0, v, v });
+    list.push_back({ v, 0, 0, -v });
+  }
+  list.push_back({ -0.0f, -0.0f, -0.0f, 1 });
+  list.push_back({ -0.0f, 1, -0.0f, -0.0f });
+  return list;
+}
+
+TEST(QuatPacker, PackBatch)
+{
+  auto list = Quaternions();
+  std::vector<uint32_t> packed(list.size());
+  PackBatch(list[0].data(), packed.data(), list.size());
+  for (size_t i = 0; i < list.size(); ++i) {
+    auto& q = list[i];
+    ASSERT_EQ(packed[i], Pack(q[0], q[1], q[2], q[3])) << i;
+  }
+}
+
+TEST(QuatPacker, UnpackBatch)
+{
+  // every drop, x0 and x1. x2 is sampled
+  std::vector<uint32_t> packed;
+  std::vector<float> unpacked;
+  for (uint32_t drop = 0; drop < 4; ++drop) {
+    for (uint32_t x0 = 0; x0 < 1024; ++x0) {
+      packed.clear();
+      for (uint32_t x1 = 0; x1 < 1024; ++x1) {
+        for (auto x2 : { 0u, 511u, 1023u, (x0 ^ x1) }) {
+          packed.push_back(x0 | (x1 << 10) | (x2 << 20) | (drop << 30));
+        }
+      }
+      unpacked.resize(packed.size() * 4);
+      UnpackBatch(packed.data(), unpacked.data(), packed.size());
+
+      for (size_t i = 0; i < packed.size(); ++i) {
+        float expected[4];
+        Unpack(packed[i], expected);
+        for (int j = 0; j < 4; ++j) {
+          auto actual = unpacked[i * 4 + j];
+          if (std::isnan(expected[j])) {
+            // out of the unit sphere
+            ASSERT_TRUE(std::isnan(actual)) << packed[i];
+          } else {
+            ASSERT_EQ(std::memcmp(&actual, &expected[j], sizeof(float)), 0)
+              << packed[i];
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST(QuatPacker, RoundTrip)
+{
+  auto list = Quaternions();
+  // not a multiple of 4. the tail is scalar
+  if (list.size() % 4 == 0) {
+    list.pop_back();
+  }
+  std::vector<uint32_t> packed(list.size());
+  PackBatch(list[0].data(), packed.data(), list.size());
+  std::vector<std::array<float, 4>> unpacked(list.size());
+  UnpackBatch(packed.data(), unpacked[0].data(), packed.size());
+
+  // the quantization step is 2 / 1023 / sqrt(2), truncated. about 0.5 deg
+  float maxAngle = 0;
+  for (size_t i = 0; i < list.size(); ++i) {
+    auto& a = list[i];
+    auto& b = unpacked[i];
+    auto dot = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+    auto angle = 2 * std::acos(std::min(1.0f, std::abs(dot)));
+    maxAngle = std::max(maxAngle, angle);
+  }
+  EXPECT_LT(maxAngle, 0.01f);
+}
@@ -0,0 +1,214 @@
+#include <gtest/gtest.h>
+#include <DirectXMath.h>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <vrm/network/srht_update.h>
+
+using namespace libvrm::srht;
+
+// magic + FrameHeader + body, as UdpSender gathers it
+static std::vector<uint8_t>
+MakePacket(FrameFlags flags, const std::vector<uint8_t>& body)
+{
+  std::vector<uint8_t> packet(8 + sizeof(FrameHeader));
+  std::memcpy(packet.data(), SRHT_FRAME_MAGIC1, 8);
+  FrameHeader header{
+    .time = 1000,
+    .flags = flags,
+    .skeletonId = 3,
+    .x = 1,
+    .y = 2,
+    .z = 3,
+  };
+  std::memcpy(packet.data() + 8, &header, sizeof(header));
+  packet.insert(packet.end(), body.begin(), body.end());
+  return packet;
+}
+
+struct Sender
+{
+  FrameEncoder Encoder;
+  SenderStream Stream;
+
+  std::vector<uint8_t> Encode(const std::vector<DirectX::XMFLOAT4>& rotations,
+                              const FrameEncoding& encoding,
+                              EncodedFrame* encoded = nullptr)
+  {
+    std::vector<uint8_t> body;
+    auto result = Encoder.Encode(Stream, rotations, encoding, body);
+    if (encoded) {
+      *encoded = result;
+    }
+    return MakePacket(result.Flags, body);
+  }
+};
+
+static bool
+IsKeyframe(const EncodedFrame& encoded)
+{
+  return (encoded.Flags & FrameFlags::DELTA) == FrameFlags::NONE;
+}
+
+static DirectX::XMFLOAT4
+RotationY(float degrees)
+{
+  DirectX::XMFLOAT4 q;
+  DirectX::XMStoreFloat4(
+    &q,
+    DirectX::XMQuaternionRotationAxis(DirectX::XMVectorSet(0, 1, 0, 0),
+                                      DirectX::XMConvertToRadians(degrees)));
+  return q;
+}
+
+// the angle between. q and -q are the same rotation
+static float
+AngleDegrees(const DirectX::XMFLOAT4& a, const DirectX::XMFLOAT4& b)
+{
+  auto dot = std::abs(a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w);
+  return DirectX::XMConvertToDegrees(2 * std::acos(std::min(dot, 1.0f)));
+}
+
+static std::vector<DirectX::XMFLOAT4>
+Pose(size_t count, float degrees)
+{
+  std::vector<DirectX::XMFLOAT4> rotations;
+  for (size_t i = 0; i < count; ++i) {
+    rotations.push_back(RotationY(degrees + i));
+  }
+  return rotations;
+}
+
+TEST(SrhtFrame, Keyframe)
+{
+  auto rotations = Pose(55, 10);
+  for (auto rotation : { RotationEncoding::Float4,
+                         RotationEncoding::Quat32,
+                         RotationEncoding::Quat48 }) {
+    Sender sender;
+    EncodedFrame encoded;
+    auto packet = sender.Encode(rotations, { .Rotation = rotation }, &encoded);
+    EXPECT_TRUE(IsKeyframe(encoded));
+    EXPECT_EQ(encoded.Rotations, rotations.size());
+
+    FrameData frame;
+    ASSERT_TRUE(DecodeFrame(packet, &frame));
+    EXPECT_TRUE(frame.Keyframe);
+    EXPECT_EQ(frame.SkeletonId, 3);
+    EXPECT_EQ(frame.Time.count(), 1000);
+    EXPECT_EQ(frame.RootPosition.z, 3);
+    ASSERT_EQ(frame.Rotations.size(), rotations.size());
+    for (size_t i = 0; i < rotations.size(); ++i) {
+      EXPECT_LT(AngleDegrees(frame.Rotations[i], rotations[i]), 0.2f) << i;
+    }
+  }
+}
+
+TEST(SrhtFrame, Delta)
+{
+  // over 32 joints. the mask has 3 words
+  auto rotations = Pose(70, 0);
+  for (auto rotation : { RotationEncoding::Float4,
+                         RotationEncoding::Quat32,
+                         RotationEncoding::Quat48 }) {
+    FrameEncoding encoding{ .Rotation = rotation, .Delta = true };
+    Sender sender;
+    FrameData frame;
+    ASSERT_TRUE(DecodeFrame(sender.Encode(rotations, encoding), &frame));
+
+    auto moved = rotations;
+    for (auto i : { 0, 31, 32, 33, 69 }) {
+      moved[i] = RotationY(90);
+    }
+    // below the threshold
+    moved[5] = RotationY(5.1f);
+
+    EncodedFrame encoded;
+    auto packet = sender.Encode(moved, encoding, &encoded);
+    EXPECT_FALSE(IsKeyframe(encoded));
+    EXPECT_EQ(encoded.Rotations, 5);
+
+    ASSERT_TRUE(DecodeFrame(packet, &frame));
+    EXPECT_FALSE(frame.Keyframe);
+    EXPECT_EQ(frame.Changed, 5);
+    for (size_t i = 0; i < moved.size(); ++i) {
+      EXPECT_LT(AngleDegrees(frame.Rotations[i], moved[i]), 0.6f) << i;
+    }
+    EXPECT_LT(AngleDegrees(frame.Rotations[5], rotations[5]), 0.2f);
+  }
+}
+
+TEST(SrhtFrame, KeyframeInterval)
+{
+  auto rotations = Pose(20, 0);
+  Sender sender;
+  FrameEncoding encoding{ .Delta = true, .KeyframeInterval = 4 };
+  for (int i = 0; i < 12; ++i) {
+    EncodedFrame encoded;
+    sender.Encode(rotations, encoding, &encoded);
+    EXPECT_EQ(IsKeyframe(encoded), i % 4 == 0) << i;
+  }
+
+  // the joint count changed
+  EncodedFrame encoded;
+  sender.Encode(Pose(21, 0), encoding, &encoded);
+  EXPECT_TRUE(IsKeyframe(encoded));
+}
+
+TEST(SrhtFrame, DeltaWaitsKeyframe)
+{
+  auto rotations = Pose(40, 0);
+  FrameEncoding encoding{ .Delta = true };
+  Sender sender;
+  auto keyframe = sender.Encode(rotations, encoding);
+  rotations[3] = RotationY(45);
+  auto delta = sender.Encode(rotations, encoding);
+
+  // the keyframe is lost
+  FrameData frame;
+  EXPECT_FALSE(DecodeFrame(delta, &frame));
+  EXPECT_TRUE(frame.Rotations.empty());
+
+  ASSERT_TRUE(DecodeFrame(keyframe, &frame));
+  ASSERT_TRUE(DecodeFrame(delta, &frame));
+  EXPECT_LT(AngleDegrees(frame.Rotations[3], rotations[3]), 0.2f);
+
+  // an other skeleton of a different joint count
+  FrameData other;
+  ASSERT_TRUE(DecodeFrame(Sender().Encode(Pose(39, 0), encoding), &other));
+  EXPECT_FALSE(DecodeFrame(delta, &other));
+}
+
+TEST(SrhtFrame, Truncated)
+{
+  auto rotations = Pose(40, 0);
+  for (auto rotation : { RotationEncoding::Float4,
+                         RotationEncoding::Quat32,
+                         RotationEncoding::Quat48 }) {
+    FrameEncoding encoding{ .Rotation = rotation, .Delta = true };
+    Sender sender;
+    auto keyframe = sender.Encode(rotations, encoding);
+    auto moved = rotations;
+    moved[10] = RotationY(90);
+    moved[20] = RotationY(90);
+    auto delta = sender.Encode(moved, encoding);
+
+    for (auto packet : { keyframe, delta }) {
+      FrameData frame;
+      ASSERT_TRUE(DecodeFrame(keyframe, &frame));
+      ASSERT_TRUE(DecodeFrame(packet, &frame));
+      // a rotation cut in the middle
+      packet.pop_back();
+      EXPECT_FALSE(DecodeFrame(packet, &frame));
+      // the header only
+      packet.resize(8 + sizeof(FrameHeader) - 1);
+      EXPECT_FALSE(DecodeFrame(packet, &frame));
+    }
+
+    // the mask is cut
+    FrameData frame;
+    ASSERT_TRUE(DecodeFrame(keyframe, &frame));
+    delta.resize(8 + sizeof(FrameHeader) + sizeof(DeltaHeader) + 2);
+    EXPECT_FALSE(DecodeFrame(delta, &frame));
+  }
+}
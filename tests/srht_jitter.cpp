@@ -0,0 +1,162 @@
+#include <gtest/gtest.h>
+#include <DirectXMath.h>
+#include <algorithm>
+#include <cmath>
+#include <vrm/network/srht_jitter.h>
+
+using namespace libvrm::srht;
+using namespace std::chrono_literals;
+
+// sender time to the local clock
+static const auto Epoch = std::chrono::steady_clock::time_point(1000s);
+static const auto Transit = 5ms;
+
+static std::chrono::steady_clock::time_point
+Arrival(std::chrono::nanoseconds time, std::chrono::nanoseconds late = {})
+{
+  return Epoch + time + Transit + late;
+}
+
+// the time to sample for the sender time t
+static std::chrono::steady_clock::time_point
+Playout(std::chrono::nanoseconds t)
+{
+  return Epoch + t + Transit;
+}
+
+static float
+Seconds(std::chrono::nanoseconds time)
+{
+  return std::chrono::duration<float>(time).count();
+}
+
+// root.x is the time in seconds. the joints turn 1 degree per millisecond
+static FrameData
+Frame(std::chrono::nanoseconds time, size_t joints = 3)
+{
+  FrameData frame;
+  frame.Time = time;
+  frame.RootPosition = { Seconds(time), 0, 0 };
+  frame.Keyframe = true;
+  auto angle = DirectX::XMConvertToRadians(Seconds(time) * 1000);
+  for (size_t i = 0; i < joints; ++i) {
+    DirectX::XMFLOAT4 q;
+    DirectX::XMStoreFloat4(
+      &q,
+      DirectX::XMQuaternionRotationAxis(DirectX::XMVectorSet(0, 1, 0, 0),
+                                        angle));
+    frame.Rotations.push_back(q);
+  }
+  return frame;
+}
+
+static float
+AngleDegrees(const DirectX::XMFLOAT4& q)
+{
+  return DirectX::XMConvertToDegrees(2 * std::atan2(q.y, q.w));
+}
+
+// no adaptive delay. a sample at t shows the sender time t
+static JitterBuffer
+NoDelay()
+{
+  JitterBuffer jitter;
+  jitter.MinDelay = 0;
+  jitter.MaxDelay = 0;
+  return jitter;
+}
+
+TEST(SrhtJitter, Interpolate)
+{
+  auto jitter = NoDelay();
+  FrameData out;
+  EXPECT_FALSE(jitter.Sample(Playout(0ms), &out));
+
+  for (auto t : { 0ms, 10ms, 20ms }) {
+    jitter.Push(Frame(t), Arrival(t));
+  }
+  ASSERT_TRUE(jitter.Sample(Playout(15ms), &out));
+  EXPECT_NEAR(out.RootPosition.x, 0.015f, 1e-4f);
+  ASSERT_EQ(out.Rotations.size(), 3);
+  EXPECT_NEAR(AngleDegrees(out.Rotations[2]), 15, 0.1f);
+  EXPECT_EQ(jitter.Stats().Received, 3);
+  EXPECT_EQ(jitter.Stats().Lost, 0);
+}
+
+TEST(SrhtJitter, Reorder)
+{
+  auto jitter = NoDelay();
+  // 20ms overtakes 10ms
+  jitter.Push(Frame(0ms), Arrival(0ms));
+  jitter.Push(Frame(20ms), Arrival(20ms));
+  jitter.Push(Frame(10ms), Arrival(20ms, 1ms));
+  jitter.Push(Frame(30ms), Arrival(30ms));
+  // duplicated
+  jitter.Push(Frame(30ms), Arrival(30ms, 1ms));
+  EXPECT_EQ(jitter.Size(), 4);
+  EXPECT_EQ(jitter.Stats().Lost, 0);
+
+  // played in the sender order
+  FrameData out;
+  for (auto t : { 0ms, 5ms, 10ms, 15ms, 20ms, 25ms, 30ms }) {
+    ASSERT_TRUE(jitter.Sample(Playout(t), &out));
+    EXPECT_NEAR(out.RootPosition.x, Seconds(t), 1e-4f) << t.count();
+    EXPECT_NEAR(AngleDegrees(out.Rotations[0]), Seconds(t) * 1000, 0.1f)
+      << t.count();
+  }
+  EXPECT_EQ(jitter.Stats().Late, 0);
+}
+
+TEST(SrhtJitter, Late)
+{
+  auto jitter = NoDelay();
+  for (auto t : { 0ms, 10ms, 30ms }) {
+    jitter.Push(Frame(t), Arrival(t));
+  }
+  FrameData out;
+  ASSERT_TRUE(jitter.Sample(Playout(25ms), &out));
+  EXPECT_NEAR(out.RootPosition.x, 0.025f, 1e-4f);
+  // the gap
+  EXPECT_EQ(jitter.Stats().Lost, 1);
+
+  // 20ms arrives after 25ms is played
+  auto size = jitter.Size();
+  jitter.Push(Frame(20ms), Arrival(20ms, 20ms));
+  EXPECT_EQ(jitter.Stats().Late, 1);
+  EXPECT_EQ(jitter.Size(), size);
+
+  // never goes back
+  ASSERT_TRUE(jitter.Sample(Playout(20ms), &out));
+  EXPECT_NEAR(out.RootPosition.x, 0.025f, 1e-4f);
+}
+
+TEST(SrhtJitter, Extrapolate)
+{
+  auto jitter = NoDelay();
+  jitter.MaxExtrapolation = 0.02;
+  for (auto t : { 0ms, 10ms, 20ms }) {
+    jitter.Push(Frame(t), Arrival(t));
+  }
+
+  // beyond the newest frame, within MaxExtrapolation
+  FrameData out;
+  ASSERT_TRUE(jitter.Sample(Playout(25ms), &out));
+  EXPECT_NEAR(out.RootPosition.x, 0.025f, 1e-4f);
+  EXPECT_NEAR(AngleDegrees(out.Rotations[0]), 25, 0.1f);
+  ASSERT_TRUE(jitter.Sample(Playout(38ms), &out));
+  EXPECT_NEAR(out.RootPosition.x, 0.038f, 1e-4f);
+  EXPECT_EQ(jitter.Stats().Extrapolated, 2);
+  EXPECT_EQ(jitter.Stats().Underrun, 0);
+
+  // over the limit. the newest frame is held
+  ASSERT_TRUE(jitter.Sample(Playout(41ms), &out));
+  EXPECT_NEAR(out.RootPosition.x, 0.02f, 1e-4f);
+  EXPECT_NEAR(AngleDegrees(out.Rotations[0]), 20, 0.1f);
+  EXPECT_EQ(jitter.Stats().Extrapolated, 2);
+  EXPECT_EQ(jitter.Stats().Underrun, 1);
+
+  // the next frame resumes
+  jitter.Push(Frame(50ms), Arrival(50ms));
+  ASSERT_TRUE(jitter.Sample(Playout(45ms), &out));
+  EXPECT_NEAR(out.RootPosition.x, 0.045f, 1e-4f);
+}